@@ -34,11 +34,273 @@ class BenchmarkScenario:
     iterations: int
     description: str
 
+@dataclass
+class EbpfVariant:
+    """Alternative mylib_tracer configuration benchmarked next to the default eBPF run"""
+    key: str  # Results are stored under method 'ebpf-<key>'
+    label: str
+    tracer_args: str
+    description: str
+    writes_trace: bool = False  # Pass an output path; trace size is measured, then deleted
+    app_lib_dir: Optional[str] = None  # Run sample_app against <build>/lib/<dir>/libmylib.so
+    sample_rate: Optional[int] = None  # --sample: 1 call in N is recorded (charted against N)
+
+# All available eBPF tracer variants (select with --ebpf-variants)
+EBPF_VARIANTS = [
+    EbpfVariant(
+        key="percpu-rb",
+        label="eBPF (per-CPU ringbuf)",
+        tracer_args="--percpu-rb",
+        description="One ringbuf and one pinned consumer thread per CPU (no shared reserve lock)"
+    ),
+    EbpfVariant(
+        key="perfbuf",
+        label="eBPF (perf buffer)",
+        tracer_args="--transport=perf",
+        description="BPF_MAP_TYPE_PERF_EVENT_ARRAY + perf_buffer instead of the ringbuf (pre-5.8 kernels)"
+    ),
+    EbpfVariant(
+        key="arena",
+        label="eBPF (arena rings)",
+        tracer_args="--transport=arena",
+        description="Per-CPU rings of fixed-size slots in an mmapped BPF arena, no wakeups, polled consumers"
+    ),
+    EbpfVariant(
+        key="arena-busy-poll",
+        label="eBPF (arena rings, busy-poll)",
+        tracer_args="--transport=arena --busy-poll",
+        description="Arena rings drained by one spinning consumer thread"
+    ),
+    EbpfVariant(
+        key="stage",
+        label="eBPF (kernel-side staging)",
+        tracer_args="--stage",
+        description="Records staged in per-CPU batches, one bpf_ringbuf_output per 32 events or 1 ms"
+    ),
+    EbpfVariant(
+        key="stage-128",
+        label="eBPF (kernel-side staging, 128/batch)",
+        tracer_args="--stage=128",
+        description="Per-CPU staging with 128 records per ringbuf record"
+    ),
+    EbpfVariant(
+        key="flight-recorder",
+        label="eBPF (flight recorder)",
+        tracer_args="--flight-recorder",
+        description="Last 4096 events per CPU overwritten in an mmapped array, no consumer; one snapshot on exit "
+                    "(compare with --lttng-snapshot)",
+        writes_trace=True
+    ),
+    EbpfVariant(
+        key="batch-consume",
+        label="eBPF (in-place batch consumer)",
+        tracer_args="--batch-consume",
+        description="Read runs of records in place from the mmapped ringbuf, one consumer update per run"
+    ),
+    EbpfVariant(
+        key="busy-poll",
+        label="eBPF (busy-poll consumer)",
+        tracer_args="--busy-poll",
+        description="Consumer spins on a dedicated core; producers submit without wakeups"
+    ),
+    EbpfVariant(
+        key="wakeup-adaptive",
+        label="eBPF (adaptive wakeup)",
+        tracer_args="--wakeup=adaptive",
+        description="Kernel default notification: wake only when the consumer has caught up"
+    ),
+    EbpfVariant(
+        key="wakeup-none",
+        label="eBPF (no wakeup, 1ms drain)",
+        tracer_args="--wakeup=none --drain-interval=1",
+        description="BPF_RB_NO_WAKEUP on every event, consumer drains every millisecond"
+    ),
+    EbpfVariant(
+        key="wakeup-batch",
+        label="eBPF (wakeup every 64)",
+        tracer_args="--wakeup=batch:64",
+        description="Force a wakeup every 64 events per CPU"
+    ),
+    EbpfVariant(
+        key="wakeup-watermark",
+        label="eBPF (wakeup at 25% full)",
+        tracer_args="--wakeup=watermark:25",
+        description="Force a wakeup once bpf_ringbuf_query() reports the ringbuf 25% full"
+    ),
+    EbpfVariant(
+        key="histogram",
+        label="eBPF (in-kernel histogram)",
+        tracer_args="--histogram",
+        description="Aggregate call latency into a per-CPU log2 histogram, no events sent to userspace"
+    ),
+    EbpfVariant(
+        key="sample-10",
+        label="eBPF (sample 1/10)",
+        tracer_args="--sample=10",
+        description="Record every 10th call per CPU; entry and exit stay paired",
+        sample_rate=10
+    ),
+    EbpfVariant(
+        key="sample-100",
+        label="eBPF (sample 1/100)",
+        tracer_args="--sample=100",
+        description="Record every 100th call per CPU",
+        sample_rate=100
+    ),
+    EbpfVariant(
+        key="sample-1000",
+        label="eBPF (sample 1/1000)",
+        tracer_args="--sample=1000",
+        description="Record every 1000th call per CPU",
+        sample_rate=1000
+    ),
+    EbpfVariant(
+        key="sample-random-100",
+        label="eBPF (random sample 1/100)",
+        tracer_args="--sample=random:100",
+        description="Record each call with probability 1/100 (bpf_get_prandom_u32)",
+        sample_rate=100
+    ),
+    EbpfVariant(
+        key="budget-cpu-2",
+        label="eBPF (governed, 2% CPU)",
+        tracer_args="--budget=cpu=2",
+        description="Governor raises and lowers the sampling divisor to keep the tracer under 2% of a core"
+    ),
+    EbpfVariant(
+        key="budget-events-100k",
+        label="eBPF (governed, 100k events/s)",
+        tracer_args="--budget=events=100000",
+        description="Governor keeps the recorded event rate under 100,000 events/s"
+    ),
+    EbpfVariant(
+        key="pid-filtered-out",
+        label="eBPF (app filtered out by TGID)",
+        tracer_args="--tgid=1",
+        description="Only PID 1 is traced: the app pays the bare uprobe trap plus the in-BPF TGID check"
+    ),
+    EbpfVariant(
+        key="combined",
+        label="eBPF (one span per call)",
+        tracer_args="--combined",
+        description="Entry stashes args in task storage; the exit probe emits one record with the duration"
+    ),
+    # Load-time feature switches, one at a time against the default, then all together
+    EbpfVariant(
+        key="no-kstats",
+        label="eBPF (no kernel stats)",
+        tracer_args="--no-kstats",
+        description="Statistics map lookups and atomic adds pruned from the programs at load time"
+    ),
+    EbpfVariant(
+        key="args-none",
+        label="eBPF (no arguments)",
+        tracer_args="--args=none",
+        description="Argument registers not read; entry records carry only the timestamp"
+    ),
+    EbpfVariant(
+        key="clock-boot",
+        label="eBPF (boot clock)",
+        tracer_args="--clock=boot",
+        description="Timestamps from bpf_ktime_get_boot_ns (CLOCK_BOOTTIME)"
+    ),
+    EbpfVariant(
+        key="clock-coarse",
+        label="eBPF (coarse clock)",
+        tracer_args="--clock=coarse",
+        description="Timestamps from bpf_ktime_get_coarse_ns: no clocksource read, jiffy resolution"
+    ),
+    EbpfVariant(
+        key="rb-output",
+        label="eBPF (bpf_ringbuf_output)",
+        tracer_args="--rb-output",
+        description="Records built on the BPF stack and copied with bpf_ringbuf_output instead of reserve/submit"
+    ),
+    EbpfVariant(
+        key="features-minimal",
+        label="eBPF (all features off)",
+        tracer_args="--no-kstats --args=none --clock=coarse",
+        description="No kernel stats, no arguments, coarse clock: the floor of the reserve/submit path"
+    ),
+    EbpfVariant(
+        key="text-file",
+        label="eBPF (text trace file)",
+        tracer_args="--format=text",
+        description="Write the babeltrace-like text trace on exit",
+        writes_trace=True
+    ),
+    EbpfVariant(
+        key="ctf-file",
+        label="eBPF (binary CTF trace)",
+        tracer_args="--format=ctf",
+        description="Write a babeltrace2-readable binary CTF trace on exit",
+        writes_trace=True
+    ),
+    EbpfVariant(
+        key="ctf-stream",
+        label="eBPF (streaming CTF)",
+        tracer_args="--stream --format=ctf",
+        description="Stream CTF to disk from a background writer thread while tracing",
+        writes_trace=True
+    ),
+    EbpfVariant(
+        key="usdt",
+        label="eBPF (USDT probes)",
+        tracer_args="--usdt",
+        description="Semaphore-gated USDT probes in the lib/usdt/ libmylib build instead of uprobe + uretprobe",
+        app_lib_dir="usdt"
+    ),
+    EbpfVariant(
+        key="functions-glob",
+        label="eBPF (--functions=*, BTF args)",
+        tracer_args="--functions='*' --format=text",
+        description="Generic probes on every exported libmylib function, arguments decoded from BTF",
+        writes_trace=True
+    ),
+]
+
+# Tracer-reported metrics shown in the variants table: (field, column header, format)
+VARIANT_METRIC_COLUMNS = [
+    ('delivery_latency_avg_ns', 'Delivery Latency Avg (μs)', lambda v: f"{v / 1000:.1f}"),
+    ('delivery_latency_max_ns', 'Delivery Latency Max (μs)', lambda v: f"{v / 1000:.1f}"),
+    ('hist_p50_ns', 'Call Latency p50 (ns)', lambda v: f"≤{v:.0f}"),
+    ('hist_p99_ns', 'Call Latency p99 (ns)', lambda v: f"≤{v:.0f}"),
+    ('trace_bytes_per_event', 'Trace Bytes/Event', lambda v: f"{v:.1f}"),
+    ('trace_write_ms', 'Trace Write (ms)', lambda v: f"{v:.1f}"),
+    ('writer_stall_ms', 'Writer Stalls (ms)', lambda v: f"{v:.1f}"),
+    ('attach_time_ms', 'Attach Time (ms)', lambda v: f"{v:.2f}"),
+    ('kernel_reserve_failures', 'Kernel Reserve Failures', lambda v: f"{v:.0f}"),
+    ('ringbuf_peak_pct', 'Ringbuf Peak Fill (%)', lambda v: f"{v:.1f}"),
+    ('consumer_cpu_pct', 'Consumer CPU (% core)', lambda v: f"{v:.1f}"),
+    ('sample_error_pct', 'Sampling Error (%)', lambda v: f"{v:.2f}"),
+    ('governor_divisor', 'Governor Final 1-in-N', lambda v: f"{v:.0f}"),
+    ('governor_reaction_ms', 'Governor Reaction Max (ms)', lambda v: f"{v:.0f}"),
+    ('governor_load_pct', 'Governor Steady Load (% budget)', lambda v: f"{v:.1f}"),
+]
+
+# Symbol counts for the mylib_tracer --resolve-bench measurement
+RESOLVE_BENCH_SYMBOLS = [1, 1000]
+
+# Probe-count scaling (--probe-scaling): how many libfanout functions are probed,
+# and the --functions glob selecting exactly those (fanout_0000 .. fanout_0999)
+PROBE_SCALING_FUNCTIONS = [
+    (1, 'fanout_0000'),
+    (10, 'fanout_000?'),
+    (100, 'fanout_00??'),
+    (1000, 'fanout_0???'),
+]
+PROBE_SCALING_CALLS = 1000000
+# Attach modes compared at every probe count: (key, extra tracer args)
+PROBE_SCALING_MODES = [
+    ('per-function', ''),
+    ('uprobe-multi', '--uprobe-multi'),
+]
+
 @dataclass
 class BenchmarkResult:
     """Results from a single benchmark run with statistical measures"""
     scenario: str
-    method: str  # 'baseline', 'lttng', or 'ebpf'
+    method: str  # 'baseline', 'lttng', 'lttng-snapshot', or 'ebpf'
     iterations: int
     simulated_work_us: int
     wall_time_s: float
@@ -58,6 +320,25 @@ class BenchmarkResult:
     avg_time_max: Optional[float] = None
     wall_time_stddev: Optional[float] = None
     confidence_95_margin: Optional[float] = None
+    # Multi-threaded workload mode
+    threads: int = 1
+    calls_per_sec: Optional[float] = None  # Aggregate throughput across all threads
+    # Metrics reported by mylib_tracer on exit
+    delivery_latency_avg_ns: Optional[float] = None  # Ringbuf submit -> consumer
+    delivery_latency_max_ns: Optional[float] = None
+    hist_p50_ns: Optional[float] = None  # Histogram mode: bucket upper bounds
+    hist_p99_ns: Optional[float] = None
+    trace_bytes_per_event: Optional[float] = None  # Trace size / events written
+    trace_write_ms: Optional[float] = None  # Time to write the trace file on exit
+    writer_stall_ms: Optional[float] = None  # Streaming: consumers blocked on the writer
+    attach_time_ms: Optional[float] = None  # Symbol resolution + uprobe attach
+    kernel_reserve_failures: Optional[float] = None  # Events lost in the kernel (ringbuf full)
+    ringbuf_peak_pct: Optional[float] = None  # Highest ringbuf fill level seen while tracing
+    consumer_cpu_pct: Optional[float] = None  # Consumer threads' CPU time / tracing wall time
+    sample_error_pct: Optional[float] = None  # --sample: |estimated calls - actual| / actual
+    governor_divisor: Optional[float] = None  # --budget: sampling divisor when tracing stopped
+    governor_reaction_ms: Optional[float] = None  # Longest stretch over budget before recovering
+    governor_load_pct: Optional[float] = None  # Mean load within budget, as % of the budget
 
 class BenchmarkSuite:
     """Manages the comprehensive benchmark suite"""
@@ -102,10 +383,20 @@ class BenchmarkSuite:
         ),
     ]
 
-    def __init__(self, build_dir: Path, num_runs: int = 10, scenario_indices: Optional[List[int]] = None):
+    def __init__(self, build_dir: Path, num_runs: int = 10, scenario_indices: Optional[List[int]] = None,
+                 thread_counts: Optional[List[int]] = None, ebpf_variants: Optional[List[str]] = None,
+                 probe_scaling: bool = False, lttng_snapshot: bool = False):
         self.build_dir = Path(build_dir)
         self.num_runs = num_runs  # Number of times to run each test for statistical reliability
+        # Thread counts to run every scenario at; the first one feeds the main charts
+        self.thread_counts = thread_counts or [1]
+        # Extra eBPF tracer configurations to run after the default one
+        self.ebpf_variants = [v for v in EBPF_VARIANTS if v.key in (ebpf_variants or [])]
         self.results: List[BenchmarkResult] = []
+        self.resolve_results: List[Dict] = []  # mylib_tracer --resolve-bench timings
+        self.probe_scaling = probe_scaling
+        self.lttng_snapshot = lttng_snapshot  # Also run LTTng in snapshot (flight recorder) mode
+        self.probe_scaling_results: List[Dict] = []  # Attach/detach and per-call cost vs probe count
         self.timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
         self.output_dir = Path(f"benchmark_results_{self.timestamp}")
         self.output_dir.mkdir(exist_ok=True)
@@ -154,11 +445,28 @@ class BenchmarkSuite:
         return data
 
     def parse_app_output(self, output: str) -> Dict[str, float]:
-        """Parse sample app output for per-call timing"""
+        """Parse sample app output for per-call timing and aggregate throughput"""
+        data = {}
         avg_time_match = re.search(r'Average time per call:\s+([\d.]+)', output)
         if avg_time_match:
-            return {'avg_time_ns': float(avg_time_match.group(1))}
-        return {}
+            data['avg_time_ns'] = float(avg_time_match.group(1))
+
+        # Multi-threaded runs report aggregate throughput directly
+        throughput_match = re.search(r'Aggregate throughput:\s+([\d.]+) calls/s', output)
+        completed_match = re.search(r'Completed (\d+) iterations in ([\d.]+) seconds', output)
+        if throughput_match:
+            data['calls_per_sec'] = float(throughput_match.group(1))
+        elif completed_match and float(completed_match.group(2)) > 0:
+            data['calls_per_sec'] = int(completed_match.group(1)) / float(completed_match.group(2))
+        return data
+
+    def app_command(self, scenario: BenchmarkScenario, threads: int = 1) -> str:
+        """Build the timed sample_app command line for a scenario"""
+        cmd = f'/usr/bin/time -f "wall_time=%e user_time=%U sys_time=%S max_rss=%M" ' \
+              f'{self.build_dir}/bin/sample_app {scenario.iterations}'
+        if threads > 1:
+            cmd += f' {threads}'
+        return cmd
 
     def aggregate_multiple_runs(self, results: List[BenchmarkResult]) -> BenchmarkResult:
         """Aggregate multiple benchmark runs into a single result with statistics"""
@@ -217,16 +525,198 @@ class BenchmarkSuite:
         if events_caps:
             aggregated.events_captured = int(statistics.mean(events_caps))
 
+        events_drops = [r.events_dropped for r in results if r.events_dropped is not None]
+        if events_drops:
+            aggregated.events_dropped = int(statistics.mean(events_drops))
+
+        throughputs = [r.calls_per_sec for r in results if r.calls_per_sec is not None]
+        if throughputs:
+            aggregated.calls_per_sec = statistics.mean(throughputs)
+
+        # Tracer-reported metrics: average whatever the runs reported
+        for field, _, _ in VARIANT_METRIC_COLUMNS:
+            values = [getattr(r, field) for r in results if getattr(r, field) is not None]
+            if values:
+                setattr(aggregated, field, statistics.mean(values))
+
         return aggregated
 
-    def run_baseline_single(self, scenario: BenchmarkScenario) -> BenchmarkResult:
+    def parse_tracer_output(self, output: str) -> Dict[str, float]:
+        """Parse mylib_tracer's exit summary"""
+        data = {}
+        captured_match = re.search(r'Captured (\d+) events', output)
+        if captured_match:
+            data['events_captured'] = int(captured_match.group(1))
+
+        latency_match = re.search(r'Delivery latency: avg ([\d.]+) ns, max (\d+) ns', output)
+        if latency_match:
+            data['delivery_latency_avg_ns'] = float(latency_match.group(1))
+            data['delivery_latency_max_ns'] = float(latency_match.group(2))
+
+        # Histogram mode reports aggregated calls instead of captured events
+        hist_match = re.search(
+            r'Histogram: (\d+) calls, avg [\d.]+ ns, p50 <= (\d+) ns, p99 <= (\d+) ns', output)
+        if hist_match:
+            data['events_captured'] = int(hist_match.group(1))
+            data['hist_p50_ns'] = float(hist_match.group(2))
+            data['hist_p99_ns'] = float(hist_match.group(3))
+
+        size_match = re.search(
+            r'Trace size: (\d+) bytes \(([\d.]+) bytes/event\), written in ([\d.]+) ms', output)
+        if size_match:
+            data['trace_size_bytes'] = int(size_match.group(1))
+            data['trace_bytes_per_event'] = float(size_match.group(2))
+            data['trace_write_ms'] = float(size_match.group(3))
+
+        stall_match = re.search(r'Writer backpressure: \d+ stalls, ([\d.]+) ms stalled', output)
+        if stall_match:
+            data['writer_stall_ms'] = float(stall_match.group(1))
+
+        attach_match = re.search(r'Attach time: ([\d.]+) ms', output)
+        if attach_match:
+            data['attach_time_ms'] = float(attach_match.group(1))
+        detach_match = re.search(r'Detach time: ([\d.]+) ms', output)
+        if detach_match:
+            data['detach_time_ms'] = float(detach_match.group(1))
+
+        consumer_match = re.search(r'Consumer CPU: [\d.]+ ms over [\d.]+ ms of tracing \(([\d.]+)% of one core', output)
+        if consumer_match:
+            data['consumer_cpu_pct'] = float(consumer_match.group(1))
+
+        sample_match = re.search(r'Sampling: 1 in \d+ calls \([^)]*\), \d+ calls sampled, ~(\d+) calls estimated', output)
+        if sample_match:
+            data['calls_estimated'] = int(sample_match.group(1))
+
+        governor_match = re.search(r'Governor: budget .*?, sampling 1 in \d+\.\.\d+ \(final (\d+)\)', output)
+        if governor_match:
+            data['governor_divisor'] = int(governor_match.group(1))
+        reaction_match = re.search(
+            r'Governor: \d+ over-budget episodes, reaction avg [\d.]+ ms, max ([\d.]+) ms, '
+            r'steady state at ([\d.]+)% of budget', output)
+        if reaction_match:
+            data['governor_reaction_ms'] = float(reaction_match.group(1))
+            data['governor_load_pct'] = float(reaction_match.group(2))
+
+        # Kernel-side counters from the statistics map (machine-readable line)
+        stats_match = re.search(r'Kernel stats JSON: (\{.*\})', output)
+        if stats_match:
+            try:
+                kstats = json.loads(stats_match.group(1))
+                data['kernel_reserve_failures'] = kstats['reserve_failures']
+                data['kernel_events_dropped'] = kstats['events_dropped']
+                data['ringbuf_peak_pct'] = kstats.get('ringbuf_peak_pct')  # Only with --stats/--budget
+            except (ValueError, KeyError):
+                pass
+        return data
+
+    def find_libc(self) -> Optional[str]:
+        """Path of the libc sample_app links against (a large real-world symbol table)"""
+        try:
+            result = self.run_command(f"ldd {self.build_dir}/bin/sample_app")
+            match = re.search(r'libc\.so\.6 => (\S+)', result.stdout)
+            return match.group(1) if match else None
+        except Exception:
+            return None
+
+    def run_symbol_resolution(self):
+        """Time in-process symbol resolution for 1 and 1000 functions (no root needed)"""
+        print(f"\n  [SYMBOLS] Resolving {', '.join(str(n) for n in RESOLVE_BENCH_SYMBOLS)} symbol(s)")
+        libraries = [self.build_dir / 'lib' / 'libmylib.so']
+        libc = self.find_libc()
+        if libc:
+            libraries.append(Path(libc))
+
+        for library in libraries:
+            for count in RESOLVE_BENCH_SYMBOLS:
+                result = self.run_command(
+                    f"{self.build_dir}/bin/mylib_tracer --library={library} --resolve-bench={count}")
+                match = re.search(
+                    r'Resolved (\d+)/(\d+) symbols from \S+: index ([\d.]+) us \((\d+) functions\), '
+                    r'lookup ([\d.]+) us', result.stdout)
+                if not match:
+                    print(f"    Warning: no resolve-bench output for {library}")
+                    continue
+                self.resolve_results.append({
+                    'library': library.name,
+                    'symbols': int(match.group(2)),
+                    'found': int(match.group(1)),
+                    'functions_indexed': int(match.group(4)),
+                    'index_us': float(match.group(3)),
+                    'lookup_us': float(match.group(5)),
+                })
+
+    def run_fanout_app(self, functions: int) -> float:
+        """Time PROBE_SCALING_CALLS round-robin calls over the first N libfanout functions (ns/call)"""
+        result = self.run_command(f"{self.build_dir}/bin/fanout_app {functions} {PROBE_SCALING_CALLS}")
+        return self.parse_app_output(result.stdout).get('avg_time_ns', 0)
+
+    def run_probe_scaling_single(self, pattern: str, functions: int, mode_args: str) -> Dict[str, float]:
+        """Attach to N libfanout functions, run fanout_app, detach; returns the timings"""
+        tracer_cmd = (f"sudo {self.build_dir}/bin/mylib_tracer --library={self.build_dir}/lib/libfanout.so "
+                      f"--functions='{pattern}' {mode_args}")
+        tracer_proc = subprocess.Popen(
+            tracer_cmd,
+            shell=True,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            text=True
+        )
+        # Wait for tracer to attach
+        time.sleep(2)
+        call_ns = self.run_fanout_app(functions)
+
+        time.sleep(1)
+        self.run_command("sudo pkill -INT -f 'mylib_tracer --library=' 2>/dev/null || true")
+        tracer_output = ""
+        try:
+            tracer_output, _ = tracer_proc.communicate(timeout=30)
+        except subprocess.TimeoutExpired:
+            self.run_command("sudo pkill -9 -f 'mylib_tracer --library=' 2>/dev/null || true")
+        tracer_data = self.parse_tracer_output(tracer_output or "")
+        return {
+            'attach_time_ms': tracer_data.get('attach_time_ms'),
+            'detach_time_ms': tracer_data.get('detach_time_ms'),
+            'call_ns': call_ns,
+        }
+
+    def run_probe_scaling(self):
+        """Attach/detach latency and per-call overhead with 1-1000 probed functions"""
+        if not (self.build_dir / 'bin' / 'fanout_app').exists():
+            print("\n  [PROBES] fanout_app not built, skipping probe-count scaling")
+            return
+        print(f"\n  [PROBES] Probing {', '.join(str(n) for n, _ in PROBE_SCALING_FUNCTIONS)} "
+              f"libfanout function(s), {self.num_runs} run(s) each")
+
+        for functions, pattern in PROBE_SCALING_FUNCTIONS:
+            untraced_ns = statistics.mean(self.run_fanout_app(functions) for _ in range(self.num_runs))
+            for mode, mode_args in PROBE_SCALING_MODES:
+                runs = [self.run_probe_scaling_single(pattern, functions, mode_args)
+                        for _ in range(self.num_runs)]
+                attach = [r['attach_time_ms'] for r in runs if r['attach_time_ms'] is not None]
+                detach = [r['detach_time_ms'] for r in runs if r['detach_time_ms'] is not None]
+                if not attach:
+                    print(f"    Warning: {mode} attach to {functions} function(s) failed")
+                    continue
+                call_ns = statistics.mean(r['call_ns'] for r in runs)
+                self.probe_scaling_results.append({
+                    'functions': functions,
+                    'mode': mode,
+                    'attach_ms': statistics.mean(attach),
+                    'detach_ms': statistics.mean(detach) if detach else None,
+                    'call_ns': call_ns,
+                    'untraced_call_ns': untraced_ns,
+                    'overhead_ns': call_ns - untraced_ns,
+                })
+                print(f"    {functions:>4} functions, {mode}: attach {statistics.mean(attach):.1f} ms, "
+                      f"{call_ns - untraced_ns:.0f} ns/call overhead")
+
+    def run_baseline_single(self, scenario: BenchmarkScenario, threads: int = 1) -> BenchmarkResult:
         """Run a single baseline (no tracing) test"""
         env = {}
         if scenario.simulated_work_us > 0:
             env['SIMULATED_WORK_US'] = str(scenario.simulated_work_us)
 
-        cmd = f'/usr/bin/time -f "wall_time=%e user_time=%U sys_time=%S max_rss=%M" ' \
-              f'{self.build_dir}/bin/sample_app {scenario.iterations}'
+        cmd = self.app_command(scenario, threads)
 
         result = self.run_command(cmd, env=env)
         time_data = self.parse_time_output(result.stderr)
@@ -241,31 +731,40 @@ class BenchmarkSuite:
             user_cpu_s=time_data.get('user_time', 0),
             system_cpu_s=time_data.get('sys_time', 0),
             max_rss_kb=int(time_data.get('max_rss', 0)),
-            avg_time_per_call_ns=app_data.get('avg_time_ns', 0)
+            avg_time_per_call_ns=app_data.get('avg_time_ns', 0),
+            threads=threads,
+            calls_per_sec=app_data.get('calls_per_sec')
         )
 
-    def run_baseline(self, scenario: BenchmarkScenario) -> BenchmarkResult:
+    def run_baseline(self, scenario: BenchmarkScenario, threads: int = 1) -> BenchmarkResult:
         """Run baseline (no tracing) test multiple times for statistical reliability"""
-        print(f"\n  [BASELINE] {scenario.name} - Running {self.num_runs} times for statistical reliability")
+        print(f"\n  [BASELINE] {scenario.name} ({threads} thread(s)) - Running {self.num_runs} times for statistical reliability")
 
         results = []
         for run_num in range(self.num_runs):
             if run_num % 10 == 0:  # Progress indicator every 10 runs
                 print(f"    Run {run_num + 1}/{self.num_runs}...", end='\r')
-            results.append(self.run_baseline_single(scenario))
+            results.append(self.run_baseline_single(scenario, threads))
 
         print(f"    Completed {self.num_runs} runs                    ")
         return self.aggregate_multiple_runs(results)
 
-    def run_lttng_single(self, scenario: BenchmarkScenario, run_num: int = 0) -> BenchmarkResult:
-        """Run a single LTTng tracing test"""
-        session_name = f"mylib_bench_{scenario.simulated_work_us}us_r{run_num}"
+    def run_lttng_single(self, scenario: BenchmarkScenario, run_num: int = 0, threads: int = 1,
+                         snapshot: bool = False) -> BenchmarkResult:
+        """Run a single LTTng tracing test
+
+        In snapshot mode the session's ring buffers are overwritten instead of
+        consumed, and their contents are recorded once after the run.
+        """
+        method = 'lttng-snapshot' if snapshot else 'lttng'
+        session_name = f"mylib_bench_{method.replace('-', '_')}_{scenario.simulated_work_us}us_t{threads}_r{run_num}"
+        trace_path = self.output_dir / f"{method}_{scenario.simulated_work_us}us_t{threads}_r{run_num}"
 
         # Clean up any existing session
         self.run_command(f"lttng destroy {session_name} 2>/dev/null || true", capture_output=False)
 
         # Create and configure session
-        self.run_command(f"lttng create {session_name} --output={self.output_dir}/lttng_{scenario.simulated_work_us}us_r{run_num}")
+        self.run_command(f"lttng create {session_name}{' --snapshot' if snapshot else ''} --output={trace_path}")
         self.run_command(f"lttng enable-event -u mylib:*")
         self.run_command(f"lttng start")
 
@@ -274,19 +773,19 @@ class BenchmarkSuite:
         if scenario.simulated_work_us > 0:
             env['SIMULATED_WORK_US'] = str(scenario.simulated_work_us)
 
-        cmd = f'/usr/bin/time -f "wall_time=%e user_time=%U sys_time=%S max_rss=%M" ' \
-              f'{self.build_dir}/bin/sample_app {scenario.iterations}'
+        cmd = self.app_command(scenario, threads)
 
         result = self.run_command(cmd, env=env)
         time_data = self.parse_time_output(result.stderr)
         app_data = self.parse_app_output(result.stdout)
 
         # Stop and get trace size
+        if snapshot:
+            self.run_command(f"lttng snapshot record")
         self.run_command(f"lttng stop")
         self.run_command(f"lttng destroy {session_name}")
 
         # Get trace size
-        trace_path = self.output_dir / f"lttng_{scenario.simulated_work_us}us_r{run_num}"
         trace_size = 0
         if trace_path.exists():
             trace_size = sum(f.stat().st_size for f in trace_path.rglob('*') if f.is_file())
@@ -298,7 +797,7 @@ class BenchmarkSuite:
 
         return BenchmarkResult(
             scenario=scenario.name,
-            method='lttng',
+            method=method,
             iterations=scenario.iterations,
             simulated_work_us=scenario.simulated_work_us,
             wall_time_s=time_data.get('wall_time', 0),
@@ -306,27 +805,38 @@ class BenchmarkSuite:
             system_cpu_s=time_data.get('sys_time', 0),
             max_rss_kb=int(time_data.get('max_rss', 0)),
             avg_time_per_call_ns=app_data.get('avg_time_ns', 0),
-            trace_size_mb=trace_size / (1024 * 1024)
+            trace_size_mb=trace_size / (1024 * 1024),
+            threads=threads,
+            calls_per_sec=app_data.get('calls_per_sec'),
+            trace_bytes_per_event=trace_size / (scenario.iterations * threads * 2) if trace_size else None
         )
 
-    def run_lttng(self, scenario: BenchmarkScenario) -> BenchmarkResult:
+    def run_lttng(self, scenario: BenchmarkScenario, threads: int = 1, snapshot: bool = False) -> BenchmarkResult:
         """Run LTTng tracing test multiple times for statistical reliability"""
-        print(f"\n  [LTTNG] {scenario.name} - Running {self.num_runs} times for statistical reliability")
+        tag = "LTTNG SNAPSHOT" if snapshot else "LTTNG"
+        print(f"\n  [{tag}] {scenario.name} ({threads} thread(s)) - Running {self.num_runs} times for statistical reliability")
 
         results = []
         for run_num in range(self.num_runs):
             if run_num % 10 == 0:  # Progress indicator every 10 runs
                 print(f"    Run {run_num + 1}/{self.num_runs}...", end='\r')
-            results.append(self.run_lttng_single(scenario, run_num))
+            results.append(self.run_lttng_single(scenario, run_num, threads, snapshot))
 
         print(f"    Completed {self.num_runs} runs                    ")
         return self.aggregate_multiple_runs(results)
 
-    def run_ebpf_single(self, scenario: BenchmarkScenario, run_num: int = 0) -> BenchmarkResult:
+    def run_ebpf_single(self, scenario: BenchmarkScenario, run_num: int = 0, threads: int = 1,
+                        variant: Optional[EbpfVariant] = None) -> BenchmarkResult:
         """Run a single eBPF tracing test"""
         # Run tracer without file output for minimal overhead (benchmark mode)
         # Tracer will only collect events in memory
         tracer_cmd = f"sudo {self.build_dir}/bin/mylib_tracer"
+        if variant:
+            tracer_cmd += f" {variant.tracer_args}"
+        trace_path = None
+        if variant and variant.writes_trace:
+            trace_path = self.output_dir / f"ebpf_{variant.key}_{scenario.simulated_work_us}us_t{threads}_r{run_num}"
+            tracer_cmd += f" {trace_path}"
         tracer_proc = subprocess.Popen(
             tracer_cmd,
             shell=True,
@@ -369,8 +879,11 @@ class BenchmarkSuite:
         if scenario.simulated_work_us > 0:
             env['SIMULATED_WORK_US'] = str(scenario.simulated_work_us)
 
-        cmd = f'/usr/bin/time -f "wall_time=%e user_time=%U sys_time=%S max_rss=%M" ' \
-              f'{self.build_dir}/bin/sample_app {scenario.iterations}'
+        if variant and variant.app_lib_dir:
+            # sample_app uses RUNPATH, so LD_LIBRARY_PATH swaps in the variant library
+            env['LD_LIBRARY_PATH'] = f"{self.build_dir}/lib/{variant.app_lib_dir}"
+
+        cmd = self.app_command(scenario, threads)
 
         app_start = time.time()
         result = self.run_command(cmd, env=env)
@@ -401,23 +914,34 @@ class BenchmarkSuite:
             except:
                 pass
 
-        # Stop tracer
+        # Stop tracer and collect its exit summary
         time.sleep(1)
         self.run_command(f"sudo kill -INT {tracer_pid} 2>/dev/null || true")
+        tracer_output = ""
         try:
-            tracer_proc.wait(timeout=5)
+            # Writing a trace file happens after SIGINT, so allow it more time
+            tracer_output, _ = tracer_proc.communicate(timeout=60 if trace_path else 5)
         except subprocess.TimeoutExpired:
             self.run_command(f"sudo kill -9 {tracer_pid} 2>/dev/null || true")
-
-        # In benchmark mode, we don't write trace files (no file I/O overhead)
-        # We only collect event counts in memory
-        # Trace size is not applicable in this mode
-        trace_size = 0  # Not written to disk
-        events_captured = scenario.iterations * 2  # entry + exit per call (estimated)
+        tracer_data = self.parse_tracer_output(tracer_output or "")
+
+        # By default the tracer keeps events in memory only (no file I/O overhead).
+        # Variants that write a trace report its size; delete it right away.
+        trace_size = tracer_data.get('trace_size_bytes', 0)
+        if trace_path:
+            self.run_command(f"sudo rm -rf {trace_path}")
+        events_captured = tracer_data.get(
+            'events_captured', scenario.iterations * threads * 2)  # entry + exit per call (estimated)
+
+        # Sampling accuracy: the tracer's scaled-up call count against the calls actually made
+        expected_calls = scenario.iterations * threads
+        if 'calls_estimated' in tracer_data and expected_calls:
+            tracer_data['sample_error_pct'] = \
+                abs(tracer_data['calls_estimated'] - expected_calls) / expected_calls * 100
 
         return BenchmarkResult(
             scenario=scenario.name,
-            method='ebpf',
+            method=f'ebpf-{variant.key}' if variant else 'ebpf',
             iterations=scenario.iterations,
             simulated_work_us=scenario.simulated_work_us,
             wall_time_s=time_data.get('wall_time', 0),
@@ -428,18 +952,25 @@ class BenchmarkSuite:
             trace_size_mb=trace_size / (1024 * 1024),
             tracer_cpu_percent=tracer_cpu_percent,
             tracer_memory_kb=tracer_mem_after,
-            events_captured=events_captured
+            events_captured=events_captured,
+            events_dropped=(tracer_data['kernel_reserve_failures'] + tracer_data['kernel_events_dropped']
+                            if 'kernel_reserve_failures' in tracer_data else None),
+            threads=threads,
+            calls_per_sec=app_data.get('calls_per_sec'),
+            **{field: tracer_data.get(field) for field, _, _ in VARIANT_METRIC_COLUMNS}
         )
 
-    def run_ebpf(self, scenario: BenchmarkScenario) -> BenchmarkResult:
+    def run_ebpf(self, scenario: BenchmarkScenario, threads: int = 1,
+                 variant: Optional[EbpfVariant] = None) -> BenchmarkResult:
         """Run eBPF tracing test multiple times for statistical reliability"""
-        print(f"\n  [EBPF] {scenario.name} - Running {self.num_runs} times for statistical reliability")
+        tag = f"EBPF:{variant.key}" if variant else "EBPF"
+        print(f"\n  [{tag}] {scenario.name} ({threads} thread(s)) - Running {self.num_runs} times for statistical reliability")
 
         results = []
         for run_num in range(self.num_runs):
             if run_num % 10 == 0:  # Progress indicator every 10 runs
                 print(f"    Run {run_num + 1}/{self.num_runs}...", end='\r')
-            results.append(self.run_ebpf_single(scenario, run_num))
+            results.append(self.run_ebpf_single(scenario, run_num, threads, variant))
 
         print(f"    Completed {self.num_runs} runs                    ")
         return self.aggregate_multiple_runs(results)
@@ -455,32 +986,63 @@ class BenchmarkSuite:
             print(f"Scenario: {scenario.name}")
             print(f"  Work Duration: {scenario.simulated_work_us} μs")
             print(f"  Iterations: {scenario.iterations:,}")
+            print(f"  Threads: {', '.join(str(t) for t in self.thread_counts)}")
             print(f"  Description: {scenario.description}")
             print('='*70)
 
-            # Run all three methods
-            try:
-                baseline = self.run_baseline(scenario)
-                self.results.append(baseline)
-            except Exception as e:
-                print(f"  ERROR in baseline: {e}")
+            for threads in self.thread_counts:
+                # Run all three methods
+                try:
+                    baseline = self.run_baseline(scenario, threads)
+                    self.results.append(baseline)
+                except Exception as e:
+                    print(f"  ERROR in baseline: {e}")
+
+                try:
+                    lttng = self.run_lttng(scenario, threads)
+                    self.results.append(lttng)
+                except Exception as e:
+                    print(f"  ERROR in LTTng: {e}")
+
+                if self.lttng_snapshot:
+                    try:
+                        self.results.append(self.run_lttng(scenario, threads, snapshot=True))
+                    except Exception as e:
+                        print(f"  ERROR in LTTng snapshot: {e}")
+
+                try:
+                    ebpf = self.run_ebpf(scenario, threads)
+                    self.results.append(ebpf)
+                except Exception as e:
+                    print(f"  ERROR in eBPF: {e}")
+
+                for variant in self.ebpf_variants:
+                    try:
+                        self.results.append(self.run_ebpf(scenario, threads, variant))
+                    except Exception as e:
+                        print(f"  ERROR in eBPF variant {variant.key}: {e}")
 
-            try:
-                lttng = self.run_lttng(scenario)
-                self.results.append(lttng)
-            except Exception as e:
-                print(f"  ERROR in LTTng: {e}")
+        try:
+            self.run_symbol_resolution()
+        except Exception as e:
+            print(f"  ERROR in symbol resolution benchmark: {e}")
 
+        if self.probe_scaling:
             try:
-                ebpf = self.run_ebpf(scenario)
-                self.results.append(ebpf)
+                self.run_probe_scaling()
             except Exception as e:
-                print(f"  ERROR in eBPF: {e}")
+                print(f"  ERROR in probe-count scaling benchmark: {e}")
 
         # Save results to JSON
         results_file = self.output_dir / "results.json"
         with open(results_file, 'w') as f:
             json.dump([asdict(r) for r in self.results], f, indent=2)
+        if self.resolve_results:
+            with open(self.output_dir / "symbol_resolution.json", 'w') as f:
+                json.dump(self.resolve_results, f, indent=2)
+        if self.probe_scaling_results:
+            with open(self.output_dir / "probe_scaling.json", 'w') as f:
+                json.dump(self.probe_scaling_results, f, indent=2)
 
         print(f"\n{'='*70}")
         print(f"Results saved to: {results_file}")
@@ -571,9 +1133,12 @@ class BenchmarkSuite:
 
     def _generate_html(self) -> str:
         """Generate the HTML content for the report"""
-        # Prepare data for charts
+        # Prepare data for charts (main charts use the first thread count only)
+        primary_threads = self.thread_counts[0]
         scenarios_data = {}
         for result in self.results:
+            if result.threads != primary_threads:
+                continue
             if result.scenario not in scenarios_data:
                 scenarios_data[result.scenario] = {}
             scenarios_data[result.scenario][result.method] = result
@@ -631,6 +1196,258 @@ class BenchmarkSuite:
         js_lttng_app_overhead_pct = json.dumps([d.get('lttng_app_overhead_pct', 0) for d in overhead_data])
         js_ebpf_app_overhead_pct = json.dumps([d.get('ebpf_app_overhead_pct', 0) for d in overhead_data])
 
+        # Thread scaling: throughput and per-call overhead vs thread count, per scenario and method
+        scaling_data = {}
+        for result in self.results:
+            scaling_data.setdefault(result.scenario, {}).setdefault(result.method, {})[result.threads] = result
+        scaling_traces = []
+        for scenario_name, methods in scaling_data.items():
+            baseline_by_threads = methods.get('baseline', {})
+            for method, by_threads in methods.items():
+                thread_list = sorted(by_threads)
+                overheads = []
+                for t in thread_list:
+                    base = baseline_by_threads.get(t)
+                    if base and base.avg_time_per_call_ns > 0:
+                        overheads.append(((by_threads[t].avg_time_per_call_ns / base.avg_time_per_call_ns) - 1) * 100)
+                    else:
+                        overheads.append(None)
+                scaling_traces.append({
+                    'scenario': scenario_name,
+                    'method': method,
+                    'threads': thread_list,
+                    'calls_per_sec': [by_threads[t].calls_per_sec or 0 for t in thread_list],
+                    'overhead_pct': overheads
+                })
+        show_scaling = len(self.thread_counts) > 1
+
+        # eBPF tracer variants: every 'ebpf*' method against the baseline at the same thread
+        # count, with LTTng snapshot mode next to the flight recorder
+        method_labels = {'baseline': 'Baseline', 'lttng': 'LTTng', 'lttng-snapshot': 'LTTng (snapshot mode)',
+                         'ebpf': 'eBPF'}
+        method_labels.update({f'ebpf-{v.key}': v.label for v in EBPF_VARIANTS})
+        variant_rows = []
+        for scenario_name, methods in scaling_data.items():
+            baseline_by_threads = methods.get('baseline', {})
+            for method, by_threads in methods.items():
+                if not method.startswith('ebpf') and method != 'lttng-snapshot':
+                    continue
+                for t in sorted(by_threads):
+                    r = by_threads[t]
+                    base = baseline_by_threads.get(t)
+                    overhead_ns = r.avg_time_per_call_ns - base.avg_time_per_call_ns if base else None
+                    variant_rows.append({
+                        'scenario': scenario_name,
+                        'threads': t,
+                        'method': method,
+                        'label': method_labels.get(method, method),
+                        'result': r,
+                        'overhead_ns': overhead_ns
+                    })
+        show_variants = any(row['method'] != 'ebpf' for row in variant_rows)
+        metric_columns = [(field, header, fmt) for field, header, fmt in VARIANT_METRIC_COLUMNS
+                          if any(getattr(row['result'], field) is not None for row in variant_rows)]
+        variants_section = ""
+        if show_variants:
+            variants_section = """
+        <h2>🧪 eBPF Tracer Variants</h2>
+        <p><em>Alternative <code>mylib_tracer</code> configurations run on the same workload. Overhead is relative to the baseline at the same thread count.</em></p>
+        <div class="chart" id="variants-chart"></div>
+        <div class="table-wrapper">
+            <table>
+                <thead>
+                    <tr>
+                        <th>Scenario</th>
+                        <th>Threads</th>
+                        <th>Tracer</th>
+                        <th>Avg Time/Call (ns)</th>
+                        <th>Overhead/Call (ns)</th>
+                        <th>Calls/s</th>
+                        <th>Tracer CPU %</th>
+                        <th>Tracer Memory (KB)</th>
+""" + "".join(f"                        <th>{header}</th>\n" for _, header, _ in metric_columns) + """                    </tr>
+                </thead>
+                <tbody>
+"""
+            for row in variant_rows:
+                r = row['result']
+                overhead = f"{row['overhead_ns']:.2f}" if row['overhead_ns'] is not None else "-"
+                calls = f"{r.calls_per_sec:,.0f}" if r.calls_per_sec else "-"
+                cpu = f"{r.tracer_cpu_percent:.1f}" if r.tracer_cpu_percent is not None else "-"
+                mem = f"{r.tracer_memory_kb:,}" if r.tracer_memory_kb is not None else "-"
+                metric_cells = "".join(
+                    f"                        <td>{fmt(getattr(r, field)) if getattr(r, field) is not None else '-'}</td>\n"
+                    for field, _, fmt in metric_columns)
+                variants_section += f"""
+                    <tr>
+                        <td>{row['scenario']}</td>
+                        <td>{row['threads']}</td>
+                        <td>{row['label']}</td>
+                        <td>{r.avg_time_per_call_ns:.2f}</td>
+                        <td>{overhead}</td>
+                        <td>{calls}</td>
+                        <td>{cpu}</td>
+                        <td>{mem}</td>
+{metric_cells}                    </tr>
+"""
+            variants_section += """
+                </tbody>
+            </table>
+        </div>
+"""
+        # Trace size: every method that wrote a trace to disk, LTTng included
+        trace_rows = [r for r in self.results if r.trace_bytes_per_event]
+        trace_size_section = ""
+        if trace_rows:
+            trace_size_section = """
+        <h2>💾 Trace Size</h2>
+        <p><em>On-disk trace size for methods that wrote a trace. LTTng events are estimated as two per call.</em></p>
+        <div class="table-wrapper">
+            <table>
+                <thead>
+                    <tr>
+                        <th>Scenario</th>
+                        <th>Threads</th>
+                        <th>Tracer</th>
+                        <th>Trace Size (MB)</th>
+                        <th>Bytes/Event</th>
+                        <th>Write Time (ms)</th>
+                    </tr>
+                </thead>
+                <tbody>
+"""
+            for r in sorted(trace_rows, key=lambda r: (r.simulated_work_us, r.threads, r.method)):
+                write_ms = f"{r.trace_write_ms:.1f}" if r.trace_write_ms is not None else "-"
+                trace_size_section += f"""
+                    <tr>
+                        <td>{r.scenario}</td>
+                        <td>{r.threads}</td>
+                        <td>{method_labels.get(r.method, r.method)}</td>
+                        <td>{r.trace_size_mb or 0:.2f}</td>
+                        <td>{r.trace_bytes_per_event:.1f}</td>
+                        <td>{write_ms}</td>
+                    </tr>
+"""
+            trace_size_section += """
+                </tbody>
+            </table>
+        </div>
+"""
+
+        # Symbol resolution: index once, then per-symbol lookups
+        resolve_section = ""
+        if self.resolve_results:
+            resolve_section = """
+        <h2>🔗 Symbol Resolution</h2>
+        <p><em>Uprobe offsets are resolved in-process from a per-library ELF index (<code>mylib_tracer --resolve-bench</code>). Indexing happens once per library; each extra function costs one lookup.</em></p>
+        <div class="table-wrapper">
+            <table>
+                <thead>
+                    <tr>
+                        <th>Library</th>
+                        <th>Functions Indexed</th>
+                        <th>Symbols Resolved</th>
+                        <th>Index (μs)</th>
+                        <th>Lookup (μs)</th>
+                        <th>Total (μs)</th>
+                        <th>Per Symbol (ns)</th>
+                    </tr>
+                </thead>
+                <tbody>
+"""
+            for row in self.resolve_results:
+                resolve_section += f"""
+                    <tr>
+                        <td>{row['library']}</td>
+                        <td>{row['functions_indexed']:,}</td>
+                        <td>{row['symbols']:,}</td>
+                        <td>{row['index_us']:.1f}</td>
+                        <td>{row['lookup_us']:.1f}</td>
+                        <td>{row['index_us'] + row['lookup_us']:.1f}</td>
+                        <td>{row['lookup_us'] * 1000 / row['symbols']:.0f}</td>
+                    </tr>
+"""
+            resolve_section += """
+                </tbody>
+            </table>
+        </div>
+"""
+
+        # Probe-count scaling: per-function links against uprobe_multi
+        probe_section = ""
+        if self.probe_scaling_results:
+            probe_section = """
+        <h2>🧩 Probe Count Scaling</h2>
+        <p><em><code>mylib_tracer --functions</code> on the first N functions of the generated <code>libfanout.so</code>, with a uprobe and a uretprobe per function or two <code>uprobe_multi</code> links (<code>--uprobe-multi</code>). <code>fanout_app</code> calls the N functions round-robin, so every call is probed.</em></p>
+        <div class="table-wrapper">
+            <table>
+                <thead>
+                    <tr>
+                        <th>Functions</th>
+                        <th>Attach Mode</th>
+                        <th>Attach (ms)</th>
+                        <th>Detach (ms)</th>
+                        <th>Attach per Function (μs)</th>
+                        <th>Time/Call (ns)</th>
+                        <th>Overhead/Call (ns)</th>
+                    </tr>
+                </thead>
+                <tbody>
+"""
+            for row in self.probe_scaling_results:
+                detach = f"{row['detach_ms']:.2f}" if row['detach_ms'] is not None else "—"
+                probe_section += f"""
+                    <tr>
+                        <td>{row['functions']:,}</td>
+                        <td>{row['mode']}</td>
+                        <td>{row['attach_ms']:.2f}</td>
+                        <td>{detach}</td>
+                        <td>{row['attach_ms'] * 1000 / row['functions']:.1f}</td>
+                        <td>{row['call_ns']:.1f}</td>
+                        <td>{row['overhead_ns']:.1f}</td>
+                    </tr>
+"""
+            probe_section += """
+                </tbody>
+            </table>
+        </div>
+"""
+
+        js_variant_rows = json.dumps([{
+            'x': f"{row['scenario']} ({row['threads']}T)",
+            'label': row['label'],
+            'overhead_ns': row['overhead_ns']
+        } for row in variant_rows] if show_variants else [])
+        # Sampling: overhead and accuracy against the rate, with the unsampled run as 1/1
+        sample_rates = {f'ebpf-{v.key}': v.sample_rate for v in EBPF_VARIANTS if v.sample_rate}
+        sampling_points = [{
+            'series': f"{row['scenario']} ({row['threads']}T) - "
+                      f"{'random' if 'random' in row['method'] else 'every N'}",
+            'rate': sample_rates.get(row['method'], 1),
+            'overhead_ns': row['overhead_ns'],
+            'error_pct': row['result'].sample_error_pct or 0.0
+        } for row in variant_rows if row['method'] in sample_rates or row['method'] == 'ebpf']
+        show_sampling = any(p['rate'] > 1 for p in sampling_points)
+        if show_sampling:
+            # The unsampled run anchors both the every-N and the random curve
+            sampling_points += [dict(p, series=p['series'].replace('every N', 'random'))
+                                for p in sampling_points if p['rate'] == 1]
+            variants_section += """
+        <h3>Sampling Rate</h3>
+        <p><em>Per-call overhead and call-count error (sampled calls × N against calls made) for in-kernel sampling. Rate 1 is the unsampled tracer.</em></p>
+        <div class="chart" id="sampling-overhead-chart"></div>
+        <div class="chart" id="sampling-error-chart"></div>
+"""
+        js_sampling_points = json.dumps(sampling_points if show_sampling else [])
+        js_method_labels = json.dumps(method_labels)
+        js_scaling_traces = json.dumps(scaling_traces if show_scaling else [])
+        scaling_section = """
+        <h2>🧵 Thread Scaling</h2>
+        <p><em>Each worker thread is pinned to its own CPU and runs its own timed loop. Aggregate throughput should grow linearly with thread count; flattening curves show tracer contention.</em></p>
+        <div class="chart" id="scaling-throughput-chart"></div>
+        <div class="chart" id="scaling-overhead-chart"></div>
+""" if show_scaling else ""
+
         # Generate HTML
         html = f"""<!DOCTYPE html>
 <html>
@@ -778,6 +1595,11 @@ class BenchmarkSuite:
         <p><em>This chart shows the average time per individual function call.</em></p>
         <div class="chart" id="timing-chart"></div>
 
+{scaling_section}
+{variants_section}
+{trace_size_section}
+{resolve_section}
+{probe_section}
         <h2>📊 Detailed Results Table</h2>
         <div class="table-wrapper">
             <table>
@@ -1145,6 +1967,90 @@ class BenchmarkSuite:
             barmode: 'group',
             height: 400
         }});
+
+        // Thread scaling charts (only rendered when several thread counts were run)
+        const scalingTraces = {js_scaling_traces};
+        if (scalingTraces.length > 0) {{
+            const methodLabels = {js_method_labels};
+            const scalingLine = (t, y) => ({{
+                x: t.threads,
+                y: y,
+                name: (methodLabels[t.method] || t.method) + ' - ' + t.scenario,
+                type: 'scatter',
+                mode: 'lines+markers',
+                marker: {{ size: 8, color: colors[t.method] }},
+                line: {{ width: 2, color: colors[t.method] }}
+            }});
+
+            Plotly.newPlot('scaling-throughput-chart',
+                scalingTraces.map(t => scalingLine(t, t.calls_per_sec)), {{
+                title: 'Aggregate Throughput vs Thread Count',
+                xaxis: {{ title: 'Threads', type: 'category' }},
+                yaxis: {{ title: 'Calls per second', type: 'log' }},
+                hovermode: 'closest',
+                height: 500
+            }});
+
+            Plotly.newPlot('scaling-overhead-chart',
+                scalingTraces.filter(t => t.method !== 'baseline').map(t => scalingLine(t, t.overhead_pct)), {{
+                title: 'Per-Call Overhead vs Thread Count',
+                xaxis: {{ title: 'Threads', type: 'category' }},
+                yaxis: {{ title: 'Overhead (%)', zeroline: true }},
+                hovermode: 'closest',
+                height: 500
+            }});
+        }}
+
+        // Sampling charts: one line per scenario and sampling mode
+        const samplingPoints = {js_sampling_points};
+        if (samplingPoints.length > 0) {{
+            const series = [...new Set(samplingPoints.map(p => p.series))];
+            const samplingLine = (name, field) => {{
+                const points = samplingPoints.filter(p => p.series === name)
+                    .sort((a, b) => a.rate - b.rate);
+                return {{
+                    x: points.map(p => p.rate),
+                    y: points.map(p => p[field]),
+                    name: name,
+                    type: 'scatter',
+                    mode: 'lines+markers'
+                }};
+            }};
+            Plotly.newPlot('sampling-overhead-chart', series.map(n => samplingLine(n, 'overhead_ns')), {{
+                title: 'Per-Call Overhead vs Sampling Rate',
+                xaxis: {{ title: 'Record 1 call in N', type: 'log' }},
+                yaxis: {{ title: 'Overhead (ns/call)' }},
+                height: 450
+            }});
+            Plotly.newPlot('sampling-error-chart', series.map(n => samplingLine(n, 'error_pct')), {{
+                title: 'Call-Count Estimate Error vs Sampling Rate',
+                xaxis: {{ title: 'Record 1 call in N', type: 'log' }},
+                yaxis: {{ title: 'Error (%)' }},
+                height: 450
+            }});
+        }}
+
+        // eBPF variants chart: per-call overhead for each tracer configuration
+        const variantRows = {js_variant_rows};
+        if (variantRows.length > 0) {{
+            const labels = [...new Set(variantRows.map(r => r.label))];
+            const variantData = labels.map(label => {{
+                const rows = variantRows.filter(r => r.label === label);
+                return {{
+                    x: rows.map(r => r.x),
+                    y: rows.map(r => r.overhead_ns),
+                    name: label,
+                    type: 'bar'
+                }};
+            }});
+            Plotly.newPlot('variants-chart', variantData, {{
+                title: 'Per-Call Overhead by eBPF Tracer Variant',
+                xaxis: {{ title: 'Scenario (threads)' }},
+                yaxis: {{ title: 'Overhead (ns/call)' }},
+                barmode: 'group',
+                height: 500
+            }});
+        }}
     </script>
 </body>
 </html>
@@ -1180,6 +2086,18 @@ Examples:
   # Run scenarios 2 and 3 with 5 repetitions for quick testing
   %(prog)s ./build --scenarios 2 3 --runs 5
 
+  # Measure tracer scaling across cores with 1-64 concurrent threads
+  %(prog)s ./build -s 0 --threads 1 16 32 64
+
+  # Compare the shared ringbuf against per-CPU ringbufs on many cores
+  %(prog)s ./build -s 0 --threads 1 16 64 --ebpf-variants percpu-rb
+
+  # Flight recorder against LTTng snapshot mode
+  %(prog)s ./build -s 0 --ebpf-variants flight-recorder --lttng-snapshot
+
+  # Attach/detach time and per-call cost with 1-1000 probed functions
+  %(prog)s ./build -s 0 -r 3 --probe-scaling
+
   # List available scenarios
   %(prog)s --list-scenarios
 
@@ -1215,6 +2133,38 @@ to minimize disk usage. Only the final aggregated results are kept.
         help='Specific scenario indices to run (0-5). Run all if not specified.'
     )
 
+    parser.add_argument(
+        '-t', '--threads',
+        type=int,
+        nargs='+',
+        metavar='N',
+        help='Worker thread counts to run each scenario at, e.g. 1 16 32 64 (default: 1). '
+             'Each thread is pinned to its own CPU; the first count feeds the main charts.'
+    )
+
+    parser.add_argument(
+        '--ebpf-variants',
+        nargs='+',
+        metavar='KEY',
+        choices=[v.key for v in EBPF_VARIANTS],
+        help='Extra eBPF tracer configurations to benchmark after the default one '
+             '(see --list-scenarios for available keys)'
+    )
+
+    parser.add_argument(
+        '--probe-scaling',
+        action='store_true',
+        help='Also measure attach/detach time and per-call overhead with 1, 10, 100 and 1000 '
+             'probed functions of the generated libfanout.so, per-function vs uprobe_multi links'
+    )
+
+    parser.add_argument(
+        '--lttng-snapshot',
+        action='store_true',
+        help='Also run LTTng in snapshot mode (overwritten buffers, recorded once after the run), '
+             'the counterpart of the flight-recorder eBPF variant'
+    )
+
     parser.add_argument(
         '--list-scenarios',
         action='store_true',
@@ -1234,6 +2184,13 @@ to minimize disk usage. Only the final aggregated results are kept.
             print(f"    Iterations: {scenario.iterations:,}")
             print(f"    Description: {scenario.description}")
             print()
+        print("AVAILABLE eBPF TRACER VARIANTS (--ebpf-variants)")
+        print("="*70 + "\n")
+        for variant in EBPF_VARIANTS:
+            print(f"[{variant.key}] {variant.label}")
+            print(f"    Tracer args: {variant.tracer_args}")
+            print(f"    Description: {variant.description}")
+            print()
         return 0
 
     # Validate build_dir is provided (unless listing scenarios)
@@ -1268,6 +2225,11 @@ to minimize disk usage. Only the final aggregated results are kept.
             print("Use --list-scenarios to see all available scenarios")
             sys.exit(1)
 
+    # Validate thread counts
+    if args.threads and any(t < 1 for t in args.threads):
+        print(f"Error: Thread counts must be at least 1 (got {args.threads})")
+        sys.exit(1)
+
     # Validate repetitions count
     if args.runs < 1:
         print(f"Error: Number of runs must be at least 1 (got {args.runs})")
@@ -1283,6 +2245,8 @@ to minimize disk usage. Only the final aggregated results are kept.
 
     # Determine number of scenarios to run
     num_scenarios = len(args.scenarios) if args.scenarios else len(BenchmarkSuite.ALL_SCENARIOS)
+    num_thread_counts = len(args.threads) if args.threads else 1
+    num_methods = 3 + (len(args.ebpf_variants) if args.ebpf_variants else 0) + (1 if args.lttng_snapshot else 0)
 
     # Create and run benchmark suite
     print(f"\n{'='*70}")
@@ -1295,11 +2259,20 @@ to minimize disk usage. Only the final aggregated results are kept.
             print(f"    [{idx}] {BenchmarkSuite.ALL_SCENARIOS[idx].name} ({BenchmarkSuite.ALL_SCENARIOS[idx].simulated_work_us} μs)")
     else:
         print(f"  Scenarios: All ({num_scenarios} scenarios)")
-    print(f"  Total tests: {args.runs * num_scenarios * 3} ({num_scenarios} scenarios × 3 methods × {args.runs} runs)")
-    print(f"  Estimated time: ~{args.runs * num_scenarios * 0.07:.0f}-{args.runs * num_scenarios * 0.1:.0f} minutes")
+    if args.threads:
+        print(f"  Thread counts: {args.threads}")
+    if args.ebpf_variants:
+        print(f"  eBPF variants: {args.ebpf_variants}")
+    if args.probe_scaling:
+        print(f"  Probe-count scaling: {[n for n, _ in PROBE_SCALING_FUNCTIONS]} functions")
+    num_tests = num_scenarios * num_thread_counts * num_methods // 3
+    print(f"  Total tests: {args.runs * num_scenarios * num_thread_counts * num_methods} ({num_scenarios} scenarios × {num_thread_counts} thread counts × {num_methods} methods × {args.runs} runs)")
+    print(f"  Estimated time: ~{args.runs * num_tests * 0.07:.0f}-{args.runs * num_tests * 0.1:.0f} minutes")
     print(f"{'='*70}\n")
 
-    suite = BenchmarkSuite(build_dir, num_runs=args.runs, scenario_indices=args.scenarios)
+    suite = BenchmarkSuite(build_dir, num_runs=args.runs, scenario_indices=args.scenarios,
+                           thread_counts=args.threads, ebpf_variants=args.ebpf_variants,
+                           probe_scaling=args.probe_scaling, lttng_snapshot=args.lttng_snapshot)
 
     try:
         suite.run_all_scenarios()
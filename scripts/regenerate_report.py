@@ -94,6 +94,15 @@ Examples:
         print(f"Error parsing results data: {e}")
         sys.exit(1)
 
+    # Recover the thread counts the results were collected with
+    suite.thread_counts = sorted({r.threads for r in suite.results}) or [1]
+
+    # Symbol resolution timings are stored next to results.json when collected
+    resolve_file = results_file.parent / 'symbol_resolution.json'
+    if resolve_file.exists():
+        with open(resolve_file) as f:
+            suite.resolve_results = json.load(f)
+
     # Set output directory
     suite.output_dir = output_dir
 
@@ -0,0 +1,54 @@
+// Calls the first N functions of libfanout round-robin, so every call hits a
+// different probed function when the tracer attaches to all N
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../fanout_library/fanout.h"
+
+void print_usage(const char* prog) {
+    fprintf(stderr, "Usage: %s <num_functions> <num_iterations>\n", prog);
+    fprintf(stderr, "  num_functions:  How many of the fanout_NNNN functions to cycle through (1-%d)\n",
+            FANOUT_FUNCS);
+    fprintf(stderr, "  num_iterations: Total number of calls\n");
+    fprintf(stderr, "Example: %s 100 1000000\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    int num_functions = atoi(argv[1]);
+    if (num_functions <= 0 || num_functions > FANOUT_FUNCS) {
+        fprintf(stderr, "Error: num_functions must be between 1 and %d\n", FANOUT_FUNCS);
+        return 1;
+    }
+
+    long num_iterations = atol(argv[2]);
+    if (num_iterations <= 0) {
+        fprintf(stderr, "Error: num_iterations must be positive\n");
+        return 1;
+    }
+
+    printf("Starting benchmark with %ld iterations over %d functions...\n",
+           num_iterations, num_functions);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (long i = 0, f = 0; i < num_iterations; i++) {
+        fanout_funcs[f]((int)i);
+        if (++f == num_functions)
+            f = 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("Completed %ld iterations in %.6f seconds\n", num_iterations, elapsed);
+    printf("Average time per call: %.2f nanoseconds\n",
+           (elapsed / num_iterations) * 1e9);
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+// 1000 tiny exported functions, fanout_0000 .. fanout_0999, for measuring how
+// attach/detach time and per-call overhead scale with the number of probed
+// functions. The zero-padded names let one glob select the first 1, 10, 100
+// or 1000 of them: fanout_0000, fanout_000?, fanout_00??, fanout_????.
+#include "fanout.h"
+
+// Thread-local so the functions cannot be folded into one another and
+// multi-threaded callers don't share a cache line
+static __thread volatile int dummy __attribute__((tls_model("initial-exec"))) = 0;
+
+#define FANOUT_10(a, b, c, X) \
+    X(a, b, c, 0) X(a, b, c, 1) X(a, b, c, 2) X(a, b, c, 3) X(a, b, c, 4) \
+    X(a, b, c, 5) X(a, b, c, 6) X(a, b, c, 7) X(a, b, c, 8) X(a, b, c, 9)
+#define FANOUT_100(a, b, X) \
+    FANOUT_10(a, b, 0, X) FANOUT_10(a, b, 1, X) FANOUT_10(a, b, 2, X) \
+    FANOUT_10(a, b, 3, X) FANOUT_10(a, b, 4, X) FANOUT_10(a, b, 5, X) \
+    FANOUT_10(a, b, 6, X) FANOUT_10(a, b, 7, X) FANOUT_10(a, b, 8, X) \
+    FANOUT_10(a, b, 9, X)
+#define FANOUT_1000(a, X) \
+    FANOUT_100(a, 0, X) FANOUT_100(a, 1, X) FANOUT_100(a, 2, X) \
+    FANOUT_100(a, 3, X) FANOUT_100(a, 4, X) FANOUT_100(a, 5, X) \
+    FANOUT_100(a, 6, X) FANOUT_100(a, 7, X) FANOUT_100(a, 8, X) \
+    FANOUT_100(a, 9, X)
+
+// Each function adds its own index, so no two bodies are identical
+#define FANOUT_DEFINE(a, b, c, d)                               \
+    __attribute__((noinline)) void fanout_##a##b##c##d(int arg); \
+    __attribute__((noinline)) void fanout_##a##b##c##d(int arg) { \
+        dummy += arg + (a * 1000 + b * 100 + c * 10 + d);       \
+    }
+#define FANOUT_ENTRY(a, b, c, d) fanout_##a##b##c##d,
+
+FANOUT_1000(0, FANOUT_DEFINE)
+
+void (*const fanout_funcs[FANOUT_FUNCS])(int arg) = {
+    FANOUT_1000(0, FANOUT_ENTRY)
+};
@@ -0,0 +1,18 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of exported fanout_NNNN functions
+#define FANOUT_FUNCS 1000
+
+// fanout_funcs[i] is fanout_<i, zero-padded to four digits>
+extern void (*const fanout_funcs[FANOUT_FUNCS])(int arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FANOUT_H
@@ -1,17 +1,160 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #include "../sample_library/mylib.h"
 
+// Per-thread state for the multi-threaded workload mode
+struct worker {
+    pthread_t thread;
+    int id;
+    int cpu;                // CPU the worker is pinned to (-1 = not pinned)
+    long iterations;
+    double elapsed;         // Seconds spent in the timed loop
+};
+
+static pthread_barrier_t start_barrier;
+
 void print_usage(const char* prog) {
-    fprintf(stderr, "Usage: %s <num_iterations>\n", prog);
-    fprintf(stderr, "  num_iterations: Number of times to call the traced function\n");
+    fprintf(stderr, "Usage: %s <num_iterations> [num_threads]\n", prog);
+    fprintf(stderr, "  num_iterations: Number of times to call the traced function (per thread)\n");
+    fprintf(stderr, "  num_threads:    Number of worker threads, each pinned to its own CPU (default: 1)\n");
     fprintf(stderr, "Example: %s 1000000\n", prog);
+    fprintf(stderr, "Example: %s 1000000 16\n", prog);
+}
+
+static double timespec_diff(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) +
+           (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Call the traced function many times and return the elapsed time in seconds
+static double run_loop(long num_iterations) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Call the traced function many times
+    for (long i = 0; i < num_iterations; i++) {
+        my_traced_function(
+            42,                    // int arg1
+            0xDEADBEEF,           // uint64_t arg2
+            3.14159,              // double arg3
+            (void*)0x12345678     // void* arg4
+        );
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return timespec_diff(&start, &end);
+}
+
+static void* worker_main(void* arg) {
+    struct worker* w = arg;
+
+    // Pin before the barrier so migration never lands inside the timed loop
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            w->cpu = -1;
+        }
+    }
+
+    // Release all workers at once so every thread hits the probe concurrently
+    pthread_barrier_wait(&start_barrier);
+    w->elapsed = run_loop(w->iterations);
+    return NULL;
+}
+
+static int run_threaded(long num_iterations, int num_threads) {
+    struct worker* workers = calloc(num_threads, sizeof(*workers));
+    if (!workers) {
+        fprintf(stderr, "Error: failed to allocate worker state\n");
+        return 1;
+    }
+
+    // Pin workers round-robin over the CPUs this process may run on
+    cpu_set_t allowed;
+    int allowed_cpus[CPU_SETSIZE];
+    int num_allowed = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                allowed_cpus[num_allowed++] = cpu;
+            }
+        }
+    }
+    if (num_threads > num_allowed) {
+        fprintf(stderr, "Warning: %d threads on %d CPUs, some CPUs are shared\n",
+                num_threads, num_allowed);
+    }
+
+    int err = pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+    if (err != 0) {
+        fprintf(stderr, "Error: failed to create the start barrier: %s\n", strerror(err));
+        exit(1);
+    }
+
+    struct timespec start, end;
+    int started = 0;
+    for (int t = 0; t < num_threads; t++) {
+        workers[t].id = t;
+        workers[t].cpu = num_allowed > 0 ? allowed_cpus[t % num_allowed] : -1;
+        workers[t].iterations = num_iterations;
+        if (pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]) != 0) {
+            fprintf(stderr, "Error: failed to create thread %d\n", t);
+            break;
+        }
+        started++;
+    }
+
+    if (started < num_threads) {
+        // The barrier expects every thread; abort rather than deadlock
+        exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_barrier_wait(&start_barrier);
+    for (int t = 0; t < num_threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    pthread_barrier_destroy(&start_barrier);
+
+    // Per-thread results
+    double sum_per_call_ns = 0;
+    double sum_calls_per_sec = 0;
+    for (int t = 0; t < num_threads; t++) {
+        const struct worker* w = &workers[t];
+        double calls_per_sec = w->elapsed > 0 ? w->iterations / w->elapsed : 0;
+        double per_call_ns = (w->elapsed / w->iterations) * 1e9;
+        printf("Thread %d (CPU %d): %ld iterations in %.6f seconds, %.2f ns/call, %.0f calls/s\n",
+               w->id, w->cpu, w->iterations, w->elapsed, per_call_ns, calls_per_sec);
+        sum_per_call_ns += per_call_ns;
+        sum_calls_per_sec += calls_per_sec;
+    }
+
+    // Aggregate results
+    double elapsed = timespec_diff(&start, &end);
+    long total_calls = num_iterations * num_threads;
+
+    printf("Completed %ld iterations in %.6f seconds\n", total_calls, elapsed);
+    printf("Average time per call: %.2f nanoseconds\n", sum_per_call_ns / num_threads);
+    printf("Threads: %d\n", num_threads);
+    printf("Aggregate throughput: %.0f calls/s (sum of per-thread %.0f calls/s)\n",
+           elapsed > 0 ? total_calls / elapsed : 0, sum_calls_per_sec);
+
+    free(workers);
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    if (argc != 2 && argc != 3) {
         print_usage(argv[0]);
         return 1;
     }
@@ -22,6 +165,15 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    int num_threads = 1;
+    if (argc == 3) {
+        num_threads = atoi(argv[2]);
+        if (num_threads <= 0) {
+            fprintf(stderr, "Error: num_threads must be positive\n");
+            return 1;
+        }
+    }
+
     // Check for SIMULATED_WORK_US environment variable
     const char* work_env = getenv("SIMULATED_WORK_US");
     if (work_env) {
@@ -32,25 +184,12 @@ int main(int argc, char* argv[]) {
     } else {
         printf("Starting benchmark with %ld iterations...\n", num_iterations);
     }
-
-    struct timespec start, end;
-    clock_gettime(CLOCK_MONOTONIC, &start);
-
-    // Call the traced function many times
-    for (long i = 0; i < num_iterations; i++) {
-        my_traced_function(
-            42,                    // int arg1
-            0xDEADBEEF,           // uint64_t arg2
-            3.14159,              // double arg3
-            (void*)0x12345678     // void* arg4
-        );
+    if (num_threads > 1) {
+        printf("Running %d threads, %ld iterations each\n", num_threads, num_iterations);
+        return run_threaded(num_iterations, num_threads);
     }
 
-    clock_gettime(CLOCK_MONOTONIC, &end);
-
-    // Calculate elapsed time
-    double elapsed = (end.tv_sec - start.tv_sec) +
-                     (end.tv_nsec - start.tv_nsec) / 1e9;
+    double elapsed = run_loop(num_iterations);
 
     printf("Completed %ld iterations in %.6f seconds\n", num_iterations, elapsed);
     printf("Average time per call: %.2f nanoseconds\n",
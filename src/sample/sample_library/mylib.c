@@ -2,8 +2,39 @@
 #include <string.h>
 #include <time.h>
 
+#ifdef MYLIB_USDT
+// USDT probes at entry and exit, gated by semaphores: the probe site is a nop
+// and the arguments are only materialised while a tracer holds the semaphore
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+__extension__ unsigned short mylib_my_traced_function_entry_semaphore
+    __attribute__((unused)) __attribute__((section(".probes")));
+__extension__ unsigned short mylib_my_traced_function_exit_semaphore
+    __attribute__((unused)) __attribute__((section(".probes")));
+
+// The double is passed as its bit pattern: SDT argument specs for floating
+// point name an xmm register, which BPF USDT argument decoding cannot read
+#define MYLIB_TRACE_ENTRY(a1, a2, a3, a4)                                   \
+    do {                                                                    \
+        if (__builtin_expect(mylib_my_traced_function_entry_semaphore, 0)) { \
+            union { double d; uint64_t u; } bits = { .d = (a3) };           \
+            STAP_PROBE4(mylib, my_traced_function_entry, a1, a2, bits.u, a4); \
+        }                                                                   \
+    } while (0)
+#define MYLIB_TRACE_EXIT()                                                  \
+    do {                                                                    \
+        if (__builtin_expect(mylib_my_traced_function_exit_semaphore, 0))   \
+            STAP_PROBE(mylib, my_traced_function_exit);                     \
+    } while (0)
+#else
+#define MYLIB_TRACE_ENTRY(a1, a2, a3, a4) do { } while (0)
+#define MYLIB_TRACE_EXIT() do { } while (0)
+#endif
+
 // Volatile to prevent compiler optimization
-static volatile int dummy = 0;
+// Thread-local so multi-threaded runs don't bounce one cache line between cores
+static __thread volatile int dummy __attribute__((tls_model("initial-exec"))) = 0;
 static unsigned int simulated_work_us = 0;
 
 // Busy-wait nanosleep for accurate microsecond delays
@@ -33,6 +64,8 @@ void my_traced_function(
     double arg3,
     void* arg4)
 {
+    MYLIB_TRACE_ENTRY(arg1, arg2, arg3, arg4);
+
     // Do some minimal work to prevent complete optimization
     dummy = arg1 + (int)arg2;
     dummy += (int)arg3;
@@ -45,4 +78,6 @@ void my_traced_function(
     if (simulated_work_us > 0) {
         busy_sleep_us(simulated_work_us);
     }
+
+    MYLIB_TRACE_EXIT();
 }
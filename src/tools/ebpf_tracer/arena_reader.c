@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-2.0
+// Arena pages are allocated on first touch. A BPF store to a page nobody has
+// touched yet is dropped without an error, so the reader writes every page
+// of its ring before tracing starts. Records are read in place: the slot is
+// only reused after the tail store that follows the callbacks.
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "arena_reader.h"
+
+// Sleep between empty scans. Short enough that a CPU producing 10M
+// events/s cannot fill its ring in one nap.
+#define ARENA_POLL_NS 100000
+
+struct arena_reader {
+    arena_record_fn fn;
+    void *ctx;
+    struct arena_ring *ring;
+};
+
+struct arena_reader *arena_reader_new(void *base, int cpu, arena_record_fn fn, void *ctx) {
+    struct arena_reader *r;
+
+    if (!base || cpu < 0 || cpu >= MAX_CPUS) {
+        errno = EINVAL;
+        return NULL;
+    }
+    r = calloc(1, sizeof(*r));
+    if (!r)
+        return NULL;
+    r->fn = fn;
+    r->ctx = ctx;
+    r->ring = (struct arena_ring *)((char *)base + ARENA_RING_OFFSET(cpu));
+    memset(r->ring, 0, ARENA_RING_PAGES * ARENA_PAGE_SIZE);
+    return r;
+}
+
+void arena_reader_free(struct arena_reader *r) {
+    free(r);
+}
+
+int arena_reader_consume(struct arena_reader *r) {
+    struct arena_ring *ring = r->ring;
+    __u64 tail = ring->tail;  // Only we write it
+    __u64 head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    int n = 0, err = 0;
+
+    while (tail != head && !err) {
+        struct arena_slot *slot = &ring->slots[tail & (ARENA_RING_SLOTS - 1)];
+
+        err = r->fn(r->ctx, slot->data, slot->size);
+        tail++;
+        n++;
+    }
+    if (n)
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    return err ? err : n;
+}
+
+int arena_reader_poll(struct arena_reader *r, int timeout_ms) {
+    struct timespec nap = { .tv_nsec = ARENA_POLL_NS };
+    int n = arena_reader_consume(r);
+
+    if (n)
+        return n;
+    if ((long)timeout_ms * 1000000 < nap.tv_nsec)
+        nap.tv_nsec = (long)timeout_ms * 1000000;
+    if (nanosleep(&nap, NULL))
+        return -errno;
+    return arena_reader_consume(r);
+}
+
+double arena_reader_fill_pct(const struct arena_reader *r) {
+    __u64 head = __atomic_load_n(&r->ring->head, __ATOMIC_ACQUIRE);
+    __u64 tail = __atomic_load_n(&r->ring->tail, __ATOMIC_RELAXED);
+
+    return 100.0 * (head - tail) / ARENA_RING_SLOTS;
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-2.0
+// Consumer of one CPU's ring in the arena transport (--transport=arena).
+// The BPF side writes fixed-size slots and advances the ring's head; this
+// reads every published slot in place, then frees them all with one store
+// to the tail. There is no notification: the reader polls.
+#ifndef ARENA_READER_H
+#define ARENA_READER_H
+
+#include <stddef.h>
+#include <linux/types.h>
+#include "mylib_tracer.h"
+
+// Called with each record, in place in the arena; only valid during the call.
+// Returns 0 or a negative errno, which stops consumption.
+typedef int (*arena_record_fn)(void *ctx, void *data, size_t size);
+
+struct arena_reader;
+
+// Reader for ring cpu of the arena mapped at base. Faults the ring's pages
+// in, so it must be created before the probes are attached. Returns NULL
+// and sets errno on failure.
+struct arena_reader *arena_reader_new(void *base, int cpu, arena_record_fn fn, void *ctx);
+void arena_reader_free(struct arena_reader *r);
+
+// Consume; if there was nothing, sleep briefly (at most timeout_ms) and
+// consume again. Same return values as arena_reader_consume.
+int arena_reader_poll(struct arena_reader *r, int timeout_ms);
+
+// Hand every published record to the callback. Returns the number of
+// records consumed or the callback's error.
+int arena_reader_consume(struct arena_reader *r);
+
+// Published but unconsumed slots as a percentage of the ring
+double arena_reader_fill_pct(const struct arena_reader *r);
+
+#endif // ARENA_READER_H
@@ -0,0 +1,497 @@
+// SPDX-License-Identifier: GPL-2.0
+// Binary CTF 1.8 writer. Events are packed byte-aligned (align = 8 bits) so
+// an entry costs 37 bytes and an exit 9, against ~100 bytes of text. A
+// combined-mode span costs 45 bytes for the whole call. With --functions,
+// each traced function gets an entry and an exit event class whose fields
+// are its captured arguments and return value, sized and signed per BTF.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <linux/types.h>
+#include "mylib_tracer.h"
+#include "ctf_writer.h"
+#include "func_table.h"
+
+#define CTF_MAGIC 0xC1FC1FC1U
+#define CTF_PACKET_SIZE (64 * 1024)  // Bytes per packet, zero-padded
+
+// Event ids in the metadata below
+#define CTF_EVENT_ENTRY 0
+#define CTF_EVENT_EXIT  1
+#define CTF_EVENT_SPAN  2
+#define CTF_EVENT_FUNC_BASE 3  // --functions: function i is 3 + 2i (entry), 4 + 2i (exit)
+
+// packet.header + packet.context, all byte-aligned
+#define CTF_PACKET_HEADER_SIZE (4 + 16 + 4)
+#define CTF_PACKET_CONTEXT_SIZE (8 + 8 + 8 + 8 + 8 + 4)
+#define CTF_PACKET_PREAMBLE_SIZE (CTF_PACKET_HEADER_SIZE + CTF_PACKET_CONTEXT_SIZE)
+
+// event.header: uint16_t id + 64-bit timestamp. The id has room for every
+// --functions event class.
+#define CTF_EVENT_HEADER_SIZE (2 + 8)
+_Static_assert(CTF_EVENT_FUNC_BASE + 2 * MAX_TRACED_FUNCS <= 0x10000,
+               "CTF event ids must fit the uint16_t event.header id");
+
+// Payload sizes; must match the fields declared in the metadata
+#define CTF_ENTRY_PAYLOAD_SIZE (4 + 8 + 8 + 8)
+#define CTF_EXIT_PAYLOAD_SIZE 0
+#define CTF_SPAN_PAYLOAD_SIZE (8 + CTF_ENTRY_PAYLOAD_SIZE)
+
+// One stream_N file and its packet under construction
+struct ctf_stream {
+    FILE *file;
+    __u32 cpu_id;
+
+    unsigned char packet[CTF_PACKET_SIZE];
+    size_t used;                   // Bytes filled in the current packet
+    unsigned long packet_events;
+    unsigned long packets_written;
+    __u64 ts_begin;
+    __u64 ts_last;                 // Last timestamp written to the stream
+};
+
+struct ctf_writer {
+    char *dir;
+    unsigned char uuid[16];
+    clockid_t clock;               // Source of the event timestamps
+    __s64 clock_offset_ns;         // CLOCK_REALTIME - clock at open
+    __s64 clock_precision_ns;
+    unsigned long long bytes;
+
+    int nr_streams;
+    struct ctf_stream streams[];
+};
+
+static void put_bytes(struct ctf_stream *s, const void *src, size_t len) {
+    memcpy(s->packet + s->used, src, len);
+    s->used += len;
+}
+
+static void put_u8(struct ctf_stream *s, __u8 v)   { put_bytes(s, &v, sizeof(v)); }
+static void put_u16(struct ctf_stream *s, __u16 v) { put_bytes(s, &v, sizeof(v)); }
+static void put_u32(struct ctf_stream *s, __u32 v) { put_bytes(s, &v, sizeof(v)); }
+static void put_u64(struct ctf_stream *s, __u64 v) { put_bytes(s, &v, sizeof(v)); }
+
+// The low size bytes of v, in host byte order like every other field
+static void put_int(struct ctf_stream *s, __u64 v, unsigned int size) {
+    switch (size) {
+    case 1: put_u8(s, v); break;
+    case 2: put_u16(s, v); break;
+    case 4: put_u32(s, v); break;
+    default: put_u64(s, v); break;
+    }
+}
+
+// --functions: payload bytes of a function's entry (captured arguments) or
+// exit (captured return value)
+static size_t func_payload_size(const struct func_layout *f, int exit) {
+    size_t size = 0;
+
+    if (exit)
+        return f->ret.reg >= 0 ? f->ret.size : 0;
+    for (unsigned int i = 0; i < f->nr_args; i++) {
+        if (f->args[i].reg >= 0)
+            size += f->args[i].size;
+    }
+    return size;
+}
+
+static void generate_uuid(unsigned char uuid[16]) {
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    ssize_t n = fd >= 0 ? read(fd, uuid, 16) : -1;
+
+    if (fd >= 0)
+        close(fd);
+    if (n != 16) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        srand((unsigned int)(ts.tv_nsec ^ ts.tv_sec ^ getpid()));
+        for (int i = 0; i < 16; i++)
+            uuid[i] = rand() & 0xff;
+    }
+
+    // RFC 4122 version 4 (random)
+    uuid[6] = (uuid[6] & 0x0f) | 0x40;
+    uuid[8] = (uuid[8] & 0x3f) | 0x80;
+}
+
+static void format_uuid(const unsigned char uuid[16], char out[37]) {
+    snprintf(out, 37,
+             "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+             uuid[0], uuid[1], uuid[2], uuid[3], uuid[4], uuid[5], uuid[6], uuid[7],
+             uuid[8], uuid[9], uuid[10], uuid[11], uuid[12], uuid[13], uuid[14], uuid[15]);
+}
+
+// Start a packet; the context is filled in when the packet is flushed
+static void begin_packet(struct ctf_writer *w, struct ctf_stream *s) {
+    s->used = 0;
+    put_u32(s, CTF_MAGIC);
+    put_bytes(s, w->uuid, sizeof(w->uuid));
+    put_u32(s, 0);  // stream_id (every file is an instance of stream class 0)
+    s->used = CTF_PACKET_PREAMBLE_SIZE;
+    s->packet_events = 0;
+}
+
+static int flush_packet(struct ctf_writer *w, struct ctf_stream *s,
+                        unsigned long events_discarded) {
+    size_t content = s->used;
+
+    // Patch packet.context now that the extent of the packet is known
+    s->used = CTF_PACKET_HEADER_SIZE;
+    put_u64(s, s->packet_events ? s->ts_begin : s->ts_last);
+    put_u64(s, s->ts_last);
+    put_u64(s, (__u64)content * 8);          // content_size (bits)
+    put_u64(s, (__u64)CTF_PACKET_SIZE * 8);  // packet_size (bits)
+    put_u64(s, events_discarded);
+    put_u32(s, s->cpu_id);
+
+    memset(s->packet + content, 0, CTF_PACKET_SIZE - content);
+    if (fwrite(s->packet, CTF_PACKET_SIZE, 1, s->file) != 1)
+        return -EIO;
+
+    w->bytes += CTF_PACKET_SIZE;
+    s->packets_written++;
+    begin_packet(w, s);
+    return 0;
+}
+
+static void free_writer(struct ctf_writer *w) {
+    for (int i = 0; i < w->nr_streams; i++) {
+        if (w->streams[i].file)
+            fclose(w->streams[i].file);
+    }
+    free(w->dir);
+    free(w);
+}
+
+struct ctf_writer *ctf_writer_open(const char *dir, int nr_streams, clockid_t clock) {
+    struct ctf_writer *w;
+    struct timespec real, mono, res;
+    char path[4096];
+
+    if (mkdir(dir, 0755) && errno != EEXIST)
+        return NULL;
+
+    w = calloc(1, sizeof(*w) + nr_streams * sizeof(struct ctf_stream));
+    if (!w)
+        return NULL;
+    w->nr_streams = nr_streams;
+
+    generate_uuid(w->uuid);
+
+    w->dir = strdup(dir);
+    for (int i = 0; w->dir && i < nr_streams; i++) {
+        struct ctf_stream *s = &w->streams[i];
+
+        snprintf(path, sizeof(path), "%s/stream_%d", dir, i);
+        s->file = fopen(path, "w");
+        if (!s->file)
+            break;
+        s->cpu_id = i;
+        begin_packet(w, s);
+    }
+    if (!w->dir || (nr_streams > 0 && !w->streams[nr_streams - 1].file)) {
+        int err = errno;
+        free_writer(w);
+        errno = err;
+        return NULL;
+    }
+
+    // Anchor the BPF timestamps to wall-clock time like LTTng does
+    w->clock = clock;
+    clock_gettime(CLOCK_REALTIME, &real);
+    clock_gettime(clock, &mono);
+    w->clock_offset_ns = ((__s64)real.tv_sec - mono.tv_sec) * 1000000000LL +
+                         ((__s64)real.tv_nsec - mono.tv_nsec);
+    w->clock_precision_ns = clock_getres(clock, &res) ? 1 :
+                            (__s64)res.tv_sec * 1000000000LL + res.tv_nsec;
+
+    return w;
+}
+
+int ctf_writer_write_event(struct ctf_writer *w, int stream,
+                           const void *data, size_t size) {
+    struct ctf_stream *s = &w->streams[stream];
+    const struct func_layout *f = NULL;
+    size_t payload;
+    __u32 id;
+    __u64 ts;
+
+    if (size == sizeof(struct trace_event_entry)) {
+        id = CTF_EVENT_ENTRY;
+        payload = CTF_ENTRY_PAYLOAD_SIZE;
+    } else if (size == sizeof(struct trace_event_exit)) {
+        id = CTF_EVENT_EXIT;
+        payload = CTF_EXIT_PAYLOAD_SIZE;
+    } else if (size == sizeof(struct trace_event_span)) {
+        id = CTF_EVENT_SPAN;
+        payload = CTF_SPAN_PAYLOAD_SIZE;
+    } else if (size == sizeof(struct trace_event_call) ||
+               size == sizeof(struct trace_event_return)) {
+        int exit = size == sizeof(struct trace_event_return);
+        __u32 func_id;
+
+        memcpy(&func_id, (const char *)data + sizeof(__u64), sizeof(func_id));
+        f = func_table_lookup(func_id);
+        if (!f)
+            return -EINVAL;
+        id = CTF_EVENT_FUNC_BASE + 2 * func_id + exit;
+        payload = func_payload_size(f, exit);
+    } else {
+        return -EINVAL;
+    }
+
+    if (s->used + CTF_EVENT_HEADER_SIZE + payload > CTF_PACKET_SIZE) {
+        int err = flush_packet(w, s, 0);
+        if (err)
+            return err;
+    }
+
+    // CTF readers require a monotonic clock within a stream. Producers on a
+    // shared ringbuf can reserve slightly out of timestamp order, so clamp.
+    memcpy(&ts, data, sizeof(ts));  // First field of every event type
+    if (id == CTF_EVENT_SPAN) {
+        // Spans arrive in completion order, so stamp them with their end
+        // time; the entry time is timestamp - duration_ns
+        const struct trace_event_span *e = data;
+        ts += e->duration_ns;
+    }
+    if (ts < s->ts_last)
+        ts = s->ts_last;
+    if (s->packet_events++ == 0)
+        s->ts_begin = ts;
+    s->ts_last = ts;
+
+    put_u16(s, id);
+    put_u64(s, ts);
+    if (id == CTF_EVENT_ENTRY) {
+        const struct trace_event_entry *e = data;
+        __s32 arg1 = e->arg1;
+        __u64 arg2 = e->arg2, arg4 = e->arg4;
+        double arg3 = e->arg3;
+
+        put_bytes(s, &arg1, sizeof(arg1));
+        put_u64(s, arg2);
+        put_bytes(s, &arg3, sizeof(arg3));
+        put_u64(s, arg4);
+    } else if (id == CTF_EVENT_SPAN) {
+        const struct trace_event_span *e = data;
+        __s32 arg1 = e->arg1;
+        __u64 arg2 = e->arg2, arg4 = e->arg4;
+        double arg3 = e->arg3;
+
+        put_u64(s, e->duration_ns);
+        put_bytes(s, &arg1, sizeof(arg1));
+        put_u64(s, arg2);
+        put_bytes(s, &arg3, sizeof(arg3));
+        put_u64(s, arg4);
+    } else if (size == sizeof(struct trace_event_call)) {
+        const struct trace_event_call *e = data;
+
+        for (unsigned int i = 0; i < f->nr_args; i++) {
+            const struct arg_layout *a = &f->args[i];
+
+            if (a->reg >= 0)
+                put_int(s, e->regs[a->reg], a->size);
+        }
+    } else if (size == sizeof(struct trace_event_return)) {
+        const struct trace_event_return *e = data;
+
+        if (f->ret.reg >= 0)
+            put_int(s, e->ret, f->ret.size);
+    }
+    return 0;
+}
+
+// TSDL declaration of a captured argument. The leading underscore keeps
+// names like "size" or "event" clear of TSDL keywords; babeltrace2 strips
+// it, as it does for LTTng's fields.
+static void write_func_field(FILE *f, const struct arg_layout *a) {
+    fprintf(f, "\t\tinteger { size = %u; align = 8; signed = %s;%s } _%s;\n",
+            a->size * 8, a->cls == ARG_SIGNED ? "true" : "false",
+            a->cls == ARG_HEX ? " base = 16;" : "", a->name);
+}
+
+// --functions: an entry and an exit event class per traced function
+static void write_func_events(FILE *f) {
+    for (unsigned int i = 0; i < func_table_count(); i++) {
+        const struct func_layout *fn = func_table_lookup(i);
+
+        fprintf(f, "\nevent {\n");
+        fprintf(f, "\tname = \"mylib:%s_entry\";\n", fn->name);
+        fprintf(f, "\tid = %u;\n", CTF_EVENT_FUNC_BASE + 2 * i);
+        fprintf(f, "\tstream_id = 0;\n");
+        fprintf(f, "\tfields := struct {\n");
+        for (unsigned int j = 0; j < fn->nr_args; j++) {
+            if (fn->args[j].reg >= 0)
+                write_func_field(f, &fn->args[j]);
+        }
+        fprintf(f, "\t};\n");
+        fprintf(f, "};\n\n");
+
+        fprintf(f, "event {\n");
+        fprintf(f, "\tname = \"mylib:%s_exit\";\n", fn->name);
+        fprintf(f, "\tid = %u;\n", CTF_EVENT_FUNC_BASE + 2 * i + 1);
+        fprintf(f, "\tstream_id = 0;\n");
+        fprintf(f, "\tfields := struct {\n");
+        if (fn->ret.reg >= 0)
+            write_func_field(f, &fn->ret);
+        fprintf(f, "\t};\n");
+        fprintf(f, "};\n");
+    }
+}
+
+// The TSDL clock keeps the name "monotonic" whatever --clock picked; the
+// description says which one it really is
+static const char *clock_description(clockid_t clock) {
+    switch (clock) {
+    case CLOCK_BOOTTIME:         return "CLOCK_BOOTTIME (bpf_ktime_get_boot_ns)";
+    case CLOCK_MONOTONIC_COARSE: return "CLOCK_MONOTONIC_COARSE (bpf_ktime_get_coarse_ns)";
+    case CLOCK_TAI:              return "CLOCK_TAI (bpf_ktime_get_tai_ns)";
+    default:                     return "CLOCK_MONOTONIC (bpf_ktime_get_ns)";
+    }
+}
+
+static int write_metadata(struct ctf_writer *w) {
+    char path[4096], uuid[37];
+    FILE *f;
+    long size;
+
+    snprintf(path, sizeof(path), "%s/metadata", w->dir);
+    f = fopen(path, "w");
+    if (!f)
+        return -errno;
+
+    format_uuid(w->uuid, uuid);
+
+    fprintf(f, "/* CTF 1.8 */\n\n");
+    fprintf(f, "typealias integer { size = 8; align = 8; signed = false; } := uint8_t;\n");
+    fprintf(f, "typealias integer { size = 16; align = 8; signed = false; } := uint16_t;\n");
+    fprintf(f, "typealias integer { size = 32; align = 8; signed = false; } := uint32_t;\n");
+    fprintf(f, "typealias integer { size = 64; align = 8; signed = false; } := uint64_t;\n\n");
+
+    fprintf(f, "trace {\n");
+    fprintf(f, "\tmajor = 1;\n");
+    fprintf(f, "\tminor = 8;\n");
+    fprintf(f, "\tuuid = \"%s\";\n", uuid);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    fprintf(f, "\tbyte_order = be;\n");
+#else
+    fprintf(f, "\tbyte_order = le;\n");
+#endif
+    fprintf(f, "\tpacket.header := struct {\n");
+    fprintf(f, "\t\tuint32_t magic;\n");
+    fprintf(f, "\t\tuint8_t uuid[16];\n");
+    fprintf(f, "\t\tuint32_t stream_id;\n");
+    fprintf(f, "\t};\n");
+    fprintf(f, "};\n\n");
+
+    fprintf(f, "env {\n");
+    fprintf(f, "\tdomain = \"ebpf\";\n");
+    fprintf(f, "\ttracer_name = \"mylib_tracer\";\n");
+    fprintf(f, "};\n\n");
+
+    fprintf(f, "clock {\n");
+    fprintf(f, "\tname = \"monotonic\";\n");
+    fprintf(f, "\tdescription = \"%s\";\n", clock_description(w->clock));
+    fprintf(f, "\tfreq = 1000000000;\n");
+    fprintf(f, "\tprecision = %lld;\n", (long long)w->clock_precision_ns);
+    fprintf(f, "\toffset_s = %lld;\n", (long long)(w->clock_offset_ns / 1000000000LL));
+    fprintf(f, "\toffset = %lld;\n", (long long)(w->clock_offset_ns % 1000000000LL));
+    fprintf(f, "};\n\n");
+
+    fprintf(f, "typealias integer {\n");
+    fprintf(f, "\tsize = 64; align = 8; signed = false;\n");
+    fprintf(f, "\tmap = clock.monotonic.value;\n");
+    fprintf(f, "} := uint64_clock_monotonic_t;\n\n");
+
+    fprintf(f, "stream {\n");
+    fprintf(f, "\tid = 0;\n");
+    fprintf(f, "\tevent.header := struct {\n");
+    fprintf(f, "\t\tuint16_t id;\n");
+    fprintf(f, "\t\tuint64_clock_monotonic_t timestamp;\n");
+    fprintf(f, "\t};\n");
+    fprintf(f, "\tpacket.context := struct {\n");
+    fprintf(f, "\t\tuint64_clock_monotonic_t timestamp_begin;\n");
+    fprintf(f, "\t\tuint64_clock_monotonic_t timestamp_end;\n");
+    fprintf(f, "\t\tuint64_t content_size;\n");
+    fprintf(f, "\t\tuint64_t packet_size;\n");
+    fprintf(f, "\t\tuint64_t events_discarded;\n");
+    fprintf(f, "\t\tuint32_t cpu_id;\n");
+    fprintf(f, "\t};\n");
+    fprintf(f, "};\n\n");
+
+    // Same names and field types as the LTTng tracepoints in mylib_tp.h
+    fprintf(f, "event {\n");
+    fprintf(f, "\tname = \"mylib:my_traced_function_entry\";\n");
+    fprintf(f, "\tid = %d;\n", CTF_EVENT_ENTRY);
+    fprintf(f, "\tstream_id = 0;\n");
+    fprintf(f, "\tfields := struct {\n");
+    fprintf(f, "\t\tinteger { size = 32; align = 8; signed = true; } arg1;\n");
+    fprintf(f, "\t\tuint64_t arg2;\n");
+    fprintf(f, "\t\tfloating_point { exp_dig = 11; mant_dig = 53; align = 8; } arg3;\n");
+    fprintf(f, "\t\tinteger { size = 64; align = 8; signed = false; base = 16; } arg4;\n");
+    fprintf(f, "\t};\n");
+    fprintf(f, "};\n\n");
+
+    fprintf(f, "event {\n");
+    fprintf(f, "\tname = \"mylib:my_traced_function_exit\";\n");
+    fprintf(f, "\tid = %d;\n", CTF_EVENT_EXIT);
+    fprintf(f, "\tstream_id = 0;\n");
+    fprintf(f, "\tfields := struct {\n");
+    fprintf(f, "\t};\n");
+    fprintf(f, "};\n\n");
+
+    // Combined mode: one event per call, timestamped at function exit
+    fprintf(f, "event {\n");
+    fprintf(f, "\tname = \"mylib:my_traced_function\";\n");
+    fprintf(f, "\tid = %d;\n", CTF_EVENT_SPAN);
+    fprintf(f, "\tstream_id = 0;\n");
+    fprintf(f, "\tfields := struct {\n");
+    fprintf(f, "\t\tuint64_t duration_ns;\n");
+    fprintf(f, "\t\tinteger { size = 32; align = 8; signed = true; } arg1;\n");
+    fprintf(f, "\t\tuint64_t arg2;\n");
+    fprintf(f, "\t\tfloating_point { exp_dig = 11; mant_dig = 53; align = 8; } arg3;\n");
+    fprintf(f, "\t\tinteger { size = 64; align = 8; signed = false; base = 16; } arg4;\n");
+    fprintf(f, "\t};\n");
+    fprintf(f, "};\n");
+
+    write_func_events(f);
+
+    size = ftell(f);
+    if (fclose(f))
+        return -errno;
+    if (size > 0)
+        w->bytes += size;
+    return 0;
+}
+
+int ctf_writer_close(struct ctf_writer *w, unsigned long events_discarded,
+                     unsigned long long *bytes) {
+    int err = 0;
+
+    for (int i = 0; i < w->nr_streams; i++) {
+        struct ctf_stream *s = &w->streams[i];
+
+        // Always emit at least one packet so no stream file is empty; the
+        // discarded count rides on stream 0's final packet
+        if (!err && (s->packet_events || s->packets_written == 0))
+            err = flush_packet(w, s, i == 0 ? events_discarded : 0);
+        if (fclose(s->file) && !err)
+            err = -errno;
+        s->file = NULL;
+    }
+
+    if (!err)
+        err = write_metadata(w);
+
+    if (bytes)
+        *bytes = w->bytes;
+    free_writer(w);
+    return err;
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-2.0
+// Binary CTF 1.8 (Common Trace Format) writer for mylib_tracer events.
+//
+// Produces a trace directory readable by babeltrace2, the same way LTTng
+// output is:
+//   <dir>/metadata   TSDL description of the layout below
+//   <dir>/stream_N   fixed-size packets of packed, host-endian events, one
+//                    file per stream (babeltrace2 merges them by timestamp)
+#ifndef CTF_WRITER_H
+#define CTF_WRITER_H
+
+#include <stddef.h>
+#include <time.h>
+
+struct ctf_writer;
+
+// Create the trace directory and open nr_streams stream files. Stream i is
+// tagged cpu_id = i. clock is the clock event timestamps were read from
+// (--clock); it is anchored to wall-clock time in the metadata. Returns NULL
+// and sets errno on failure.
+struct ctf_writer *ctf_writer_open(const char *dir, int nr_streams, clockid_t clock);
+
+// Append one event as delivered by the ring buffer (any trace_event_* type,
+// told apart by size; call and return events need the installed func_table)
+// to a stream. A stream must only be fed by one thread at a time;
+// timestamps that go backwards are clamped. Returns 0 or a negative errno.
+int ctf_writer_write_event(struct ctf_writer *w, int stream,
+                           const void *data, size_t size);
+
+// Flush the last packet, write the metadata file and free the writer.
+// events_discarded is recorded in the final packet context. If bytes is
+// non-NULL it receives the total trace size (stream + metadata).
+int ctf_writer_close(struct ctf_writer *w, unsigned long events_discarded,
+                     unsigned long long *bytes);
+
+#endif // CTF_WRITER_H
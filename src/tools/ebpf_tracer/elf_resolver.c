@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: GPL-2.0
+// libelf-based symbol resolver. A uprobe offset is a file offset, not a
+// virtual address: for a symbol in section S it is
+//     st_value - S.sh_addr + S.sh_offset
+// which only equals st_value when the section is mapped at its file offset.
+// (nm prints st_value, so the old popen was wrong for such libraries.)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <gelf.h>
+#include "elf_resolver.h"
+
+struct elf_sym_entry {
+    const char *name;
+    size_t name_off;  // Into the names arena while it may still move
+    long offset;
+    int rank;         // Lower wins among duplicates: .dynsym before .symtab, global before local
+};
+
+struct elf_resolver {
+    char *path;
+    char *names;      // All symbol names, NUL-separated
+    struct elf_sym_entry *syms;
+    int nr_syms;
+    struct elf_resolver *next;  // Cache list
+};
+
+static struct elf_resolver *cache;
+
+static int sym_cmp(const void *a, const void *b) {
+    const struct elf_sym_entry *x = a, *y = b;
+    int c = strcmp(x->name, y->name);
+    return c ? c : x->rank - y->rank;
+}
+
+static int sym_cmp_name(const void *a, const void *b) {
+    const struct elf_sym_entry *x = a, *y = b;
+    return strcmp(x->name, y->name);
+}
+
+static int sym_bind_rank(const GElf_Sym *sym) {
+    switch (GELF_ST_BIND(sym->st_info)) {
+    case STB_GLOBAL: return 0;
+    case STB_WEAK:   return 1;
+    default:         return 2;
+    }
+}
+
+// Append the defined functions of one symbol table to the index
+static int index_symtab(struct elf_resolver *r, Elf *elf, Elf_Scn *scn,
+                        const GElf_Shdr *shdr, int table_rank,
+                        size_t *cap, size_t *names_len, size_t *names_cap) {
+    Elf_Data *data = elf_getdata(scn, NULL);
+    size_t count;
+
+    if (!data || !shdr->sh_entsize)
+        return 0;
+    count = shdr->sh_size / shdr->sh_entsize;
+
+    for (size_t i = 0; i < count; i++) {
+        GElf_Sym sym;
+        GElf_Shdr sec;
+        Elf_Scn *sec_scn;
+        const char *name;
+        size_t len;
+
+        if (!gelf_getsym(data, (int)i, &sym))
+            continue;
+        if (GELF_ST_TYPE(sym.st_info) != STT_FUNC &&
+            GELF_ST_TYPE(sym.st_info) != STT_GNU_IFUNC)
+            continue;
+        if (sym.st_shndx == SHN_UNDEF || sym.st_shndx >= SHN_LORESERVE || !sym.st_value)
+            continue;
+
+        name = elf_strptr(elf, shdr->sh_link, sym.st_name);
+        if (!name || !*name)
+            continue;
+
+        sec_scn = elf_getscn(elf, sym.st_shndx);
+        if (!sec_scn || !gelf_getshdr(sec_scn, &sec) || sec.sh_type == SHT_NOBITS)
+            continue;
+
+        if ((size_t)r->nr_syms == *cap) {
+            size_t new_cap = *cap ? *cap * 2 : 256;
+            void *p = realloc(r->syms, new_cap * sizeof(*r->syms));
+            if (!p)
+                return -ENOMEM;
+            r->syms = p;
+            *cap = new_cap;
+        }
+
+        len = strlen(name) + 1;
+        if (*names_len + len > *names_cap) {
+            size_t new_cap = *names_cap ? *names_cap * 2 : 4096;
+            while (new_cap < *names_len + len)
+                new_cap *= 2;
+            void *p = realloc(r->names, new_cap);
+            if (!p)
+                return -ENOMEM;
+            r->names = p;
+            *names_cap = new_cap;
+        }
+        memcpy(r->names + *names_len, name, len);
+
+        struct elf_sym_entry *e = &r->syms[r->nr_syms++];
+        e->name_off = *names_len;
+        e->offset = (long)(sym.st_value - sec.sh_addr + sec.sh_offset);
+        e->rank = table_rank * 4 + sym_bind_rank(&sym);
+        *names_len += len;
+    }
+    return 0;
+}
+
+struct elf_resolver *elf_resolver_open(const char *path) {
+    size_t cap = 0, names_len = 0, names_cap = 0;
+    struct elf_resolver *r;
+    Elf_Scn *scn = NULL;
+    Elf *elf;
+    int fd, err = 0;
+
+    if (elf_version(EV_CURRENT) == EV_NONE) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    elf = elf_begin(fd, ELF_C_READ_MMAP, NULL);
+    if (!elf || elf_kind(elf) != ELF_K_ELF) {
+        if (elf)
+            elf_end(elf);
+        close(fd);
+        errno = ENOEXEC;
+        return NULL;
+    }
+
+    r = calloc(1, sizeof(*r));
+    if (!r) {
+        err = -ENOMEM;
+        goto out;
+    }
+
+    // One pass over every symbol table; lookups never touch the ELF again
+    while ((scn = elf_nextscn(elf, scn)) != NULL) {
+        GElf_Shdr shdr;
+
+        if (!gelf_getshdr(scn, &shdr))
+            continue;
+        if (shdr.sh_type == SHT_DYNSYM)
+            err = index_symtab(r, elf, scn, &shdr, 0, &cap, &names_len, &names_cap);
+        else if (shdr.sh_type == SHT_SYMTAB)
+            err = index_symtab(r, elf, scn, &shdr, 1, &cap, &names_len, &names_cap);
+        if (err)
+            goto out;
+    }
+
+    // The arena has stopped moving; sort and keep the best-ranked duplicate
+    for (int i = 0; i < r->nr_syms; i++)
+        r->syms[i].name = r->names + r->syms[i].name_off;
+    qsort(r->syms, r->nr_syms, sizeof(*r->syms), sym_cmp);
+
+    int n = 0;
+    for (int i = 0; i < r->nr_syms; i++) {
+        if (n > 0 && !strcmp(r->syms[n - 1].name, r->syms[i].name))
+            continue;
+        r->syms[n++] = r->syms[i];
+    }
+    r->nr_syms = n;
+
+    r->path = strdup(path);
+    if (!r->path)
+        err = -ENOMEM;
+
+out:
+    elf_end(elf);
+    close(fd);
+    if (err) {
+        elf_resolver_close(r);
+        errno = -err;
+        return NULL;
+    }
+    return r;
+}
+
+void elf_resolver_close(struct elf_resolver *r) {
+    if (!r)
+        return;
+    free(r->syms);
+    free(r->names);
+    free(r->path);
+    free(r);
+}
+
+struct elf_resolver *elf_resolver_get(const char *path) {
+    char resolved[PATH_MAX];
+    struct elf_resolver *r;
+
+    // Key on the canonical path so ../lib/x.so and ./build/lib/x.so share
+    if (!realpath(path, resolved))
+        return NULL;
+
+    for (r = cache; r; r = r->next) {
+        if (!strcmp(r->path, resolved))
+            return r;
+    }
+
+    r = elf_resolver_open(resolved);
+    if (r) {
+        r->next = cache;
+        cache = r;
+    }
+    return r;
+}
+
+void elf_resolver_cache_clear(void) {
+    while (cache) {
+        struct elf_resolver *next = cache->next;
+        elf_resolver_close(cache);
+        cache = next;
+    }
+}
+
+long elf_resolver_offset(const struct elf_resolver *r, const char *name) {
+    struct elf_sym_entry key = { .name = name };
+    const struct elf_sym_entry *e;
+
+    e = bsearch(&key, r->syms, r->nr_syms, sizeof(*r->syms), sym_cmp_name);
+    return e ? e->offset : -ENOENT;
+}
+
+int elf_resolver_resolve(const struct elf_resolver *r, const char *const *names,
+                         long *offsets, int n) {
+    int found = 0;
+
+    for (int i = 0; i < n; i++) {
+        offsets[i] = elf_resolver_offset(r, names[i]);
+        if (offsets[i] >= 0)
+            found++;
+    }
+    return found;
+}
+
+int elf_resolver_count(const struct elf_resolver *r) {
+    return r->nr_syms;
+}
+
+const char *elf_resolver_name(const struct elf_resolver *r, int i) {
+    return i >= 0 && i < r->nr_syms ? r->syms[i].name : NULL;
+}
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: GPL-2.0
+// In-process ELF symbol resolver: maps function names in a shared library to
+// the file offsets uprobes attach at. Replaces forking `nm -D | grep` per
+// symbol. Each library is parsed once (.dynsym, plus .symtab if present)
+// into a sorted index, so resolving thousands of names is a binary search each.
+#ifndef ELF_RESOLVER_H
+#define ELF_RESOLVER_H
+
+struct elf_resolver;
+
+// Index the function symbols of an ELF file. Returns NULL and sets errno on
+// failure.
+struct elf_resolver *elf_resolver_open(const char *path);
+
+// Like elf_resolver_open, but returns a cached resolver for a path that was
+// already indexed. Cached resolvers live until elf_resolver_cache_clear()
+// and must not be passed to elf_resolver_close().
+struct elf_resolver *elf_resolver_get(const char *path);
+void elf_resolver_cache_clear(void);
+
+void elf_resolver_close(struct elf_resolver *r);
+
+// File offset of a defined function symbol, or -ENOENT
+long elf_resolver_offset(const struct elf_resolver *r, const char *name);
+
+// Resolve n names in one call. offsets[i] is the file offset or -ENOENT.
+// Returns the number of names found.
+int elf_resolver_resolve(const struct elf_resolver *r, const char *const *names,
+                         long *offsets, int n);
+
+// Number of indexed function symbols, and the name of the i-th (sorted order)
+int elf_resolver_count(const struct elf_resolver *r);
+const char *elf_resolver_name(const struct elf_resolver *r, int i);
+
+#endif // ELF_RESOLVER_H
@@ -0,0 +1,330 @@
+// SPDX-License-Identifier: GPL-2.0
+// Column layout per chunk. Every event has a timestamp (a signed 32-bit delta
+// from the chunk's current base) and a type byte. The base starts at the
+// chunk's first timestamp; an event too far from it (a gap of more than
+// ~2 s) moves the base to its own timestamp through an entry in the chunk's
+// small rebase table, so sparse events share chunks like dense ones. Entry and span events
+// also append one argument row; spans additionally append a duration. The
+// generic call and return events (--functions) append a function row, plus a
+// register row or a return value row. Rows are implicit: the n-th event with
+// arguments owns argument row n, so a scan walks each column front to back.
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "event_store.h"
+
+#define CHUNK_EVENTS (64 * 1024)
+
+enum event_kind {
+    KIND_ENTRY = 0,  // Same values as event_type
+    KIND_EXIT = 1,
+    KIND_SPAN = 2,
+    KIND_CALL = 3,
+    KIND_RETURN = 4,
+};
+
+// From event row onward, ts_delta is relative to base
+struct ts_rebase {
+    unsigned int row;
+    __u64 base;
+};
+
+// calloc'd, so only the column pages that are written become resident. The
+// argument columns of a chunk of entry/exit pairs are about half used.
+struct event_chunk {
+    struct event_chunk *next;
+    __u64 ts_base;              // Base of the first event's delta
+    __u64 ts_cur;               // Base of the latest delta (append side)
+    struct ts_rebase *rebases;  // In row order; grown with realloc
+    unsigned int nr_rebases;
+    unsigned int max_rebases;
+    unsigned int nr_events;
+    unsigned int nr_args;
+    unsigned int nr_spans;
+    unsigned int nr_funcs;
+    unsigned int nr_calls;
+    unsigned int nr_returns;
+
+    __s32 ts_delta[CHUNK_EVENTS];
+    __u8 kind[CHUNK_EVENTS];
+
+    __s32 arg1[CHUNK_EVENTS];
+    __u64 arg2[CHUNK_EVENTS];
+    double arg3[CHUNK_EVENTS];
+    __u64 arg4[CHUNK_EVENTS];
+
+    __u64 duration_ns[CHUNK_EVENTS];
+
+    __u32 func_id[CHUNK_EVENTS];
+    __u64 regs[CALL_REGS][CHUNK_EVENTS];
+    __u64 ret[CHUNK_EVENTS];
+};
+
+void event_store_init(struct event_store *s, unsigned long max_events) {
+    memset(s, 0, sizeof(*s));
+    s->max_events = max_events;
+}
+
+void event_store_free(struct event_store *s) {
+    struct event_chunk *c = s->head;
+
+    while (c) {
+        struct event_chunk *next = c->next;
+        free(c->rebases);
+        free(c);
+        c = next;
+    }
+    s->head = s->tail = NULL;
+    s->count = 0;
+    s->nr_chunks = 0;
+}
+
+static struct event_chunk *new_chunk(struct event_store *s, __u64 ts) {
+    struct event_chunk *c = calloc(1, sizeof(*c));
+
+    if (!c)
+        return NULL;
+    c->ts_base = c->ts_cur = ts;
+    if (s->tail)
+        s->tail->next = c;
+    else
+        s->head = c;
+    s->tail = c;
+    s->nr_chunks++;
+    return c;
+}
+
+// Whether ts can be stored as a delta from the chunk's current base
+static int ts_fits(const struct event_chunk *c, __u64 ts) {
+    __s64 delta = (__s64)(ts - c->ts_cur);
+    return delta >= INT32_MIN && delta <= INT32_MAX;
+}
+
+// Make ts the base from event row n onward
+static int ts_rebase(struct event_chunk *c, unsigned int n, __u64 ts) {
+    if (c->nr_rebases == c->max_rebases) {
+        unsigned int max = c->max_rebases ? c->max_rebases * 2 : 16;
+        struct ts_rebase *r = realloc(c->rebases, max * sizeof(*r));
+
+        if (!r)
+            return -ENOMEM;
+        c->rebases = r;
+        c->max_rebases = max;
+    }
+    c->rebases[c->nr_rebases++] = (struct ts_rebase){ .row = n, .base = ts };
+    c->ts_cur = ts;
+    return 0;
+}
+
+int event_store_append(struct event_store *s, const void *data, size_t size) {
+    struct event_chunk *c = s->tail;
+    enum event_kind kind;
+    __u64 ts;
+
+    if (size == sizeof(struct trace_event_entry))
+        kind = KIND_ENTRY;
+    else if (size == sizeof(struct trace_event_exit))
+        kind = KIND_EXIT;
+    else if (size == sizeof(struct trace_event_span))
+        kind = KIND_SPAN;
+    else if (size == sizeof(struct trace_event_call))
+        kind = KIND_CALL;
+    else if (size == sizeof(struct trace_event_return))
+        kind = KIND_RETURN;
+    else
+        return -EINVAL;
+
+    if (s->count >= s->max_events)
+        return -ENOSPC;
+
+    memcpy(&ts, data, sizeof(ts));  // First field of every event type
+
+    if (!c || c->nr_events == CHUNK_EVENTS) {
+        c = new_chunk(s, ts);
+        if (!c)
+            return -ENOMEM;
+    } else if (!ts_fits(c, ts) && ts_rebase(c, c->nr_events, ts)) {
+        return -ENOMEM;
+    }
+
+    unsigned int n = c->nr_events++;
+    c->ts_delta[n] = (__s32)(ts - c->ts_cur);
+    c->kind[n] = kind;
+
+    if (kind == KIND_ENTRY) {
+        const struct trace_event_entry *e = data;
+        unsigned int a = c->nr_args++;
+
+        c->arg1[a] = e->arg1;
+        c->arg2[a] = e->arg2;
+        c->arg3[a] = e->arg3;
+        c->arg4[a] = e->arg4;
+    } else if (kind == KIND_SPAN) {
+        const struct trace_event_span *e = data;
+        unsigned int a = c->nr_args++;
+
+        c->arg1[a] = e->arg1;
+        c->arg2[a] = e->arg2;
+        c->arg3[a] = e->arg3;
+        c->arg4[a] = e->arg4;
+        c->duration_ns[c->nr_spans++] = e->duration_ns;
+    } else if (kind == KIND_CALL) {
+        const struct trace_event_call *e = data;
+        unsigned int r = c->nr_calls++;
+
+        c->func_id[c->nr_funcs++] = e->func_id;
+        for (int i = 0; i < CALL_REGS; i++)
+            c->regs[i][r] = e->regs[i];
+    } else if (kind == KIND_RETURN) {
+        const struct trace_event_return *e = data;
+
+        c->func_id[c->nr_funcs++] = e->func_id;
+        c->ret[c->nr_returns++] = e->ret;
+    }
+
+    s->count++;
+    return 0;
+}
+
+size_t event_store_bytes(const struct event_store *s) {
+    size_t bytes = 0;
+
+    for (const struct event_chunk *c = s->head; c; c = c->next) {
+        bytes += (size_t)c->nr_events * (sizeof(c->ts_delta[0]) + sizeof(c->kind[0]));
+        bytes += (size_t)c->nr_args * (sizeof(c->arg1[0]) + sizeof(c->arg2[0]) +
+                                       sizeof(c->arg3[0]) + sizeof(c->arg4[0]));
+        bytes += (size_t)c->nr_spans * sizeof(c->duration_ns[0]);
+        bytes += (size_t)c->nr_funcs * sizeof(c->func_id[0]);
+        bytes += (size_t)c->nr_calls * CALL_REGS * sizeof(c->regs[0][0]);
+        bytes += (size_t)c->nr_returns * sizeof(c->ret[0]);
+        bytes += (size_t)c->max_rebases * sizeof(c->rebases[0]);
+    }
+    return bytes;
+}
+
+unsigned int event_store_chunk_events(void) {
+    return CHUNK_EVENTS;
+}
+
+// Position the cursor on the first event of c
+static void cursor_enter(struct event_cursor *cur, const struct event_chunk *c) {
+    cur->chunk = c;
+    cur->idx = cur->arg_idx = cur->span_idx = 0;
+    cur->func_idx = cur->call_idx = cur->ret_idx = 0;
+    cur->rebase_idx = 0;
+    cur->ts_base = c ? c->ts_base : 0;
+}
+
+void event_cursor_init(struct event_cursor *cur, const struct event_store *s) {
+    memset(cur, 0, sizeof(*cur));
+    cursor_enter(cur, s->head);
+}
+
+size_t event_cursor_next(struct event_cursor *cur, union stored_event *ev) {
+    const struct event_chunk *c = cur->chunk;
+
+    while (c && cur->idx == c->nr_events) {
+        c = c->next;
+        cursor_enter(cur, c);
+    }
+    if (!c)
+        return 0;
+
+    unsigned int n = cur->idx++;
+    if (cur->rebase_idx < c->nr_rebases && c->rebases[cur->rebase_idx].row == n)
+        cur->ts_base = c->rebases[cur->rebase_idx++].base;
+    __u64 ts = cur->ts_base + (__s64)c->ts_delta[n];
+
+    switch (c->kind[n]) {
+    case KIND_ENTRY: {
+        unsigned int a = cur->arg_idx++;
+
+        ev->entry.timestamp = ts;
+        ev->entry.arg1 = c->arg1[a];
+        ev->entry.arg2 = c->arg2[a];
+        ev->entry.arg3 = c->arg3[a];
+        ev->entry.arg4 = c->arg4[a];
+        ev->entry.event_type = KIND_ENTRY;
+        return sizeof(ev->entry);
+    }
+    case KIND_SPAN: {
+        unsigned int a = cur->arg_idx++;
+
+        ev->span.timestamp = ts;
+        ev->span.duration_ns = c->duration_ns[cur->span_idx++];
+        ev->span.arg1 = c->arg1[a];
+        ev->span.arg2 = c->arg2[a];
+        ev->span.arg3 = c->arg3[a];
+        ev->span.arg4 = c->arg4[a];
+        ev->span.event_type = KIND_SPAN;
+        return sizeof(ev->span);
+    }
+    case KIND_CALL: {
+        unsigned int r = cur->call_idx++;
+
+        ev->call.timestamp = ts;
+        ev->call.func_id = c->func_id[cur->func_idx++];
+        for (int i = 0; i < CALL_REGS; i++)
+            ev->call.regs[i] = c->regs[i][r];
+        ev->call.event_type = KIND_CALL;
+        return sizeof(ev->call);
+    }
+    case KIND_RETURN:
+        ev->ret.timestamp = ts;
+        ev->ret.func_id = c->func_id[cur->func_idx++];
+        ev->ret.ret = c->ret[cur->ret_idx++];
+        ev->ret.event_type = KIND_RETURN;
+        return sizeof(ev->ret);
+    default:
+        ev->exit.timestamp = ts;
+        ev->exit.event_type = KIND_EXIT;
+        return sizeof(ev->exit);
+    }
+}
+
+unsigned long event_cursor_skip(struct event_cursor *cur, unsigned long n) {
+    const struct event_chunk *c = cur->chunk;
+    unsigned long skipped = 0;
+
+    while (c && skipped < n) {
+        unsigned int left = c->nr_events - cur->idx;
+
+        if (n - skipped < left) {
+            // Part of this chunk: the row indexes advance with the events
+            // being skipped that own rows
+            unsigned int end = cur->idx + (unsigned int)(n - skipped);
+
+            while (cur->rebase_idx < c->nr_rebases && c->rebases[cur->rebase_idx].row < end)
+                cur->ts_base = c->rebases[cur->rebase_idx++].base;
+            for (; cur->idx < end; cur->idx++) {
+                __u8 kind = c->kind[cur->idx];
+
+                cur->arg_idx += kind == KIND_ENTRY || kind == KIND_SPAN;
+                cur->span_idx += kind == KIND_SPAN;
+                cur->func_idx += kind == KIND_CALL || kind == KIND_RETURN;
+                cur->call_idx += kind == KIND_CALL;
+                cur->ret_idx += kind == KIND_RETURN;
+            }
+            return n;
+        }
+
+        skipped += left;
+        if (!c->next) {
+            cur->idx = c->nr_events;
+            cur->arg_idx = c->nr_args;
+            cur->span_idx = c->nr_spans;
+            cur->func_idx = c->nr_funcs;
+            cur->call_idx = c->nr_calls;
+            cur->ret_idx = c->nr_returns;
+            if (c->nr_rebases) {
+                cur->rebase_idx = c->nr_rebases;
+                cur->ts_base = c->rebases[c->nr_rebases - 1].base;
+            }
+            break;
+        }
+        c = c->next;
+        cursor_enter(cur, c);
+    }
+    return skipped;
+}
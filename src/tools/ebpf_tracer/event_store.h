@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: GPL-2.0
+// Columnar in-memory event store. Timestamps, event types and arguments live
+// in separate columns of fixed-capacity chunks allocated as they fill, so an
+// exit event costs 5 bytes instead of a slot sized for the largest record.
+#ifndef EVENT_STORE_H
+#define EVENT_STORE_H
+
+#include <stddef.h>
+#include <linux/types.h>
+#include "mylib_tracer.h"
+
+// Any event record, as delivered by the ring buffer
+union stored_event {
+    struct trace_event_entry entry;
+    struct trace_event_exit exit;
+    struct trace_event_span span;
+    struct trace_event_call call;
+    struct trace_event_return ret;
+    char raw[sizeof(struct trace_event_call)];  // Max size
+};
+
+struct event_chunk;
+
+struct event_store {
+    struct event_chunk *head;
+    struct event_chunk *tail;
+    unsigned long count;
+    unsigned long max_events;
+    unsigned int nr_chunks;
+};
+
+// Read position in a store; events come back in append order
+struct event_cursor {
+    const struct event_chunk *chunk;
+    unsigned int idx;       // Event within the chunk
+    unsigned int arg_idx;   // Argument row (entry and span events)
+    unsigned int span_idx;  // Duration row (span events)
+    unsigned int func_idx;  // Function row (call and return events)
+    unsigned int call_idx;  // Register row (call events)
+    unsigned int ret_idx;   // Return value row (return events)
+    unsigned int rebase_idx;  // Next timestamp rebase of the chunk
+    __u64 ts_base;          // Base the next event's delta is relative to
+};
+
+void event_store_init(struct event_store *s, unsigned long max_events);
+void event_store_free(struct event_store *s);
+
+// Append one ring buffer record. Returns 0, -ENOSPC once max_events are
+// stored, -ENOMEM, or -EINVAL for a record of unknown size.
+int event_store_append(struct event_store *s, const void *data, size_t size);
+
+// Bytes of column data and timestamp rebase tables in use (chunk pages are
+// only touched as they fill)
+size_t event_store_bytes(const struct event_store *s);
+
+// Events per chunk, for reporting
+unsigned int event_store_chunk_events(void);
+
+void event_cursor_init(struct event_cursor *c, const struct event_store *s);
+
+// Rebuild the next record into *ev and advance. Returns its size, or 0 at the end.
+size_t event_cursor_next(struct event_cursor *c, union stored_event *ev);
+
+// Advance past up to n events without rebuilding them; whole chunks are
+// stepped over in O(1). Returns the number skipped (less than n at the end).
+unsigned long event_cursor_skip(struct event_cursor *c, unsigned long n);
+
+#endif // EVENT_STORE_H
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-2.0
+// A slot is read like a seqlock: its seq must be the expected record index
+// + 1 both before and after the copy. The BPF side zeroes seq before it
+// rewrites a slot and sets it last, so a slot that changed under the copy
+// fails the second check and is skipped rather than returned torn.
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <bpf/bpf.h>
+#include "flight_recorder.h"
+
+struct flight_recorder {
+    int head_fd;
+    int nr_cpus;
+    unsigned int slots;
+    const struct flight_slot *base;
+    size_t map_size;
+    __u64 *heads;               // Per-CPU values of flight_head
+};
+
+struct flight_recorder *flight_recorder_new(int map_fd, int head_fd, int nr_cpus,
+                                            unsigned int slots) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    struct flight_recorder *fr;
+    void *base;
+
+    if (nr_cpus <= 0 || nr_cpus > MAX_CPUS || !slots || slots > FLIGHT_MAX_SLOTS) {
+        errno = EINVAL;
+        return NULL;
+    }
+    fr = calloc(1, sizeof(*fr));
+    if (!fr)
+        return NULL;
+    fr->heads = calloc(nr_cpus, sizeof(*fr->heads));
+    if (!fr->heads) {
+        free(fr);
+        return NULL;
+    }
+    fr->head_fd = head_fd;
+    fr->nr_cpus = nr_cpus;
+    fr->slots = slots;
+    fr->map_size = ((size_t)nr_cpus * slots * sizeof(struct flight_slot) + page - 1) & ~(page - 1);
+
+    base = mmap(NULL, fr->map_size, PROT_READ, MAP_SHARED, map_fd, 0);
+    if (base == MAP_FAILED) {
+        int err = errno;
+
+        free(fr->heads);
+        free(fr);
+        errno = err;
+        return NULL;
+    }
+    fr->base = base;
+    return fr;
+}
+
+void flight_recorder_free(struct flight_recorder *fr) {
+    if (!fr)
+        return;
+    munmap((void *)fr->base, fr->map_size);
+    free(fr->heads);
+    free(fr);
+}
+
+int flight_recorder_snapshot(struct flight_recorder *fr, flight_record_fn fn, void *ctx,
+                             struct flight_snapshot *st) {
+    __u32 zero = 0;
+
+    memset(st, 0, sizeof(*st));
+    if (bpf_map_lookup_elem(fr->head_fd, &zero, fr->heads))
+        return -errno;
+
+    for (int cpu = 0; cpu < fr->nr_cpus; cpu++) {
+        const struct flight_slot *ring = fr->base + (size_t)cpu * fr->slots;
+        __u64 head = fr->heads[cpu];
+        __u64 idx = head > fr->slots ? head - fr->slots : 0;
+
+        st->older += idx;
+        for (; idx < head; idx++) {
+            const struct flight_slot *slot = &ring[idx % fr->slots];
+            __u8 data[MAX_RECORD_SIZE];
+            __u64 seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+            __u32 size = slot->size;
+            int err;
+
+            if (seq != idx + 1 || size > MAX_RECORD_SIZE) {
+                st->skipped++;
+                continue;
+            }
+            memcpy(data, slot->data, size);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+                st->skipped++;
+                continue;
+            }
+            err = fn(ctx, cpu, data, size);
+            if (err)
+                return err;
+            st->records++;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-2.0
+// Snapshot reader for the flight recorder (--flight-recorder). The BPF side
+// overwrites per-CPU circular buffers of slots in the mmapped `flight` map
+// and counts the records written per CPU in `flight_head`; this copies out
+// whatever the buffers hold at the moment of the snapshot.
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stddef.h>
+#include <linux/types.h>
+#include "mylib_tracer.h"
+
+// Called with each record of a snapshot, oldest first per CPU. The data is
+// a private copy, only valid during the call. Returns 0 or a negative errno,
+// which stops the snapshot.
+typedef int (*flight_record_fn)(void *ctx, int cpu, void *data, size_t size);
+
+struct flight_snapshot {
+    unsigned long records;      // Handed to the callback
+    unsigned long skipped;      // Being written, or overwritten while we copied them
+    unsigned long long older;   // Written before the records still in the buffers
+};
+
+struct flight_recorder;
+
+// Map the slots of nr_cpus CPUs (the number of possible CPUs) with slots
+// records each. Returns NULL and sets errno on failure.
+struct flight_recorder *flight_recorder_new(int map_fd, int head_fd, int nr_cpus,
+                                            unsigned int slots);
+void flight_recorder_free(struct flight_recorder *fr);
+
+// Hand every complete record in the buffers to fn. Probes may keep writing
+// meanwhile. Returns 0 or a negative errno.
+int flight_recorder_snapshot(struct flight_recorder *fr, flight_record_fn fn, void *ctx,
+                             struct flight_snapshot *st);
+
+#endif // FLIGHT_RECORDER_H
@@ -0,0 +1,340 @@
+// SPDX-License-Identifier: GPL-2.0
+// Argument classification follows the x86-64 SysV calling convention, as far
+// as integer registers go: integers, enums and pointers take the next of
+// rdi, rsi, rdx, rcx, r8, r9; floating point goes to SSE registers; a struct
+// of more than 16 bytes goes to memory; a smaller one takes one or two
+// integer registers if it holds no floating point. Only scalars in integer
+// registers are captured, but the others still have to be accounted for to
+// know where the following arguments are.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <bpf/btf.h>
+#include "elf_resolver.h"
+#include "func_table.h"
+
+static const char *const reg_names[CALL_REGS] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+
+static const struct func_table *installed;
+
+// Whether a type is or contains floating point (SSE class)
+static int has_float(const struct btf *btf, __u32 id, int depth) {
+    const struct btf_type *t;
+    int rid = btf__resolve_type(btf, id);
+
+    if (rid < 0 || depth > 8)
+        return 1;  // Be conservative
+    t = btf__type_by_id(btf, rid);
+    if (btf_is_float(t))
+        return 1;
+    if (btf_is_array(t))
+        return has_float(btf, btf_array(t)->type, depth + 1);
+    if (btf_is_composite(t)) {
+        const struct btf_member *m = btf_members(t);
+
+        for (int i = 0; i < btf_vlen(t); i++) {
+            if (has_float(btf, m[i].type, depth + 1))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// Class and size of a type, with typedefs and qualifiers stripped
+static void classify_type(const struct btf *btf, __u32 id, struct arg_layout *a) {
+    const struct btf_type *t;
+    int rid;
+
+    a->size = 8;
+    if (id == 0) {
+        a->cls = ARG_VOID;
+        return;
+    }
+    rid = btf__resolve_type(btf, id);
+    t = rid < 0 ? NULL : btf__type_by_id(btf, rid);
+    if (!t) {
+        a->cls = ARG_HEX;
+        return;
+    }
+
+    if (btf_is_int(t)) {
+        __u8 enc = btf_int_encoding(t);
+
+        a->size = t->size;
+        if (t->size > 8)
+            a->cls = ARG_AGGREGATE;  // __int128: a register pair
+        else if (enc & BTF_INT_BOOL)
+            a->cls = ARG_BOOL;
+        else
+            a->cls = enc & BTF_INT_SIGNED ? ARG_SIGNED : ARG_UNSIGNED;
+    } else if (btf_is_enum(t) || btf_is_enum64(t)) {
+        a->size = t->size;
+        a->cls = btf_kflag(t) ? ARG_SIGNED : ARG_UNSIGNED;
+    } else if (btf_is_ptr(t)) {
+        a->cls = ARG_HEX;
+    } else if (btf_is_float(t)) {
+        a->size = t->size;
+        a->cls = ARG_FLOAT;
+    } else {
+        __s64 size = btf__resolve_size(btf, rid);
+
+        a->size = size > 0 && size < 256 ? size : 0;
+        a->cls = ARG_AGGREGATE;
+    }
+}
+
+static void set_name(char *dst, size_t len, const char *name) {
+    snprintf(dst, len, "%s", name);
+}
+
+// CALL_REGS registers as hex, for functions without type information
+static void untyped_layout(struct func_layout *f) {
+    f->typed = 0;
+    f->nr_args = CALL_REGS;
+    for (int i = 0; i < CALL_REGS; i++) {
+        struct arg_layout *a = &f->args[i];
+
+        snprintf(a->name, sizeof(a->name), "arg%d", i + 1);
+        a->cls = ARG_HEX;
+        a->size = 8;
+        a->reg = i;
+    }
+    set_name(f->ret.name, sizeof(f->ret.name), "ret");
+    f->ret.cls = ARG_HEX;
+    f->ret.size = 8;
+    f->ret.reg = 0;
+}
+
+static int typed_layout(const struct btf *btf, struct func_layout *f) {
+    const struct btf_type *func, *proto;
+    const struct btf_param *p;
+    int next_reg = 0, regs_known = 1;
+    __s32 id;
+
+    id = btf__find_by_name_kind(btf, f->name, BTF_KIND_FUNC);
+    if (id < 0)
+        return -ENOENT;
+    func = btf__type_by_id(btf, id);
+    proto = func ? btf__type_by_id(btf, func->type) : NULL;
+    if (!proto || !btf_is_func_proto(proto))
+        return -EINVAL;
+
+    f->typed = 1;
+    f->nr_args = 0;
+    p = btf_params(proto);
+    for (int i = 0; i < btf_vlen(proto) && f->nr_args < MAX_FUNC_ARGS; i++) {
+        struct arg_layout *a = &f->args[f->nr_args];
+        const char *name = btf__name_by_offset(btf, p[i].name_off);
+        int nregs = 1;
+
+        if (p[i].type == 0)
+            break;  // Variadic "..."
+        if (name && *name)
+            set_name(a->name, sizeof(a->name), name);
+        else
+            snprintf(a->name, sizeof(a->name), "arg%u", f->nr_args + 1);
+        classify_type(btf, p[i].type, a);
+        f->nr_args++;
+        a->reg = -1;
+
+        if (a->cls == ARG_FLOAT)
+            continue;
+        if (a->cls == ARG_AGGREGATE) {
+            if (a->size == 0 || a->size > 16)
+                continue;  // In memory
+            if (has_float(btf, p[i].type, 0)) {
+                regs_known = 0;  // Possibly split between SSE and integer registers
+                continue;
+            }
+            nregs = (a->size + 7) / 8;
+        }
+        if (!regs_known)
+            continue;
+        // Too few registers left: this argument goes on the stack, but later
+        // scalars still take the remaining registers
+        if (next_reg + nregs > CALL_REGS)
+            continue;
+        if (a->cls != ARG_AGGREGATE)
+            a->reg = next_reg;
+        next_reg += nregs;
+    }
+
+    set_name(f->ret.name, sizeof(f->ret.name), "ret");
+    classify_type(btf, proto->type, &f->ret);
+    f->ret.reg = f->ret.cls == ARG_VOID || f->ret.cls == ARG_FLOAT ||
+                 f->ret.cls == ARG_AGGREGATE ? -1 : 0;
+    return 0;
+}
+
+static struct btf *load_btf(const char *lib_path, const char *btf_path, char *source, size_t len) {
+    struct btf *btf;
+    char path[4096];
+
+    if (btf_path) {
+        btf = btf__parse(btf_path, NULL);
+        if (btf)
+            set_name(source, len, btf_path);
+        return btf;
+    }
+
+    // pahole -J adds a .BTF section; --btf_encode_detached writes a file
+    btf = btf__parse(lib_path, NULL);
+    if (btf) {
+        set_name(source, len, lib_path);
+        return btf;
+    }
+    snprintf(path, sizeof(path), "%s.btf", lib_path);
+    btf = btf__parse(path, NULL);
+    if (btf)
+        set_name(source, len, path);
+    return btf;
+}
+
+static int add_function(struct func_table *t, const char *name, long offset) {
+    struct func_layout *f;
+
+    // Aliases share an offset; attaching twice would record every call twice
+    for (unsigned int i = 0; i < t->nr; i++) {
+        if (t->funcs[i].offset == offset)
+            return 0;
+    }
+    if (t->nr == MAX_TRACED_FUNCS)
+        return -E2BIG;
+    f = &t->funcs[t->nr++];
+    set_name(f->name, sizeof(f->name), name);
+    f->offset = offset;
+    return 0;
+}
+
+static int add_pattern(struct func_table *t, const struct elf_resolver *r, const char *pattern) {
+    int matched = 0, err;
+
+    if (!strpbrk(pattern, "*?[")) {
+        long offset = elf_resolver_offset(r, pattern);
+
+        if (offset < 0)
+            return offset;
+        return add_function(t, pattern, offset);
+    }
+
+    for (int i = 0; i < elf_resolver_count(r); i++) {
+        const char *name = elf_resolver_name(r, i);
+
+        if (fnmatch(pattern, name, 0))
+            continue;
+        err = add_function(t, name, elf_resolver_offset(r, name));
+        if (err)
+            return err;
+        matched++;
+    }
+    return matched ? 0 : -ENOENT;
+}
+
+int func_table_build(struct func_table *t, const char *lib_path,
+                     const char *btf_path, const char *patterns) {
+    struct elf_resolver *r;
+    char *list, *tok, *save;
+    struct btf *btf;
+    int err = 0;
+
+    memset(t, 0, sizeof(*t));
+    r = elf_resolver_get(lib_path);
+    if (!r)
+        return -errno;
+
+    list = strdup(patterns);
+    if (!list)
+        return -ENOMEM;
+    for (tok = strtok_r(list, ",", &save); tok && !err; tok = strtok_r(NULL, ",", &save)) {
+        err = add_pattern(t, r, tok);
+        if (err == -ENOENT)
+            fprintf(stderr, "No function in %s matches '%s'\n", lib_path, tok);
+    }
+    free(list);
+    if (err)
+        return err;
+    if (t->nr == 0)
+        return -ENOENT;
+
+    btf = load_btf(lib_path, btf_path, t->type_source, sizeof(t->type_source));
+    if (!btf && btf_path)
+        return errno ? -errno : -ENOENT;
+    for (unsigned int i = 0; i < t->nr; i++) {
+        if (!btf || typed_layout(btf, &t->funcs[i]))
+            untyped_layout(&t->funcs[i]);
+    }
+    btf__free(btf);
+    return 0;
+}
+
+void func_table_mask(struct func_table *t, unsigned int mask) {
+    for (unsigned int i = 0; i < t->nr; i++) {
+        struct func_layout *f = &t->funcs[i];
+
+        for (unsigned int j = 0; j < f->nr_args; j++) {
+            if (f->args[j].reg >= 0 && !(mask & (1U << f->args[j].reg)))
+                f->args[j].reg = -1;
+        }
+    }
+}
+
+static const char *class_name(const struct arg_layout *a) {
+    switch (a->cls) {
+    case ARG_SIGNED:    return "signed";
+    case ARG_UNSIGNED:  return "unsigned";
+    case ARG_BOOL:      return "bool";
+    case ARG_HEX:       return "hex";
+    case ARG_FLOAT:     return "float";
+    case ARG_AGGREGATE: return "aggregate";
+    default:            return "void";
+    }
+}
+
+void func_table_print(const struct func_table *t, FILE *f) {
+    for (unsigned int i = 0; i < t->nr; i++) {
+        const struct func_layout *fn = &t->funcs[i];
+
+        fprintf(f, "  [%u] %s(", i, fn->name);
+        for (unsigned int j = 0; j < fn->nr_args; j++) {
+            const struct arg_layout *a = &fn->args[j];
+
+            fprintf(f, "%s%s: %s%u %s", j ? ", " : "", a->name, class_name(a), a->size * 8,
+                    a->reg >= 0 ? reg_names[a->reg] :
+                    a->cls == ARG_FLOAT ? "(xmm, not captured)" : "(not captured)");
+        }
+        fprintf(f, ") -> %s", class_name(&fn->ret));
+        if (fn->ret.cls != ARG_VOID)
+            fprintf(f, "%u%s", fn->ret.size * 8, fn->ret.reg >= 0 ? "" : " (not captured)");
+        fprintf(f, "%s\n", fn->typed ? "" : " [no type info]");
+    }
+}
+
+void func_table_install(const struct func_table *t) {
+    installed = t;
+}
+
+const struct func_layout *func_table_lookup(__u32 func_id) {
+    if (!installed || func_id >= installed->nr)
+        return NULL;
+    return &installed->funcs[func_id];
+}
+
+unsigned int func_table_count(void) {
+    return installed ? installed->nr : 0;
+}
+
+__u64 func_arg_value(const struct arg_layout *a, __u64 reg) {
+    switch (a->size) {
+    case 1:
+        return a->cls == ARG_SIGNED ? (__u64)(__s64)(__s8)reg : (__u8)reg;
+    case 2:
+        return a->cls == ARG_SIGNED ? (__u64)(__s64)(__s16)reg : (__u16)reg;
+    case 4:
+        return a->cls == ARG_SIGNED ? (__u64)(__s64)(__s32)reg : (__u32)reg;
+    default:
+        return reg;
+    }
+}
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-2.0
+// Function table for --functions. Resolves names and glob patterns against
+// the library's symbols and derives each function's argument layout from
+// BTF: which integer register every parameter arrives in and how to print
+// it. The generic BPF probes capture raw registers; the text and CTF writers
+// decode them with this table.
+#ifndef FUNC_TABLE_H
+#define FUNC_TABLE_H
+
+#include <stdio.h>
+#include <linux/types.h>
+#include "mylib_tracer.h"
+
+#define FUNC_NAME_MAX 64
+#define ARG_NAME_MAX 32
+#define MAX_FUNC_ARGS 12
+
+// How a parameter (or the return value) is printed
+enum arg_class {
+    ARG_SIGNED,     // Sign-extended from size bytes
+    ARG_UNSIGNED,   // Zero-extended from size bytes
+    ARG_BOOL,
+    ARG_HEX,        // Pointers, and every register when there is no type info
+    ARG_FLOAT,      // SSE register: not in pt_regs, never captured
+    ARG_AGGREGATE,  // Struct, union or 128-bit integer by value: not captured
+    ARG_VOID,       // Return type only
+};
+
+// An argument is captured if it arrives in one of the CALL_REGS integer
+// registers. Past the sixth, or after a small aggregate containing floats
+// (whose register use is not worked out), reg is -1.
+struct arg_layout {
+    char name[ARG_NAME_MAX];
+    enum arg_class cls;
+    __u8 size;   // Bytes
+    __s8 reg;    // Index into trace_event_call.regs (0 = ret for the return
+                 // value), or -1 if not captured
+};
+
+struct func_layout {
+    char name[FUNC_NAME_MAX];
+    long offset;  // File offset the probes attach at
+    int typed;    // Layout from BTF; otherwise CALL_REGS registers as hex
+    unsigned int nr_args;
+    struct arg_layout args[MAX_FUNC_ARGS];
+    struct arg_layout ret;
+};
+
+struct func_table {
+    unsigned int nr;
+    char type_source[256];  // BTF file used, "" if none
+    struct func_layout funcs[MAX_TRACED_FUNCS];
+};
+
+// Fill t from a comma-separated list of names and fnmatch(3) patterns.
+// Types come from btf_path, else the library's .BTF section, else
+// <lib_path>.btf; without any, every function gets the untyped layout.
+// Returns 0 or a negative errno (-ENOENT: a plain name was not found or a
+// pattern matched nothing, -E2BIG: more than MAX_TRACED_FUNCS functions).
+int func_table_build(struct func_table *t, const char *lib_path,
+                     const char *btf_path, const char *patterns);
+
+// --args: mark arguments in registers outside mask (bit i = register i) as
+// not captured, so they print as "?" rather than the 0 the probes store
+void func_table_mask(struct func_table *t, unsigned int mask);
+
+// One line per function: its signature as the probes see it
+void func_table_print(const struct func_table *t, FILE *f);
+
+// The table trace_event_call / trace_event_return records are decoded
+// against. Set once before tracing; NULL until then.
+void func_table_install(const struct func_table *t);
+const struct func_layout *func_table_lookup(__u32 func_id);
+unsigned int func_table_count(void);
+
+// Sign- or zero-extend a captured register per the argument's class
+__u64 func_arg_value(const struct arg_layout *a, __u64 reg);
+
+#endif // FUNC_TABLE_H
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-2.0
+// The load of a tick is the largest ratio of a measurement to its budget.
+// Tracer cost scales with the number of recorded events, so an overloaded
+// tick jumps straight to the divisor that would have put it at
+// GOVERNOR_TARGET of the budget. Reserve failures mean events are already
+// being lost, so they at least double the divisor. Below GOVERNOR_RELAX the
+// divisor comes down, by at most half per tick, so a short lull in a burst
+// does not reopen the floodgates at once.
+#include <math.h>
+#include <string.h>
+#include "governor.h"
+
+#define GOVERNOR_TARGET 0.8
+#define GOVERNOR_RELAX 0.5
+#define GOVERNOR_MAX_DIVISOR (1U << 20)
+
+void governor_init(struct governor *g, const struct governor_budget *budget,
+                   unsigned int divisor) {
+    memset(g, 0, sizeof(*g));
+    g->budget = *budget;
+    g->divisor = g->min_divisor = g->max_divisor = divisor;
+    g->episode_start_ms = -1;
+}
+
+static double tick_load(const struct governor *g, const struct governor_tick *t) {
+    double load = 0.0;
+
+    if (g->budget.events_per_s > 0)
+        load = t->events / t->secs / g->budget.events_per_s;
+    if (g->budget.cpu_pct > 0) {
+        double cpu_pct = t->cpu_ns / (t->secs * 1e7);
+        if (cpu_pct / g->budget.cpu_pct > load)
+            load = cpu_pct / g->budget.cpu_pct;
+    }
+    return load;
+}
+
+unsigned int governor_update(struct governor *g, const struct governor_tick *t) {
+    double div = g->divisor, next = div;
+    double load;
+    int over;
+
+    if (t->secs <= 0)
+        return g->divisor;
+
+    load = tick_load(g, t);
+    // Sampling only cuts the cost of events; with none recorded, the
+    // remaining CPU time (polling, the governor itself) cannot be helped
+    over = t->events > 0 && (load > 1.0 || t->reserve_failures > 0);
+
+    if (over) {
+        if (load > 1.0)
+            next = ceil(div * load / GOVERNOR_TARGET);
+        if (t->reserve_failures > 0 && next < div * 2)
+            next = div * 2;
+    } else if (load < GOVERNOR_RELAX) {
+        next = floor(fmax(div * load / GOVERNOR_TARGET, div / 2));
+    }
+    next = fmax(1.0, fmin(next, GOVERNOR_MAX_DIVISOR));
+
+    g->now_ms += t->secs * 1e3;
+    if (over) {
+        if (g->episode_start_ms < 0)
+            g->episode_start_ms = g->now_ms - t->secs * 1e3;
+    } else {
+        if (g->episode_start_ms >= 0) {
+            // Back within budget: the episode lasted until this tick began
+            double reaction = g->now_ms - t->secs * 1e3 - g->episode_start_ms;
+
+            g->episodes++;
+            g->reaction_sum_ms += reaction;
+            if (reaction > g->reaction_max_ms)
+                g->reaction_max_ms = reaction;
+            g->episode_start_ms = -1;
+        }
+        if (t->events > 0) {
+            g->steady_load_sum += load;
+            g->steady_ticks++;
+        }
+    }
+
+    if ((unsigned int)next != g->divisor) {
+        g->divisor = next;
+        g->adjustments++;
+        if (g->divisor < g->min_divisor)
+            g->min_divisor = g->divisor;
+        if (g->divisor > g->max_divisor)
+            g->max_divisor = g->divisor;
+    }
+    return g->divisor;
+}
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-2.0
+// Overhead-budget governor. Once per tick it compares the event rate, ringbuf
+// reserve failures and the tracer's own CPU time against a budget, and picks
+// the sampling divisor (record 1 call in N) for the next tick. The caller
+// pushes the divisor into the BPF side; this file only holds the policy.
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <linux/types.h>
+
+// Limits; 0 leaves a dimension unconstrained
+struct governor_budget {
+    double cpu_pct;        // Tracer CPU time, percent of one core
+    double events_per_s;   // Events recorded per second
+};
+
+// What happened during one tick
+struct governor_tick {
+    double secs;
+    __u64 events;             // Events recorded (kernel events_sent delta)
+    __u64 reserve_failures;   // Events lost because the buffer was full
+    __u64 cpu_ns;             // Tracer process CPU time
+};
+
+struct governor {
+    struct governor_budget budget;
+    unsigned int divisor;
+    unsigned int min_divisor, max_divisor;  // Range used so far
+    unsigned long adjustments;
+
+    // Reaction: over-budget episodes, from the first tick over budget to the
+    // first tick back within it
+    double now_ms;
+    double episode_start_ms;   // < 0 when within budget
+    unsigned long episodes;
+    double reaction_sum_ms;
+    double reaction_max_ms;
+
+    // Accuracy: load (fraction of the budget) in ticks within budget
+    double steady_load_sum;
+    unsigned long steady_ticks;
+};
+
+void governor_init(struct governor *g, const struct governor_budget *budget,
+                   unsigned int divisor);
+
+// Account one tick and return the divisor for the next one
+unsigned int governor_update(struct governor *g, const struct governor_tick *t);
+
+#endif // GOVERNOR_H
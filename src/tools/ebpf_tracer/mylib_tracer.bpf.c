@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0
 #include <linux/types.h>
+#include <linux/bpf.h>  // struct bpf_timer
 
 // Basic type definitions
 typedef __u8 u8;
@@ -39,6 +40,7 @@ struct pt_regs {
 #include <bpf/bpf_helpers.h>
 #include <bpf/bpf_tracing.h>
 #include <bpf/bpf_core_read.h>
+#include <bpf/usdt.bpf.h>
 
 // BPF map types
 #ifndef BPF_MAP_TYPE_RINGBUF
@@ -49,6 +51,38 @@ struct pt_regs {
 #define BPF_MAP_TYPE_PERCPU_ARRAY 6
 #endif
 
+#ifndef BPF_MAP_TYPE_HASH
+#define BPF_MAP_TYPE_HASH 1
+#endif
+
+#ifndef BPF_MAP_TYPE_PERF_EVENT_ARRAY
+#define BPF_MAP_TYPE_PERF_EVENT_ARRAY 4
+#endif
+
+#ifndef BPF_MAP_TYPE_ARRAY_OF_MAPS
+#define BPF_MAP_TYPE_ARRAY_OF_MAPS 12
+#endif
+
+#ifndef BPF_MAP_TYPE_TASK_STORAGE
+#define BPF_MAP_TYPE_TASK_STORAGE 29
+#endif
+
+#ifndef BPF_MAP_TYPE_ARENA
+#define BPF_MAP_TYPE_ARENA 33
+#endif
+
+#ifndef BPF_F_NO_PREALLOC
+#define BPF_F_NO_PREALLOC (1U << 0)
+#endif
+
+#ifndef BPF_F_MMAPABLE
+#define BPF_F_MMAPABLE (1U << 10)
+#endif
+
+#ifndef BPF_LOCAL_STORAGE_GET_F_CREATE
+#define BPF_LOCAL_STORAGE_GET_F_CREATE (1ULL << 0)
+#endif
+
 // Ring buffer flags - CRITICAL for low-latency tracing
 // BPF_RB_FORCE_WAKEUP ensures immediate wakeup of userspace consumer
 // Without this, events can sit in the ring buffer for up to the poll timeout (was 100ms!)
@@ -61,38 +95,169 @@ struct pt_regs {
 #define BPF_RB_FORCE_WAKEUP (1ULL << 1)
 #endif
 
+// bpf_perf_event_output() index: the perf ring of the CPU we run on
+#ifndef BPF_F_CURRENT_CPU
+#define BPF_F_CURRENT_CPU 0xffffffffULL
+#endif
+
+// bpf_ringbuf_query() flag: amount of data not yet consumed
+#ifndef BPF_RB_AVAIL_DATA
+#define BPF_RB_AVAIL_DATA 0
+#endif
+
+// Arena pointers (clang 18+ lowers address space 1 to arena accesses)
+#ifndef __arena
+#define __arena __attribute__((address_space(1)))
+#endif
+
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC 1
+#endif
+
+// Compiler barrier: keeps the stores before it ahead of the ones after it
+// (x86 does not reorder stores, so that is all a release needs)
+#define barrier() asm volatile("" ::: "memory")
+
+#ifndef __ulong
+#define __ulong(name, val) enum { __ulong_##name = val } name
+#endif
+
 #define MAX_STRING_LEN 64
 
 // Optimized: Smaller event structures to reduce memory allocation overhead
-// Entry event with all arguments
-struct trace_event_entry {
-    u64 timestamp;
-    s32 arg1;
-    u64 arg2;
-    double arg3;
-    u64 arg4;
-    u32 event_type;  // 0=entry
-} __attribute__((packed));
+// (trace_event_entry / trace_event_exit are shared with userspace)
+#include "mylib_tracer.h"
 
-// Exit event - minimal size
-struct trace_event_exit {
-    u64 timestamp;
-    u32 event_type;  // 1=exit
-} __attribute__((packed));
+// Load-time configuration, set by userspace through the skeleton's rodata
+// before mylib_tracer_bpf__load(). The verifier sees these as constants and
+// prunes the branches that are not taken.
+const volatile u32 use_percpu_ringbuf = 0;
+const volatile u32 wakeup_policy = WAKEUP_FORCE;
+const volatile u32 wakeup_batch = 64;        // WAKEUP_BATCH: events per wakeup
+const volatile u64 wakeup_watermark = 0;     // WAKEUP_WATERMARK: bytes pending before wakeup
+const volatile u32 histogram_mode = 0;       // Aggregate latencies in-kernel, no ringbuf traffic
+const volatile u64 hist_linear_step_ns = 0;  // 0 = log2 buckets, else linear bucket width
+const volatile u32 combined_mode = 0;        // One span record per call, emitted at exit
+const volatile u32 use_perfbuf = 0;          // Send events through perf_events instead of a ringbuf
+const volatile u32 sample_mode = SAMPLE_ALL;
+const volatile u32 sample_every = 1;         // SAMPLE_EVERY_N: record 1 call in N per CPU
+const volatile u32 sample_threshold = 0;     // SAMPLE_RANDOM: record if prandom < threshold
+const volatile u32 sample_governed = 0;      // --budget: rate comes from the sample_rate map
+const volatile u32 nr_filter_tgids = 0;      // --tgid: trace only these processes
+const volatile u32 filter_tgids[MAX_FILTER_IDS] = {};
+const volatile u32 nr_filter_pids = 0;       // --pid: trace only these threads
+const volatile u32 filter_pids[MAX_FILTER_IDS] = {};
+const volatile u32 stats_enabled = 1;        // --no-kstats: skip the statistics map entirely
+const volatile u32 capture_args = CAPTURE_ALL_ARGS;  // --args: argument registers to read
+const volatile u32 ts_clock = TS_CLOCK_MONO; // --clock: enum ts_clock
+const volatile u32 use_ringbuf_output = 0;   // --rb-output: copy with bpf_ringbuf_output()
+const volatile u32 use_arena = 0;            // --transport=arena: copy into this CPU's arena ring
+#ifdef __BPF_FEATURE_ADDR_SPACE_CAST
+const volatile u32 arena_built = 1;          // Set by the compiler, read by userspace
+#else
+const volatile u32 arena_built = 0;
+#endif
+const volatile u32 stage_events = 0;         // --stage: records per batch (0 = no staging)
+const volatile u64 stage_flush_ns = 0;       // --stage: flush timer period
+const volatile u32 nr_stage_cpus = 0;        // --stage: staging buffers the timer walks
+const volatile u32 flight_slots = 0;         // --flight-recorder: slots per CPU (0 = off)
+const volatile u64 flight_trigger_ns = 0;    // --flight-trigger: calls this slow are anomalies
+
+// --flight-trigger: anomalies seen so far. Userspace polls it through the
+// mmapped .bss and takes a snapshot whenever it changes.
+u64 flight_anomalies = 0;
 
 // Ring buffer for events - OPTIMIZED: 2MB for very high-throughput scenarios
 struct {
     __uint(type, BPF_MAP_TYPE_RINGBUF);
-    __uint(max_entries, 2 * 1024 * 1024);  // OPTIMIZED: 2MB for benchmarking high loads
+    __uint(max_entries, EVENTS_RINGBUF_SIZE);  // OPTIMIZED: 2MB for benchmarking high loads
 } events SEC(".maps");
 
-// Statistics map for performance monitoring (OPTIMIZED with libbpf 1.7.0)
-struct stats {
-    u64 events_sent;
-    u64 events_dropped;
-    u64 reserve_failures;
+// Per-CPU ring buffers: one ringbuf per CPU behind an array-of-maps, so
+// producers on different CPUs never contend on the same ringbuf spinlock.
+// Userspace resizes the outer map to the number of possible CPUs and
+// populates it with ringbufs it creates itself (one consumer thread each).
+struct percpu_ringbuf {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, PERCPU_RINGBUF_SIZE);
 };
 
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY_OF_MAPS);
+    __uint(max_entries, 1);  // Resized to the CPU count by userspace
+    __type(key, u32);
+    __array(values, struct percpu_ringbuf);
+} percpu_events SEC(".maps");
+
+// Perf buffer transport (--transport=perf, or kernels without ringbuf).
+// libbpf sizes it to the number of possible CPUs; userspace maps one perf
+// ring per CPU with perf_buffer__new().
+struct {
+    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, sizeof(u32));
+} perf_events SEC(".maps");
+
+// Arena transport (--transport=arena): per-CPU rings laid out as described
+// in mylib_tracer.h. Userspace sizes it to the CPU count and faults every
+// page in before attaching; a BPF store to a page that is not there would
+// be dropped silently.
+struct {
+    __uint(type, BPF_MAP_TYPE_ARENA);
+    __uint(map_flags, BPF_F_MMAPABLE);
+    __uint(max_entries, 1);  // Pages; resized by userspace
+    __ulong(map_extra, ARENA_USER_BASE);
+} arena SEC(".maps");
+
+// Taking the address of an arena global is what ties a program to the
+// arena: the verifier rejects arena pointers in programs that never
+// reference the map
+u64 __arena arena_anchor;
+
+// --stage: the batch this CPU is filling
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct stage_batch);
+} staging SEC(".maps");
+
+// --stage: the flush timer. Uprobe programs may not use a map holding a
+// bpf_timer, so it is armed by stage_start, a syscall program userspace
+// runs once, and its callback reaches every CPU's batch through
+// bpf_map_lookup_percpu_elem().
+struct stage_timer {
+    struct bpf_timer timer;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct stage_timer);
+} stage_timer SEC(".maps");
+
+// --flight-recorder: every CPU's circular buffer of slots, mmapped by
+// userspace so that a snapshot is a memory copy
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(map_flags, BPF_F_MMAPABLE);
+    __uint(max_entries, 1);  // CPUs x flight_slots; resized by userspace
+    __type(key, u32);
+    __type(value, struct flight_slot);
+} flight SEC(".maps");
+
+// --flight-recorder: records written on each CPU; the next one goes to slot
+// head % flight_slots
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, u64);
+} flight_head SEC(".maps");
+
+// Statistics map for performance monitoring (OPTIMIZED with libbpf 1.7.0)
+// (struct stats is shared with userspace, which reads it with --stats)
 struct {
     __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);  // Per-CPU for zero contention
     __uint(max_entries, 1);
@@ -100,73 +265,873 @@ struct {
     __type(value, struct stats);
 } statistics SEC(".maps");
 
+// Per-CPU event counter for WAKEUP_BATCH
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, u64);
+} wakeup_counter SEC(".maps");
+
+// Sampling: per-CPU call counter for SAMPLE_EVERY_N
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, u64);
+} sample_counter SEC(".maps");
+
+// Sampling: the governed rate (--budget), updated by userspace at runtime
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct sample_rate);
+} sample_rate SEC(".maps");
+
+// Sampling: threads whose current call was picked at entry (key = pid_tgid).
+// The exit probe only records the calls found here, so a sampled call keeps
+// both halves even if the thread migrated CPUs in between. LRU, so entries
+// whose exit never fires (thread killed, longjmp) are evicted instead of
+// filling the map and stopping sampling for good.
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, 10240);
+    __type(key, u64);
+    __type(value, u8);
+} sampled_calls SEC(".maps");
+
+// Histogram mode: entry timestamp per thread (key = pid_tgid)
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 10240);
+    __type(key, u64);
+    __type(value, u64);
+} start_ts SEC(".maps");
+
+// Combined mode: the pending call's entry timestamp and arguments. Task
+// storage lives on the task_struct, so the lookup at exit is a pointer walk
+// rather than a hash of pid_tgid, and it is freed with the thread.
+struct span_start {
+    u64 timestamp;  // 0 = no call in flight
+    s32 arg1;
+    u64 arg2;
+    u64 arg3_bits;
+    u64 arg4;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, int);
+    __type(value, struct span_start);
+} span_start SEC(".maps");
+
+// Histogram mode: per-CPU latency histogram, merged by userspace
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, u32);
+    __type(value, struct latency_hist);
+} latency_hist SEC(".maps");
+
+// Event timestamp from the configured clock (--clock)
+static __always_inline u64 now_ns(void) {
+    if (ts_clock == TS_CLOCK_BOOT)
+        return bpf_ktime_get_boot_ns();
+    if (ts_clock == TS_CLOCK_COARSE)
+        return bpf_ktime_get_coarse_ns();
+    if (ts_clock == TS_CLOCK_TAI)
+        return bpf_ktime_get_tai_ns();
+    return bpf_ktime_get_ns();
+}
+
+// --args: argument n (0-based) if it is captured, else 0. The register is
+// only read on the branch the verifier keeps.
+#define CAPTURED(n, expr) ((capture_args & (1U << (n))) ? (u64)(expr) : 0)
+
+// --pid / --tgid: nonzero if the current thread is not one we trace. Checked
+// before anything else, so other processes that map the library pay only
+// the uprobe trap. Without a filter the verifier prunes all of this.
+static __always_inline int filtered_out(void) {
+    u64 id;
+
+    if (!nr_filter_tgids && !nr_filter_pids)
+        return 0;
+
+    id = bpf_get_current_pid_tgid();
+    for (u32 i = 0; i < MAX_FILTER_IDS && i < nr_filter_tgids; i++) {
+        if (filter_tgids[i] == (u32)(id >> 32))
+            return 0;
+    }
+    for (u32 i = 0; i < MAX_FILTER_IDS && i < nr_filter_pids; i++) {
+        if (filter_pids[i] == (u32)id)
+            return 0;
+    }
+    return 1;
+}
+
+// --budget: the divisor a call was sampled at, for the call count estimate
+static __always_inline void update_stat_calls_estimated(u32 weight) {
+    u32 zero = 0;
+    struct stats *s;
+
+    if (!stats_enabled)
+        return;
+    s = bpf_map_lookup_elem(&statistics, &zero);
+    if (s) __sync_fetch_and_add(&s->calls_estimated, weight);
+}
+
+// --sample: a picked call that could not be remembered for its exit
+static __always_inline void update_stat_sample_failures(void) {
+    u32 zero = 0;
+    struct stats *s;
+
+    if (!stats_enabled)
+        return;
+    s = bpf_map_lookup_elem(&statistics, &zero);
+    if (s) __sync_fetch_and_add(&s->sample_failures, 1);
+}
+
+// Sampling decision at entry. Picked calls are remembered for the exit probe
+// under key (the thread, plus the function for the generic probes); if that
+// fails the call is skipped as a whole and counted in sample_failures.
+static __always_inline int sample_entry(u64 key) {
+    u32 every = sample_every, threshold = sample_threshold;
+    u32 zero = 0;
+    u8 one = 1;
+
+    if (sample_governed) {
+        struct sample_rate *rate = bpf_map_lookup_elem(&sample_rate, &zero);
+        if (!rate)
+            return 0;
+        every = rate->every;
+        threshold = rate->threshold;
+    }
+
+    if (sample_mode == SAMPLE_EVERY_N) {
+        u64 *count = bpf_map_lookup_elem(&sample_counter, &zero);
+        if (!count)
+            return 0;
+        // < rather than !=: the governor may lower every below the count
+        if (++(*count) < every)
+            return 0;
+        *count = 0;
+    } else if (every > 1 && bpf_get_prandom_u32() >= threshold) {
+        return 0;
+    }
+
+    if (bpf_map_update_elem(&sampled_calls, &key, &one, BPF_ANY)) {
+        update_stat_sample_failures();
+        return 0;
+    }
+    // The divisor changes while tracing, so each call carries its own weight
+    if (sample_governed)
+        update_stat_calls_estimated(every);
+    return 1;
+}
+
+// Sampling at exit: record the call only if its entry was picked
+static __always_inline int sample_exit(u64 key) {
+    return bpf_map_delete_elem(&sampled_calls, &key) == 0;
+}
+
 // Statistics helper functions
 static __always_inline void update_stat_events_sent(void) {
     u32 zero = 0;
-    struct stats *s = bpf_map_lookup_elem(&statistics, &zero);
+    struct stats *s;
+
+    if (!stats_enabled)
+        return;
+    s = bpf_map_lookup_elem(&statistics, &zero);
     if (s) __sync_fetch_and_add(&s->events_sent, 1);
 }
 
 static __always_inline void update_stat_events_dropped(void) {
     u32 zero = 0;
-    struct stats *s = bpf_map_lookup_elem(&statistics, &zero);
+    struct stats *s;
+
+    if (!stats_enabled)
+        return;
+    s = bpf_map_lookup_elem(&statistics, &zero);
     if (s) __sync_fetch_and_add(&s->events_dropped, 1);
 }
 
 static __always_inline void update_stat_reserve_failures(void) {
     u32 zero = 0;
-    struct stats *s = bpf_map_lookup_elem(&statistics, &zero);
+    struct stats *s;
+
+    if (!stats_enabled)
+        return;
+    s = bpf_map_lookup_elem(&statistics, &zero);
     if (s) __sync_fetch_and_add(&s->reserve_failures, 1);
 }
 
-// Entry probe - OPTIMIZED for maximum speed
-SEC("uprobe/my_traced_function")
-int my_traced_function_entry(struct pt_regs *ctx) {
+// --stage: a flushed batch of count records, sent or lost as a whole
+static __always_inline void update_stat_batch(u32 count, long err) {
+    u32 zero = 0;
+    struct stats *s;
+
+    if (!stats_enabled)
+        return;
+    s = bpf_map_lookup_elem(&statistics, &zero);
+    if (!s)
+        return;
+    if (err)
+        __sync_fetch_and_add(&s->reserve_failures, count);
+    else
+        __sync_fetch_and_add(&s->events_sent, count);
+}
+
+// The ring buffer of a CPU (per-CPU mode) or the shared one
+static __always_inline void *cpu_ringbuf(u32 cpu) {
+    if (use_percpu_ringbuf)
+        return bpf_map_lookup_elem(&percpu_events, &cpu);
+    return &events;
+}
+
+// Pick the ring buffer for the current CPU (per-CPU mode) or the shared one
+static __always_inline void *select_ringbuf(void) {
+    return cpu_ringbuf(use_percpu_ringbuf ? bpf_get_smp_processor_id() : 0);
+}
+
+// Submit flags for the configured notification policy. Everything except
+// WAKEUP_FORCE trades delivery latency for fewer irq_work + consumer wakeups.
+static __always_inline u64 submit_flags(void *rb) {
+    if (wakeup_policy == WAKEUP_FORCE)
+        return BPF_RB_FORCE_WAKEUP;
+    if (wakeup_policy == WAKEUP_ADAPTIVE)
+        return 0;
+    if (wakeup_policy == WAKEUP_NONE)
+        return BPF_RB_NO_WAKEUP;
+
+    if (wakeup_policy == WAKEUP_BATCH) {
+        u32 zero = 0;
+        u64 *count = bpf_map_lookup_elem(&wakeup_counter, &zero);
+        if (!count)
+            return BPF_RB_FORCE_WAKEUP;
+        if (++(*count) >= wakeup_batch) {
+            *count = 0;
+            return BPF_RB_FORCE_WAKEUP;
+        }
+        return BPF_RB_NO_WAKEUP;
+    }
+
+    // WAKEUP_WATERMARK
+    if (bpf_ringbuf_query(rb, BPF_RB_AVAIL_DATA) >= wakeup_watermark)
+        return BPF_RB_FORCE_WAKEUP;
+    return BPF_RB_NO_WAKEUP;
+}
+
+// Stack records handed to copy_submit(): the arena copy reads them in words
+#define copy_rec __attribute__((aligned(8)))
+
+#ifdef __BPF_FEATURE_ADDR_SPACE_CAST
+// Arena transport: copy the record into the next slot of this CPU's ring
+// and publish it by advancing head. Records are multiples of 4 bytes and
+// copy_rec aligned, so the copy is a few word stores. x86 does not reorder
+// stores, so the compiler barrier is all that keeps the slot visible before
+// the head.
+static __always_inline long arena_output(void *event, u64 size) {
+    u64 base = (u64)&arena_anchor & ~0xffffffffULL;
+    u32 cpu = bpf_get_smp_processor_id();
+    struct arena_ring __arena *r;
+    struct arena_slot __arena *slot;
+    const u32 *src = event;
+    u32 __arena *dst;
+    u64 head;
+
+    if (cpu >= MAX_CPUS || size > MAX_RECORD_SIZE)
+        return -1;
+    r = (struct arena_ring __arena *)(base + ARENA_RING_OFFSET(cpu));
+
+    // Another task on this CPU preempted mid-write: count it as a full ring
+    if (__sync_lock_test_and_set(&r->busy, 1))
+        return -1;
+    head = r->head;
+    if (head - *(volatile u64 __arena *)&r->tail >= ARENA_RING_SLOTS) {
+        r->busy = 0;
+        return -1;
+    }
+    slot = &r->slots[head & (ARENA_RING_SLOTS - 1)];
+    slot->size = size;
+    dst = (u32 __arena *)slot->data;
+    for (u32 i = 0; i < MAX_RECORD_SIZE / 4 && i < size / 4; i++)
+        dst[i] = src[i];
+    barrier();
+    r->head = head + 1;
+    r->busy = 0;
+    return 0;
+}
+#else
+// Without arena pointers the transport cannot be built; userspace checks
+// arena_built and refuses --transport=arena
+static __always_inline long arena_output(void *event, u64 size) {
+    return -1;
+}
+#endif
+
+// --stage: move a batch to its CPU's ring buffer as one record and empty
+// it. The caller holds b->lock.
+static __always_inline void stage_flush(struct stage_batch *b, u32 cpu) {
+    u32 len = b->len;
+    void *rb;
+    long err;
+
+    if (b->count) {
+        if (len > STAGE_BYTES)
+            len = STAGE_BYTES;
+        b->cpu = cpu;
+        rb = cpu_ringbuf(cpu);
+        err = rb ? bpf_ringbuf_output(rb, b, offsetof(struct stage_batch, data) + len,
+                                      submit_flags(rb)) : -1;
+        update_stat_batch(b->count, err);
+    }
+    b->count = 0;
+    b->len = 0;
+}
+
+// --stage: append the record to this CPU's batch (flushing it first if the
+// record would not fit), then flush once stage_events records are in. The
+// lock keeps out the flush timer and tasks that preempt us on this CPU; a
+// record that finds it taken is lost, like one that finds the ringbuf full.
+static __always_inline long stage_output(void *event, u64 size) {
+    u32 cpu = bpf_get_smp_processor_id();
+    const u32 *src = event;
+    struct stage_batch *b;
+    u32 zero = 0, len;
+
+    b = bpf_map_lookup_elem(&staging, &zero);
+    if (!b || size > MAX_RECORD_SIZE)
+        return -1;
+    if (__sync_lock_test_and_set(&b->lock, 1))
+        return -1;
+
+    len = b->len;
+    if (len > STAGE_BYTES - sizeof(u32) - MAX_RECORD_SIZE) {
+        stage_flush(b, cpu);
+        len = 0;
+    }
+    *(u32 *)&b->data[len] = size;
+    for (u32 i = 0; i < MAX_RECORD_SIZE / 4 && i < size / 4; i++)
+        *(u32 *)&b->data[len + sizeof(u32) + 4 * i] = src[i];
+    b->len = len + sizeof(u32) + size;
+    if (++b->count >= stage_events)
+        stage_flush(b, cpu);
+    barrier();
+    b->lock = 0;
+    return 0;
+}
+
+// --flight-recorder: overwrite the oldest slot of this CPU's buffer. The
+// fetch-and-add gives tasks that preempt each other on this CPU distinct
+// slots. seq is cleared first and set last, so a snapshot that copies the
+// slot while it is rewritten sees the change and skips it.
+static __always_inline long flight_output(void *event, u64 size) {
+    u32 cpu = bpf_get_smp_processor_id();
+    struct flight_slot *slot;
+    const u32 *src = event;
+    u32 zero = 0, key;
+    u64 *head, idx;
+
+    head = bpf_map_lookup_elem(&flight_head, &zero);
+    if (!head || size > MAX_RECORD_SIZE)
+        return -1;
+    idx = __sync_fetch_and_add(head, 1);
+    key = cpu * flight_slots + idx % flight_slots;
+    slot = bpf_map_lookup_elem(&flight, &key);
+    if (!slot)
+        return -1;
+
+    slot->seq = 0;
+    barrier();
+    slot->size = size;
+    for (u32 i = 0; i < MAX_RECORD_SIZE / 4 && i < size / 4; i++)
+        ((u32 *)slot->data)[i] = src[i];
+    barrier();
+    slot->seq = idx + 1;
+    return 0;
+}
+
+// Copying transports: the record is built on the stack, then copied into
+// this CPU's perf ring, (--rb-output) into the ringbuf with
+// bpf_ringbuf_output(), into this CPU's arena ring, or (--stage) into this
+// CPU's staging batch. All of them fail when the buffer is full. The
+// flight recorder's slots are never full: the oldest record is overwritten.
+static __always_inline int copy_transport(void) {
+    return use_perfbuf || use_ringbuf_output || use_arena || stage_events || flight_slots;
+}
+
+static __always_inline void copy_submit(void *ctx, void *event, u64 size) {
+    long err;
+
+    if (stage_events) {
+        // Sent records are counted when their batch is flushed
+        if (stage_output(event, size))
+            update_stat_reserve_failures();
+        return;
+    }
+    if (use_perfbuf) {
+        err = bpf_perf_event_output(ctx, &perf_events, BPF_F_CURRENT_CPU, event, size);
+    } else if (use_arena) {
+        err = arena_output(event, size);
+    } else if (flight_slots) {
+        err = flight_output(event, size);
+    } else {
+        void *rb = select_ringbuf();
+
+        err = rb ? bpf_ringbuf_output(rb, event, size, submit_flags(rb)) : -1;
+    }
+    if (err)
+        update_stat_reserve_failures();
+    else
+        update_stat_events_sent();
+}
+
+static __always_inline u64 log2_u32(u32 v) {
+    u32 shift, r;
+
+    r = (v > 0xFFFF) << 4; v >>= r;
+    shift = (v > 0xFF) << 3; v >>= shift; r |= shift;
+    shift = (v > 0xF) << 2; v >>= shift; r |= shift;
+    shift = (v > 0x3) << 1; v >>= shift; r |= shift;
+    r |= (v >> 1);
+    return r;
+}
+
+static __always_inline u64 log2_u64(u64 v) {
+    u32 hi = v >> 32;
+    return hi ? log2_u32(hi) + 32 : log2_u32(v);
+}
+
+// Histogram mode entry: remember when this thread entered the function
+static __always_inline void hist_record_entry(void) {
+    u64 id = bpf_get_current_pid_tgid();
+    u64 ts = now_ns();
+
+    bpf_map_update_elem(&start_ts, &id, &ts, BPF_ANY);
+}
+
+// Histogram mode exit: bucket the duration into this CPU's histogram
+static __always_inline void hist_record_exit(void) {
+    u64 id = bpf_get_current_pid_tgid();
+    u64 *tsp = bpf_map_lookup_elem(&start_ts, &id);
+    if (!tsp) {
+        update_stat_events_dropped();  // Entry not seen (attached mid-call or map full)
+        return;
+    }
+
+    u64 delta = now_ns() - *tsp;
+    bpf_map_delete_elem(&start_ts, &id);
+
+    u32 zero = 0;
+    struct latency_hist *hist = bpf_map_lookup_elem(&latency_hist, &zero);
+    if (!hist)
+        return;
+
+    u64 slot = hist_linear_step_ns ? delta / hist_linear_step_ns : log2_u64(delta);
+    if (slot >= HIST_SLOTS)
+        slot = HIST_SLOTS - 1;
+
+    // Per-CPU value: no atomics needed
+    hist->slots[slot]++;
+    hist->count++;
+    hist->sum_ns += delta;
+    update_stat_events_sent();
+}
+
+// Combined mode entry: stash the call for the exit probe, no ringbuf traffic
+static __always_inline void span_record_entry(s32 arg1, u64 arg2, u64 arg3_bits, u64 arg4) {
+    struct span_start *s;
+
+    s = bpf_task_storage_get(&span_start, bpf_get_current_task_btf(), 0,
+                             BPF_LOCAL_STORAGE_GET_F_CREATE);
+    if (!s) {
+        update_stat_events_dropped();
+        return;
+    }
+    s->arg1 = arg1;
+    s->arg2 = arg2;
+    s->arg3_bits = arg3_bits;
+    s->arg4 = arg4;
+    s->timestamp = now_ns();
+}
+
+// Combined mode exit: emit the whole call as one span record
+static __always_inline void span_record_exit(void *ctx) {
+    struct trace_event_span *event;
+    struct span_start *s;
+    void *rb;
+
+    s = bpf_task_storage_get(&span_start, bpf_get_current_task_btf(), 0, 0);
+    if (!s || !s->timestamp) {
+        update_stat_events_dropped();  // Entry not seen (attached mid-call)
+        return;
+    }
+
+    if (copy_transport()) {
+        struct trace_event_span rec copy_rec = {
+            .timestamp = s->timestamp,
+            .duration_ns = now_ns() - s->timestamp,
+            .arg1 = s->arg1,
+            .arg2 = s->arg2,
+            .arg4 = s->arg4,
+            .event_type = 2,
+        };
+
+        __builtin_memcpy(&rec.arg3, &s->arg3_bits, sizeof(s->arg3_bits));
+        s->timestamp = 0;
+        copy_submit(ctx, &rec, sizeof(rec));
+        if (flight_trigger_ns && rec.duration_ns >= flight_trigger_ns)
+            __sync_fetch_and_add(&flight_anomalies, 1);
+        return;
+    }
+
+    rb = select_ringbuf();
+    if (!rb) {
+        update_stat_reserve_failures();
+        s->timestamp = 0;
+        return;
+    }
+
+    event = bpf_ringbuf_reserve(rb, sizeof(*event), 0);
+    if (!event) {
+        update_stat_reserve_failures();
+        s->timestamp = 0;
+        return;
+    }
+
+    event->timestamp = s->timestamp;
+    event->duration_ns = now_ns() - s->timestamp;
+    event->event_type = 2;
+    event->arg1 = s->arg1;
+    event->arg2 = s->arg2;
+    __builtin_memcpy(&event->arg3, &s->arg3_bits, sizeof(s->arg3_bits));
+    event->arg4 = s->arg4;
+    s->timestamp = 0;
+
+    bpf_ringbuf_submit(event, submit_flags(rb));
+    update_stat_events_sent();
+}
+
+// Emit an entry event (or record the entry in histogram/combined mode). arg3
+// is passed as the raw bits of the double: BPF has no floating point.
+static __always_inline int emit_entry(void *ctx, s32 arg1, u64 arg2, u64 arg3_bits, u64 arg4) {
     struct trace_event_entry *event;
+    void *rb;
+
+    if (filtered_out())
+        return 0;
+    if (sample_mode != SAMPLE_ALL && !sample_entry(bpf_get_current_pid_tgid()))
+        return 0;
+    if (histogram_mode) {
+        hist_record_entry();
+        return 0;
+    }
+    if (combined_mode) {
+        span_record_entry(arg1, arg2, arg3_bits, arg4);
+        return 0;
+    }
+    if (copy_transport()) {
+        struct trace_event_entry rec copy_rec = {
+            .timestamp = now_ns(),
+            .arg1 = arg1,
+            .arg2 = arg2,
+            .arg4 = arg4,
+            .event_type = 0,
+        };
+
+        __builtin_memcpy(&rec.arg3, &arg3_bits, sizeof(arg3_bits));
+        copy_submit(ctx, &rec, sizeof(rec));
+        return 0;
+    }
+
+    rb = select_ringbuf();
+    if (!rb) {
+        update_stat_reserve_failures();
+        return 0;
+    }
 
     // Reserve smaller event structure
-    event = bpf_ringbuf_reserve(&events, sizeof(*event), 0);
+    event = bpf_ringbuf_reserve(rb, sizeof(*event), 0);
     if (!event) {
         update_stat_reserve_failures();  // STATS: Track reserve failures
         return 0;
     }
 
     // Minimal work - just capture the essentials
-    event->timestamp = bpf_ktime_get_ns();
+    event->timestamp = now_ns();
     event->event_type = 0;
+    event->arg1 = arg1;
+    event->arg2 = arg2;
+    __builtin_memcpy(&event->arg3, &arg3_bits, sizeof(arg3_bits));
+    event->arg4 = arg4;
 
-    // Capture arguments directly without extra operations
-    event->arg1 = (s32)PT_REGS_PARM1(ctx);
-    event->arg2 = PT_REGS_PARM2(ctx);
-    // arg3 is double - handled via bitcast in userspace
-    event->arg3 = 0.0;  // Placeholder - will be populated properly later
-    event->arg4 = PT_REGS_PARM4(ctx);
-
-    // Submit with BPF_RB_FORCE_WAKEUP for immediate wakeup (critical for low-latency benchmarks)
-    bpf_ringbuf_submit(event, BPF_RB_FORCE_WAKEUP);
+    // Submit with the configured wakeup policy (BPF_RB_FORCE_WAKEUP by default)
+    bpf_ringbuf_submit(event, submit_flags(rb));
     update_stat_events_sent();  // STATS: Track successful events
     return 0;
 }
 
-// Exit probe - OPTIMIZED for minimal overhead
-SEC("uretprobe/my_traced_function")
-int my_traced_function_exit(struct pt_regs *ctx) {
+static __always_inline int emit_exit(void *ctx) {
     struct trace_event_exit *event;
+    void *rb;
+
+    if (filtered_out())
+        return 0;
+    if (sample_mode != SAMPLE_ALL && !sample_exit(bpf_get_current_pid_tgid()))
+        return 0;
+    if (histogram_mode) {
+        hist_record_exit();
+        return 0;
+    }
+    if (combined_mode) {
+        span_record_exit(ctx);
+        return 0;
+    }
+    if (copy_transport()) {
+        struct trace_event_exit rec copy_rec = {
+            .timestamp = now_ns(),
+            .event_type = 1,
+        };
+
+        copy_submit(ctx, &rec, sizeof(rec));
+        return 0;
+    }
+
+    rb = select_ringbuf();
+    if (!rb) {
+        update_stat_reserve_failures();
+        return 0;
+    }
 
     // Reserve minimal event structure
-    event = bpf_ringbuf_reserve(&events, sizeof(*event), 0);
+    event = bpf_ringbuf_reserve(rb, sizeof(*event), 0);
     if (!event) {
         update_stat_reserve_failures();  // STATS: Track reserve failures
         return 0;
     }
 
-    event->timestamp = bpf_ktime_get_ns();
+    event->timestamp = now_ns();
     event->event_type = 1;
 
-    // Submit with BPF_RB_FORCE_WAKEUP for immediate wakeup (critical for low-latency benchmarks)
-    bpf_ringbuf_submit(event, BPF_RB_FORCE_WAKEUP);
+    // Submit with the configured wakeup policy (BPF_RB_FORCE_WAKEUP by default)
+    bpf_ringbuf_submit(event, submit_flags(rb));
     update_stat_events_sent();  // STATS: Track successful events
     return 0;
 }
 
+// Generic probes (--functions): every traced function gets a uprobe and a
+// uretprobe running these programs, with its index in userspace's function
+// table as the attach cookie. The entry captures all six integer argument
+// registers; userspace knows from the function's BTF which ones hold
+// arguments and how to print them.
+static __always_inline void fill_call(struct trace_event_call *e, struct pt_regs *ctx,
+                                      u32 func_id) {
+    e->timestamp = now_ns();
+    e->func_id = func_id;
+    e->regs[0] = CAPTURED(0, PT_REGS_PARM1(ctx));
+    e->regs[1] = CAPTURED(1, PT_REGS_PARM2(ctx));
+    e->regs[2] = CAPTURED(2, PT_REGS_PARM3(ctx));
+    e->regs[3] = CAPTURED(3, PT_REGS_PARM4(ctx));
+    e->regs[4] = CAPTURED(4, PT_REGS_PARM5(ctx));
+    e->regs[5] = CAPTURED(5, PT_REGS_PARM6(ctx));
+    e->event_type = 3;
+}
+
+static __always_inline void fill_return(struct trace_event_return *e, struct pt_regs *ctx,
+                                        u32 func_id) {
+    e->timestamp = now_ns();
+    e->func_id = func_id;
+    e->ret = PT_REGS_RC(ctx);
+    e->event_type = 4;
+}
+
+// Sampling key of a generic call: the thread ID (unique system-wide) and the
+// function, so nested traced calls on one thread keep their own pairing
+static __always_inline u64 call_key(u32 func_id) {
+    return ((u64)func_id << 32) | (u32)bpf_get_current_pid_tgid();
+}
+
+static __always_inline int emit_call(struct pt_regs *ctx) {
+    u32 func_id = bpf_get_attach_cookie(ctx);
+    struct trace_event_call *event;
+    void *rb;
+
+    if (filtered_out())
+        return 0;
+    if (sample_mode != SAMPLE_ALL && !sample_entry(call_key(func_id)))
+        return 0;
+    if (copy_transport()) {
+        struct trace_event_call rec copy_rec;
+
+        fill_call(&rec, ctx, func_id);
+        copy_submit(ctx, &rec, sizeof(rec));
+        return 0;
+    }
+
+    rb = select_ringbuf();
+    if (!rb) {
+        update_stat_reserve_failures();
+        return 0;
+    }
+    event = bpf_ringbuf_reserve(rb, sizeof(*event), 0);
+    if (!event) {
+        update_stat_reserve_failures();
+        return 0;
+    }
+    fill_call(event, ctx, func_id);
+    bpf_ringbuf_submit(event, submit_flags(rb));
+    update_stat_events_sent();
+    return 0;
+}
+
+static __always_inline int emit_return(struct pt_regs *ctx) {
+    u32 func_id = bpf_get_attach_cookie(ctx);
+    struct trace_event_return *event;
+    void *rb;
+
+    if (filtered_out())
+        return 0;
+    if (sample_mode != SAMPLE_ALL && !sample_exit(call_key(func_id)))
+        return 0;
+    if (copy_transport()) {
+        struct trace_event_return rec copy_rec;
+
+        fill_return(&rec, ctx, func_id);
+        copy_submit(ctx, &rec, sizeof(rec));
+        return 0;
+    }
+
+    rb = select_ringbuf();
+    if (!rb) {
+        update_stat_reserve_failures();
+        return 0;
+    }
+    event = bpf_ringbuf_reserve(rb, sizeof(*event), 0);
+    if (!event) {
+        update_stat_reserve_failures();
+        return 0;
+    }
+    fill_return(event, ctx, func_id);
+    bpf_ringbuf_submit(event, submit_flags(rb));
+    update_stat_events_sent();
+    return 0;
+}
+
+SEC("uprobe")
+int generic_entry(struct pt_regs *ctx) {
+    return emit_call(ctx);
+}
+
+SEC("uretprobe")
+int generic_exit(struct pt_regs *ctx) {
+    return emit_return(ctx);
+}
+
+// --uprobe-multi: the same probes, attached to every function through one
+// uprobe_multi link per program; the cookie still carries the table index
+SEC("uprobe.multi")
+int generic_multi_entry(struct pt_regs *ctx) {
+    return emit_call(ctx);
+}
+
+SEC("uretprobe.multi")
+int generic_multi_exit(struct pt_regs *ctx) {
+    return emit_return(ctx);
+}
+
+// Entry probe - OPTIMIZED for maximum speed
+SEC("uprobe/my_traced_function")
+int my_traced_function_entry(struct pt_regs *ctx) {
+    // The double arg3 travels in xmm0, which pt_regs does not capture, so it
+    // is reported as 0.0; it also doesn't use an integer register, which puts
+    // the pointer arg4 in the third one.
+    return emit_entry(ctx, (s32)CAPTURED(0, PT_REGS_PARM1(ctx)), CAPTURED(1, PT_REGS_PARM2(ctx)),
+                      0, CAPTURED(3, PT_REGS_PARM3(ctx)));
+}
+
+// Exit probe - OPTIMIZED for minimal overhead
+SEC("uretprobe/my_traced_function")
+int my_traced_function_exit(struct pt_regs *ctx) {
+    return emit_exit(ctx);
+}
+
+// USDT probes in the MYLIB_USDT build of libmylib (--usdt). The library passes
+// arg3 as its bit pattern because USDT arg specs can only name integer
+// registers. No uretprobe trampoline: the exit probe is a nop in the function.
+static __always_inline u64 usdt_arg(struct pt_regs *ctx, int n) {
+    long val = 0;
+
+    if (capture_args & (1U << n))
+        bpf_usdt_arg(ctx, n, &val);
+    return val;
+}
+
+SEC("usdt")
+int usdt_my_traced_function_entry(struct pt_regs *ctx) {
+    return emit_entry(ctx, (s32)usdt_arg(ctx, 0), usdt_arg(ctx, 1), usdt_arg(ctx, 2),
+                      usdt_arg(ctx, 3));
+}
+
+SEC("usdt")
+int BPF_USDT(usdt_my_traced_function_exit) {
+    return emit_exit(ctx);
+}
+
+// --stage: flush every CPU's batch. A batch a producer holds is skipped and
+// left for the next tick. Only the lock orders this against the producer
+// on the batch's CPU: the xchg is a full barrier, and the producer's
+// stores are all visible before its unlock on x86.
+static int stage_flush_cpu(u32 cpu, void *ctx) {
+    struct stage_batch *b;
+    u32 zero = 0;
+
+    b = bpf_map_lookup_percpu_elem(&staging, &zero, cpu);
+    if (!b || !b->count || __sync_lock_test_and_set(&b->lock, 1))
+        return 0;
+    stage_flush(b, cpu);
+    barrier();
+    b->lock = 0;
+    return 0;
+}
+
+static int stage_timer_fn(void *map, u32 *key, struct stage_timer *t) {
+    bpf_loop(nr_stage_cpus, stage_flush_cpu, NULL, 0);
+    bpf_timer_start(&t->timer, stage_flush_ns, 0);
+    return 0;
+}
+
+// --stage: run by userspace through BPF_PROG_RUN once the probes are loaded,
+// and after they are detached. Return 0 or a negative errno.
+SEC("syscall")
+int stage_start(void *ctx) {
+    struct stage_timer *t;
+    u32 zero = 0;
+    long err;
+
+    t = bpf_map_lookup_elem(&stage_timer, &zero);
+    if (!t)
+        return -1;
+    err = bpf_timer_init(&t->timer, &stage_timer, CLOCK_MONOTONIC);
+    if (!err)
+        err = bpf_timer_set_callback(&t->timer, stage_timer_fn);
+    if (!err)
+        err = bpf_timer_start(&t->timer, stage_flush_ns, 0);
+    return err;
+}
+
+// Stop the timer and flush what is left
+SEC("syscall")
+int stage_stop(void *ctx) {
+    struct stage_timer *t;
+    u32 zero = 0;
+
+    t = bpf_map_lookup_elem(&stage_timer, &zero);
+    if (t)
+        bpf_timer_cancel(&t->timer);
+    bpf_loop(nr_stage_cpus, stage_flush_cpu, NULL, 0);
+    return 0;
+}
+
 char LICENSE[] SEC("license") = "GPL";
@@ -1,159 +1,2233 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
 #include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <limits.h>
+#include <linux/types.h>
 #include <bpf/libbpf.h>
 #include <bpf/bpf.h>
+#include "mylib_tracer.h"
 #include "mylib_tracer.skel.h"
+#include "ctf_writer.h"
+#include "stream_writer.h"
+#include "elf_resolver.h"
+#include "event_store.h"
+#include "text_writer.h"
+#include "ringbuf_batch.h"
+#include "arena_reader.h"
+#include "flight_recorder.h"
+#include "governor.h"
+#include "func_table.h"
 
 #define MAX_STRING_LEN 64
-#define MAX_EVENTS 1000000  // Buffer up to 1M events in memory
-
-// Optimized event structures matching BPF side
-struct trace_event_entry {
-    uint64_t timestamp;
-    int32_t arg1;
-    uint64_t arg2;
-    double arg3;
-    uint64_t arg4;
-    uint32_t event_type;  // 0=entry
-} __attribute__((packed));
-
-struct trace_event_exit {
-    uint64_t timestamp;
-    uint32_t event_type;  // 1=exit
-} __attribute__((packed));
-
-// Union to store any event type
-union stored_event {
-    struct trace_event_entry entry;
-    struct trace_event_exit exit;
-    char raw[sizeof(struct trace_event_entry)];  // Max size
+#define MAX_EVENTS 1000000  // Buffer up to 1M events in memory (per consumer)
+#define LATENCY_SAMPLE_EVERY 64  // Measure delivery latency on 1 in N events (power of 2)
+#define PERF_BUFFER_PAGES 128    // Per CPU: 512 KB with 4 KB pages, like PERCPU_RINGBUF_SIZE
+// --stage: as many of the smallest record as fit in a batch
+#define STAGE_MAX_EVENTS (STAGE_BYTES / (sizeof(__u32) + sizeof(struct trace_event_exit)))
+
+// Trace file format
+enum output_format {
+    FORMAT_TEXT,  // babeltrace-like text, one line per event
+    FORMAT_CTF,   // Binary CTF directory, readable by babeltrace2
+};
+
+// Kernel -> userspace event transport
+enum transport {
+    TRANSPORT_AUTO,     // Ringbuf if the kernel has it (5.8+), else perf buffer
+    TRANSPORT_RINGBUF,  // BPF_MAP_TYPE_RINGBUF
+    TRANSPORT_PERF,     // BPF_MAP_TYPE_PERF_EVENT_ARRAY + perf_buffer
+    TRANSPORT_ARENA,    // Per-CPU rings in a BPF_MAP_TYPE_ARENA, polled (6.10+)
+};
+
+// Command-line configuration
+static struct env {
+    int percpu_rb;
+    int wakeup_policy;          // enum wakeup_policy
+    unsigned int wakeup_batch;  // WAKEUP_BATCH: events per wakeup
+    unsigned int watermark_pct; // WAKEUP_WATERMARK: ringbuf fill level (%) that triggers a wakeup
+    int drain_interval_ms;      // Poll timeout, also the periodic drain for non-forced wakeups
+    int histogram;              // Aggregate latencies in-kernel instead of streaming events
+    unsigned long hist_step_ns; // 0 = log2 buckets, else linear bucket width
+    int interval_s;             // Histogram / --stats: print every N seconds (0 = on exit only)
+    int format;                 // enum output_format
+    int stream;                 // Write continuously from a background thread
+    unsigned int chunk_kb;      // Streaming: size of each of a consumer's two chunks
+    const char *library;        // Library to attach to (NULL = search for libmylib.so)
+    int resolve_bench;          // Resolve N symbols, print timings and exit
+    int usdt;                   // Attach to the USDT probes instead of uprobe + uretprobe
+    int combined;               // One span record per call instead of entry + exit
+    int stats;                  // Print kernel-side counters every interval_s seconds
+    int format_threads;         // Post-run text formatting threads (0 = one per online CPU)
+    int batch_consume;          // Consume runs of records in place instead of per-record callbacks
+    int busy_poll;              // Spin on the ringbufs from one pinned thread instead of epoll
+    int busy_poll_cpu;          // CPU the spinning consumer is pinned to (-1 = last allowed CPU)
+    int wakeup_set;             // --wakeup was given (busy-poll otherwise implies none)
+    int transport;              // enum transport
+    unsigned int nr_tgids;      // --tgid: processes to trace (0 = all)
+    __u32 tgids[MAX_FILTER_IDS];
+    unsigned int nr_pids;       // --pid: threads to trace (0 = all)
+    __u32 pids[MAX_FILTER_IDS];
+    int sample_mode;            // enum sample_mode
+    unsigned int sample_every;  // Record 1 call in N (SAMPLE_EVERY_N / SAMPLE_RANDOM)
+    int governed;               // --budget: the governor adjusts the divisor while tracing
+    struct governor_budget budget;
+    const char *functions;      // --functions: names/patterns for the generic probes
+    const char *btf_path;       // Type information for --functions (default: from the library)
+    int uprobe_multi;           // --functions through two uprobe_multi links instead of 2 per function
+    int no_kstats;              // Compile the statistics map out of the BPF programs
+    unsigned int capture_args;  // Bit i: capture argument (register) i + 1
+    int ts_clock;               // enum ts_clock
+    int rb_output;              // bpf_ringbuf_output() from the stack instead of reserve/submit
+    unsigned int stage_events;  // --stage: records per kernel-side batch (0 = no staging)
+    unsigned int stage_flush_us; // --stage: flush timer period
+    unsigned int flight_slots;  // --flight-recorder: records kept per CPU (0 = consume everything)
+    unsigned long long flight_trigger_ns; // --flight-trigger: snapshot on a call this slow
+} env = {
+    .wakeup_policy = WAKEUP_FORCE,
+    .wakeup_batch = 64,
+    .watermark_pct = 25,
+    .drain_interval_ms = 1,
+    .chunk_kb = 1024,
+    .busy_poll_cpu = -1,
+    .sample_every = 1,
+    .capture_args = CAPTURE_ALL_ARGS,
+};
+
+// One consumer drains one ring buffer into its own event buffer.
+// Shared mode has a single consumer on the main thread; per-CPU mode runs
+// one consumer thread per CPU ringbuf so nothing is shared between them.
+struct consumer {
+    int cpu;                          // CPU whose ringbuf this drains (-1 = shared ringbuf)
+    int map_fd;                       // Inner ringbuf fd we created (-1 = owned by skeleton)
+    struct ring_buffer *rb;
+    struct ringbuf_batch *batch;      // --batch-consume: used instead of rb
+    struct perf_buffer *pb;           // Perf transport: all CPUs, held by consumer 0
+    struct arena_reader *arena;       // Arena transport: this CPU's ring
+    pthread_t thread;
+    int thread_started;
+
+    // Columnar event store - events kept in memory during tracing
+    struct event_store store;
+    unsigned long event_count;
+    unsigned long events_dropped;
+    unsigned long calls;              // Entry and span events: calls recorded
+
+    // Delivery latency (consumer clock - BPF timestamp), sampled
+    unsigned long events_seen;
+    unsigned long latency_samples;
+    unsigned long long latency_sum_ns;
+    unsigned long long latency_max_ns;
+
+    unsigned long long cpu_ns;  // Thread CPU time spent consuming
+    unsigned long long perf_lost;  // Perf transport: samples the kernel reported lost
+};
+
+// Trace file being written: a text file or a CTF directory with one stream
+// per consumer
+struct trace_output {
+    struct text_writer *text;
+    struct ctf_writer *ctf;
+};
+
+// Runs with --stats or --budget only: samples ring buffer fill levels while
+// tracing, prints the kernel counters every interval (--stats) and steps
+// the governor (--budget)
+struct stats_reporter {
+    struct mylib_tracer_bpf *skel;
+    struct consumer *consumers;
+    int nr_consumers;
+    pthread_t thread;
+    int started;
+    int stop;                   // Set by main, read with __atomic_load_n
+    double fill_peak_pct;       // Highest fill level seen on any ringbuf
+
+    // --budget: adjusts the sampling divisor every tick
+    struct governor *gov;
+    struct stats gov_prev;
+    unsigned long long gov_cpu_ns;
 };
 
-// Event buffer - store events in memory during tracing
-static union stored_event *event_buffer = NULL;
-static size_t *event_sizes = NULL;
 static volatile sig_atomic_t exiting = 0;
-static unsigned long event_count = 0;
-static unsigned long events_dropped = 0;
+static volatile sig_atomic_t snapshot_requested = 0;  // --flight-recorder: SIGUSR1
+
+// Streaming mode: consumers hand events to this instead of their store
+static struct stream_writer *stream_writer;
+
+// --functions: what the generic probes are attached to, indexed by cookie
+static struct func_table func_table;
+
+// --stage: every consumer, indexed by CPU, to unpack batches into
+static struct consumer *stage_consumers;
+static int nr_stage_consumers;
+
+static void sig_handler(int sig) {
+    exiting = 1;
+}
+
+static void snapshot_handler(int sig) {
+    snapshot_requested = 1;
+}
+
+// Get a function's uprobe (file) offset from the library's cached ELF index
+static long get_function_offset(const char *lib_path, const char *func_name) {
+    struct elf_resolver *r = elf_resolver_get(lib_path);
+
+    if (!r)
+        return -1;
+    return elf_resolver_offset(r, func_name);
+}
+
+static double elapsed_us(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+// --resolve-bench: index the library from scratch and resolve n function
+// names (cycling through its symbols if it has fewer), then report timings
+static int resolve_bench(const char *lib_path, int n) {
+    struct timespec t0, t1, t2;
+    struct elf_resolver *r;
+    const char **names;
+    long *offsets;
+    double index_us;
+    int nr_syms, found;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    r = elf_resolver_open(lib_path);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (!r) {
+        fprintf(stderr, "Failed to index %s: %s\n", lib_path, strerror(errno));
+        return 1;
+    }
+    index_us = elapsed_us(&t0, &t1);
+
+    nr_syms = elf_resolver_count(r);
+    names = calloc(n, sizeof(*names));
+    offsets = calloc(n, sizeof(*offsets));
+    if (!names || !offsets || nr_syms == 0) {
+        fprintf(stderr, "No function symbols to resolve in %s\n", lib_path);
+        free(names);
+        free(offsets);
+        elf_resolver_close(r);
+        return 1;
+    }
+    for (int i = 0; i < n; i++)
+        names[i] = elf_resolver_name(r, i % nr_syms);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    found = elf_resolver_resolve(r, names, offsets, n);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    printf("Resolved %d/%d symbols from %s: index %.1f us (%d functions), "
+           "lookup %.1f us (%.0f ns/symbol)\n",
+           found, n, lib_path, index_us, nr_syms,
+           elapsed_us(&t1, &t2), elapsed_us(&t1, &t2) * 1e3 / n);
+
+    free(names);
+    free(offsets);
+    elf_resolver_close(r);
+    return 0;
+}
+
+// When the event was submitted: its timestamp, or the end of the call for a
+// span (whose timestamp is the entry time)
+static __u64 event_submit_time(const void *data, size_t size) {
+    __u64 ts = *(const __u64 *)data;  // First field of every event type
+
+    if (size == sizeof(struct trace_event_span))
+        ts += ((const struct trace_event_span *)data)->duration_ns;
+    return ts;
+}
+
+// The userspace clock that event timestamps (--clock) are read from
+static clockid_t event_clock(void) {
+    switch (env.ts_clock) {
+    case TS_CLOCK_BOOT:   return CLOCK_BOOTTIME;
+    case TS_CLOCK_COARSE: return CLOCK_MONOTONIC_COARSE;
+    case TS_CLOCK_TAI:    return CLOCK_TAI;
+    default:              return CLOCK_MONOTONIC;
+    }
+}
+
+// Sample how long the event sat in the ring buffer, against the same clock
+// the BPF side stamped it with
+static void sample_delivery_latency(struct consumer *c, const void *data, size_t size) {
+    struct timespec now;
+    __u64 ts = event_submit_time(data, size);
+
+    clock_gettime(event_clock(), &now);
+    __u64 now_ns = (__u64)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    if (now_ns < ts)
+        return;
+
+    __u64 latency = now_ns - ts;
+    c->latency_sum_ns += latency;
+    if (latency > c->latency_max_ns)
+        c->latency_max_ns = latency;
+    c->latency_samples++;
+}
+
+// Handle event: Just store in memory buffer (FAST!)
+static int handle_event(void *ctx, void *data, size_t data_sz) {
+    struct consumer *c = ctx;
+
+    if ((c->events_seen++ & (LATENCY_SAMPLE_EVERY - 1)) == 0)
+        sample_delivery_latency(c, data, data_sz);
+    if (data_sz != sizeof(struct trace_event_exit) &&
+        data_sz != sizeof(struct trace_event_return))
+        c->calls++;
+
+    if (stream_writer) {
+        if (stream_writer_append(stream_writer, c->cpu < 0 ? 0 : c->cpu, data, data_sz))
+            c->events_dropped++;
+        else
+            c->event_count++;
+        return 0;
+    }
+
+    // Full (MAX_EVENTS), out of memory, or an unknown record: count it as dropped
+    if (event_store_append(&c->store, data, data_sz))
+        c->events_dropped++;
+    else
+        c->event_count++;
+
+    return 0;
+}
+
+// --stage: a batch of records staged on one CPU, each preceded by its size.
+// They go to that CPU's consumer, so each store stays in submit order for
+// the post-run merge even when all CPUs' batches share one ringbuf.
+static int handle_stage_batch(void *ctx, void *data, size_t data_sz) {
+    const size_t hdr = offsetof(struct stage_batch, data);
+    const struct stage_batch *b = data;
+    struct consumer *c = ctx;
+    const char *pos, *end;
+    __u32 size;
+
+    if (data_sz < hdr || b->len > data_sz - hdr)
+        return 0;
+    if (b->cpu < (__u32)nr_stage_consumers)
+        c = &stage_consumers[b->cpu];
+    pos = (const char *)b->data;
+    end = pos + b->len;
+    while ((size_t)(end - pos) >= sizeof(size)) {
+        memcpy(&size, pos, sizeof(size));
+        pos += sizeof(size);
+        if (size > (size_t)(end - pos))
+            break;
+        handle_event(c, (void *)pos, size);
+        pos += size;
+    }
+    return 0;
+}
+
+// --batch-consume: a run of committed records, read in place from the
+// ringbuf's data pages. handle_event() is inlined into the loop, so there is
+// no indirect call per record.
+static int handle_batch(void *ctx, const void *run, size_t len) {
+    const char *pos = run, *end = pos + len;
+    const void *data;
+    __u32 size;
+
+    while ((data = ringbuf_batch_next(&pos, end, &size))) {
+        if (env.stage_events)
+            handle_stage_batch(ctx, (void *)data, size);
+        else
+            handle_event(ctx, (void *)data, size);
+    }
+    return 0;
+}
+
+static int consumer_alloc(struct consumer *c, int cpu) {
+    memset(c, 0, sizeof(*c));
+    c->cpu = cpu;
+    c->map_fd = -1;
+
+    // Streaming consumers store nothing; the stream writer's chunks are it.
+    // Otherwise the store allocates chunks as events arrive.
+    event_store_init(&c->store, env.stream ? 0 : MAX_EVENTS);
+    return 0;
+}
+
+// Perf transport: perf pads each raw sample so that its u32 size header plus
+// data is a multiple of 8 bytes. Map the padded size back to the record's.
+static size_t perf_record_size(__u32 size) {
+    static const size_t sizes[] = {
+        sizeof(struct trace_event_entry),
+        sizeof(struct trace_event_exit),
+        sizeof(struct trace_event_span),
+        sizeof(struct trace_event_call),
+        sizeof(struct trace_event_return),
+    };
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (((sizes[i] + sizeof(__u32) + 7) & ~(size_t)7) - sizeof(__u32) == size)
+            return sizes[i];
+    }
+    return size;
+}
+
+// Perf transport: samples from every CPU arrive through consumer 0's perf
+// buffer and are routed to that CPU's consumer, so each store stays in
+// submit order for the post-run merge
+static void handle_perf_sample(void *ctx, int cpu, void *data, __u32 size) {
+    struct consumer *consumers = ctx;
+
+    handle_event(&consumers[cpu], data, perf_record_size(size));
+}
+
+static void handle_perf_lost(void *ctx, int cpu, __u64 cnt) {
+    struct consumer *consumers = ctx;
+
+    consumers[cpu].perf_lost += cnt;
+}
+
+// Perf wakeups are per CPU every N samples (wakeup_events); there is no
+// equivalent of the adaptive or watermark ringbuf policies
+static __u32 perf_wakeup_events(void) {
+    switch (env.wakeup_policy) {
+    case WAKEUP_BATCH: return env.wakeup_batch;
+    case WAKEUP_NONE:  return ~0U;  // Drained every --drain-interval
+    default:           return 1;
+    }
+}
+
+static int setup_perf_consumer(struct mylib_tracer_bpf *skel, struct consumer *consumers) {
+    LIBBPF_OPTS(perf_buffer_opts, opts, .sample_period = perf_wakeup_events());
+
+    consumers[0].pb = perf_buffer__new(bpf_map__fd(skel->maps.perf_events), PERF_BUFFER_PAGES,
+                                       handle_perf_sample, handle_perf_lost, consumers, &opts);
+    if (!consumers[0].pb)
+        return errno ? -errno : -EINVAL;
+    return 0;
+}
+
+// Attach the consumer to a ringbuf map. Returns 0 or a negative errno.
+static int consumer_open_ring(struct consumer *c, int map_fd) {
+    if (env.batch_consume)
+        c->batch = ringbuf_batch_new(map_fd, handle_batch, c);
+    else
+        c->rb = ring_buffer__new(map_fd, env.stage_events ? handle_stage_batch : handle_event,
+                                 c, NULL);
+    if (!c->batch && !c->rb)
+        return errno ? -errno : -EINVAL;
+    return 0;
+}
+
+static int consumer_poll(struct consumer *c, int timeout_ms) {
+    if (c->batch)
+        return ringbuf_batch_poll(c->batch, timeout_ms);
+    if (c->pb)
+        return perf_buffer__poll(c->pb, timeout_ms);
+    if (c->arena)
+        return arena_reader_poll(c->arena, timeout_ms);
+    return ring_buffer__poll(c->rb, timeout_ms);
+}
+
+// Consumers without a transport of their own (perf mode, CPUs > 0) have
+// nothing to consume
+static int consumer_consume(struct consumer *c) {
+    if (c->batch)
+        return ringbuf_batch_consume(c->batch);
+    if (c->pb)
+        return perf_buffer__consume(c->pb);
+    if (c->arena)
+        return arena_reader_consume(c->arena);
+    if (c->rb)
+        return ring_buffer__consume(c->rb);
+    return 0;
+}
+
+static void consumer_free(struct consumer *c) {
+    if (c->rb)
+        ring_buffer__free(c->rb);
+    ringbuf_batch_free(c->batch);
+    arena_reader_free(c->arena);
+    if (c->pb)
+        perf_buffer__free(c->pb);
+    if (c->map_fd >= 0)
+        close(c->map_fd);
+    event_store_free(&c->store);
+}
+
+// CPU time of the calling thread, e.g. one consumer
+static unsigned long long thread_cpu_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The whole tracer: consumers, writer and reporter threads
+static unsigned long long process_cpu_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Process events - CRITICAL: Use short timeout for low-latency benchmarks
+// With BPF_RB_FORCE_WAKEUP, events wake us immediately, but we still need
+// a short timeout to check for termination signal frequently
+static int consumer_poll_loop(struct consumer *c) {
+    // Policies that suppress notifications leave records behind without an
+    // epoll event; pick them up every drain interval
+    int periodic_drain = env.wakeup_policy == WAKEUP_NONE ||
+                         env.wakeup_policy == WAKEUP_BATCH ||
+                         env.wakeup_policy == WAKEUP_WATERMARK;
+    unsigned long long cpu_start = thread_cpu_ns();
+    int err = 0;
+
+    while (!exiting) {
+        err = consumer_poll(c, env.drain_interval_ms /* timeout, ms - reduced from 100ms for low latency */);
+        if (err == -EINTR) {
+            err = 0;
+            break;
+        }
+        if (err < 0) {
+            fprintf(stderr, "Error polling ring buffer (cpu %d): %d\n", c->cpu, err);
+            break;
+        }
+        if (err == 0 && periodic_drain) {
+            err = consumer_consume(c);
+            if (err < 0) {
+                fprintf(stderr, "Error draining ring buffer (cpu %d): %d\n", c->cpu, err);
+                break;
+            }
+        }
+    }
+
+    // Drain whatever was submitted between the last poll and the stop signal
+    consumer_consume(c);
+    c->cpu_ns = thread_cpu_ns() - cpu_start;
+    return err < 0 ? err : 0;
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+// Default --busy-poll CPU: the highest one this process may run on, which
+// is online and inside its cpuset
+static int last_allowed_cpu(void) {
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set))
+        return 0;
+    for (int cpu = CPU_SETSIZE - 1; cpu > 0; cpu--) {
+        if (CPU_ISSET(cpu, &set))
+            return cpu;
+    }
+    return 0;
+}
+
+// --busy-poll: one thread pinned to env.busy_poll_cpu consumes every ringbuf
+// in turn, never sleeping. With producers submitting BPF_RB_NO_WAKEUP the
+// traced process pays no wakeup cost at all; the price is one busy core.
+// The calling thread's affinity is restored on return.
+static int busy_poll_loop(struct consumer *consumers, int nr_consumers) {
+    unsigned long long cpu_start;
+    cpu_set_t saved, set;
+    int pinned, err = 0;
+
+    CPU_ZERO(&set);
+    CPU_SET(env.busy_poll_cpu, &set);
+    pinned = !sched_getaffinity(0, sizeof(saved), &saved) &&
+             !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (!pinned)
+        fprintf(stderr, "Warning: could not pin the consumer to CPU %d\n", env.busy_poll_cpu);
+
+    cpu_start = thread_cpu_ns();
+    while (!exiting && !err) {
+        int got = 0;
+
+        for (int i = 0; i < nr_consumers; i++) {
+            int n = consumer_consume(&consumers[i]);
+            if (n < 0) {
+                fprintf(stderr, "Error draining ring buffer (cpu %d): %d\n",
+                        consumers[i].cpu, n);
+                err = n;
+                break;
+            }
+            got += n;
+        }
+        if (!got)
+            cpu_relax();
+    }
+    for (int i = 0; i < nr_consumers; i++)
+        consumer_consume(&consumers[i]);
+    consumers[0].cpu_ns = thread_cpu_ns() - cpu_start;
+
+    if (pinned)
+        pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+    return err;
+}
+
+// Pick a CPU close to @cpu for its consumer thread: an SMT sibling when one
+// exists (shares L1/L2 with the producer without stealing its core), else
+// the producer CPU itself.
+static int nearby_cpu(int cpu) {
+    char path[128];
+    char line[256];
+    FILE *f;
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    f = fopen(path, "r");
+    if (!f) {
+        return cpu;
+    }
+
+    int sibling = cpu;
+    if (fgets(line, sizeof(line), f)) {
+        // Format is either "a,b,..." or "a-b"
+        for (char *tok = strtok(line, ",-\n"); tok; tok = strtok(NULL, ",-\n")) {
+            int candidate = atoi(tok);
+            if (candidate != cpu) {
+                sibling = candidate;
+                break;
+            }
+        }
+    }
+    fclose(f);
+    return sibling;
+}
+
+static void *consumer_thread(void *arg) {
+    struct consumer *c = arg;
+    int pin = nearby_cpu(c->cpu);
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(pin, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    return (void *)(long)consumer_poll_loop(c);
+}
+
+// Create one ringbuf per CPU, plug it into the percpu_events outer map and
+// attach a ring_buffer consumer to it.
+static int setup_percpu_consumers(struct mylib_tracer_bpf *skel,
+                                  struct consumer *consumers, int nr_cpus) {
+    int outer_fd = bpf_map__fd(skel->maps.percpu_events);
+
+    for (int cpu = 0; cpu < nr_cpus; cpu++) {
+        struct consumer *c = &consumers[cpu];
+        char name[16];
+
+        snprintf(name, sizeof(name), "events_cpu%d", cpu);
+        c->map_fd = bpf_map_create(BPF_MAP_TYPE_RINGBUF, name, 0, 0,
+                                   PERCPU_RINGBUF_SIZE, NULL);
+        if (c->map_fd < 0) {
+            int err = -errno;
+            fprintf(stderr, "Failed to create ring buffer for CPU %d: %s\n",
+                    cpu, strerror(-err));
+            return err;
+        }
+
+        __u32 key = cpu;
+        if (bpf_map_update_elem(outer_fd, &key, &c->map_fd, 0)) {
+            int err = -errno;
+            fprintf(stderr, "Failed to install ring buffer for CPU %d: %s\n",
+                    cpu, strerror(-err));
+            return err;
+        }
+
+        int err = consumer_open_ring(c, c->map_fd);
+        if (err) {
+            fprintf(stderr, "Failed to create ring buffer consumer for CPU %d: %s\n",
+                    cpu, strerror(-err));
+            return err;
+        }
+    }
+    return 0;
+}
+
+// Arena transport: one reader per CPU ring. libbpf mapped the arena at load;
+// the readers fault their rings in, which must happen before attaching.
+static int setup_arena_consumers(struct mylib_tracer_bpf *skel,
+                                 struct consumer *consumers, int nr_cpus) {
+    size_t size;
+    void *base = bpf_map__initial_value(skel->maps.arena, &size);
+
+    if (!base || size < ARENA_PAGES(nr_cpus) * ARENA_PAGE_SIZE) {
+        fprintf(stderr, "Arena is not mapped\n");
+        return -ENOMEM;
+    }
+    for (int cpu = 0; cpu < nr_cpus; cpu++) {
+        consumers[cpu].arena = arena_reader_new(base, cpu, handle_event, &consumers[cpu]);
+        if (!consumers[cpu].arena) {
+            int err = -errno;
+            fprintf(stderr, "Failed to set up the arena ring for CPU %d: %s\n",
+                    cpu, strerror(-err));
+            return err;
+        }
+    }
+    return 0;
+}
+
+// --stage: run stage_start or stage_stop, the syscall programs that manage
+// the flush timer. Returns 0 or a negative errno.
+static int run_stage_prog(struct bpf_program *prog) {
+    LIBBPF_OPTS(bpf_test_run_opts, opts);
+
+    if (bpf_prog_test_run_opts(bpf_program__fd(prog), &opts))
+        return -errno;
+    return (int)opts.retval;
+}
+
+// Sum the per-CPU copies of the latency histogram
+static int read_latency_hist(struct mylib_tracer_bpf *skel, struct latency_hist *total) {
+    int nr_cpus = libbpf_num_possible_cpus();
+    struct latency_hist *percpu;
+    __u32 zero = 0;
+    int err;
+
+    percpu = calloc(nr_cpus, sizeof(*percpu));
+    if (!percpu)
+        return -ENOMEM;
+
+    err = bpf_map_lookup_elem(bpf_map__fd(skel->maps.latency_hist), &zero, percpu);
+    if (err) {
+        err = -errno;
+        free(percpu);
+        return err;
+    }
+
+    memset(total, 0, sizeof(*total));
+    for (int cpu = 0; cpu < nr_cpus; cpu++) {
+        for (int i = 0; i < HIST_SLOTS; i++)
+            total->slots[i] += percpu[cpu].slots[i];
+        total->count += percpu[cpu].count;
+        total->sum_ns += percpu[cpu].sum_ns;
+    }
+
+    free(percpu);
+    return 0;
+}
+
+static void hist_slot_range(int slot, unsigned long long *low, unsigned long long *high) {
+    if (env.hist_step_ns) {
+        *low = (unsigned long long)slot * env.hist_step_ns;
+        *high = *low + env.hist_step_ns - 1;
+    } else {
+        *low = slot ? 1ULL << slot : 0;
+        *high = slot == 63 ? ULLONG_MAX : (1ULL << (slot + 1)) - 1;
+    }
+}
+
+// Upper bound of the bucket containing the given percentile
+static unsigned long long hist_percentile(const struct latency_hist *h, double pct) {
+    unsigned long long target = (unsigned long long)(h->count * pct / 100.0);
+    unsigned long long seen = 0, low, high = 0;
+
+    if (h->count == 0)
+        return 0;
+    for (int i = 0; i < HIST_SLOTS; i++) {
+        seen += h->slots[i];
+        hist_slot_range(i, &low, &high);
+        if (seen >= target && h->slots[i])
+            return high;
+    }
+    return high;
+}
+
+static void print_latency_hist(FILE *f, const struct latency_hist *h) {
+    int first = -1, last = -1;
+    __u64 max_count = 0;
+
+    for (int i = 0; i < HIST_SLOTS; i++) {
+        if (h->slots[i]) {
+            if (first < 0)
+                first = i;
+            last = i;
+            if (h->slots[i] > max_count)
+                max_count = h->slots[i];
+        }
+    }
+
+    fprintf(f, "%24s : %-10s distribution\n", "nsecs", "count");
+    for (int i = first; i >= 0 && i <= last; i++) {
+        unsigned long long low, high;
+        char range[48];
+        int stars = max_count ? (int)(h->slots[i] * 40 / max_count) : 0;
+
+        hist_slot_range(i, &low, &high);
+        if (env.hist_step_ns && i == HIST_SLOTS - 1)
+            snprintf(range, sizeof(range), "%llu -> ...", low);
+        else
+            snprintf(range, sizeof(range), "%llu -> %llu", low, high);
+        fprintf(f, "%24s : %-10llu |%-40.*s|\n", range, (unsigned long long)h->slots[i],
+                stars, "****************************************");
+    }
+
+    fprintf(f, "Histogram: %llu calls, avg %.1f ns, p50 <= %llu ns, p99 <= %llu ns\n",
+            (unsigned long long)h->count,
+            h->count ? (double)h->sum_ns / h->count : 0.0,
+            hist_percentile(h, 50), hist_percentile(h, 99));
+}
+
+// Sum the per-CPU copies of the kernel-side counters
+static int read_kernel_stats(struct mylib_tracer_bpf *skel, struct stats *total) {
+    int nr_cpus = libbpf_num_possible_cpus();
+    struct stats *percpu;
+    __u32 zero = 0;
+    int err;
+
+    if (env.no_kstats)
+        return -ENODATA;  // The map was never created
+    percpu = calloc(nr_cpus, sizeof(*percpu));
+    if (!percpu)
+        return -ENOMEM;
+
+    err = bpf_map_lookup_elem(bpf_map__fd(skel->maps.statistics), &zero, percpu);
+    if (err) {
+        err = -errno;
+        free(percpu);
+        return err;
+    }
+
+    memset(total, 0, sizeof(*total));
+    for (int cpu = 0; cpu < nr_cpus; cpu++) {
+        total->events_sent += percpu[cpu].events_sent;
+        total->events_dropped += percpu[cpu].events_dropped;
+        total->reserve_failures += percpu[cpu].reserve_failures;
+        total->calls_estimated += percpu[cpu].calls_estimated;
+        total->sample_failures += percpu[cpu].sample_failures;
+    }
+
+    free(percpu);
+    return 0;
+}
+
+// Fill level of the fullest ringbuf, in percent. Reads the mmapped producer
+// and consumer positions, so it costs no syscall.
+static double ringbuf_fill_pct(const struct consumer *consumers, int nr_consumers) {
+    double max = 0.0;
+
+    for (int i = 0; i < nr_consumers; i++) {
+        struct ring *r = consumers[i].rb ? ring_buffer__ring(consumers[i].rb, 0) : NULL;
+        double pct;
+
+        if (consumers[i].batch)
+            pct = ringbuf_batch_fill_pct(consumers[i].batch);
+        else if (consumers[i].arena)
+            pct = arena_reader_fill_pct(consumers[i].arena);
+        else if (r)
+            pct = 100.0 * ring__avail_data_size(r) / ring__size(r);
+        else
+            continue;
+        if (pct > max)
+            max = pct;
+    }
+    return max;
+}
+
+// Publish a governed sampling rate to the BPF side
+static int set_sample_rate(struct mylib_tracer_bpf *skel, unsigned int every) {
+    struct sample_rate rate = {
+        .every = every,
+        .threshold = (__u32)((1ULL << 32) / every),
+    };
+    __u32 zero = 0;
+
+    if (bpf_map_update_elem(bpf_map__fd(skel->maps.sample_rate), &zero, &rate, BPF_ANY))
+        return -errno;
+    return 0;
+}
+
+// One governor step over the secs since the previous one
+static void governor_step(struct stats_reporter *sr, double secs) {
+    struct governor_tick t = { .secs = secs };
+    unsigned long long cpu_ns = process_cpu_ns();
+    unsigned int old = sr->gov->divisor;
+    struct stats cur;
+
+    if (read_kernel_stats(sr->skel, &cur))
+        return;
+    t.events = cur.events_sent - sr->gov_prev.events_sent;
+    t.reserve_failures = cur.reserve_failures - sr->gov_prev.reserve_failures;
+    t.cpu_ns = cpu_ns - sr->gov_cpu_ns;
+    sr->gov_prev = cur;
+    sr->gov_cpu_ns = cpu_ns;
+
+    if (governor_update(sr->gov, &t) != old)
+        set_sample_rate(sr->skel, sr->gov->divisor);
+}
+
+static void *stats_reporter_thread(void *arg) {
+    struct stats_reporter *sr = arg;
+    struct stats prev = { 0 }, cur;
+    struct timespec last, now, gov_last;
+
+    clock_gettime(CLOCK_MONOTONIC, &last);
+    gov_last = last;
+    sr->gov_cpu_ns = process_cpu_ns();
+    while (!__atomic_load_n(&sr->stop, __ATOMIC_RELAXED)) {
+        usleep(100000);
+
+        double fill = ringbuf_fill_pct(sr->consumers, sr->nr_consumers);
+        if (fill > sr->fill_peak_pct)
+            sr->fill_peak_pct = fill;
+
+        if (sr->gov) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            governor_step(sr, elapsed_us(&gov_last, &now) / 1e6);
+            gov_last = now;
+        }
+
+        if (!env.stats)
+            continue;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double secs = elapsed_us(&last, &now) / 1e6;
+        if (secs < env.interval_s)
+            continue;
+        if (read_kernel_stats(sr->skel, &cur))
+            continue;
+
+        printf("[stats] %.0f events/s, %.0f reserve failures/s, %.0f dropped/s, "
+               "ringbuf %.1f%% full",
+               (cur.events_sent - prev.events_sent) / secs,
+               (cur.reserve_failures - prev.reserve_failures) / secs,
+               (cur.events_dropped - prev.events_dropped) / secs,
+               fill);
+        if (sr->gov)
+            printf(", sampling 1 in %u", sr->gov->divisor);
+        printf("\n");
+        prev = cur;
+        last = now;
+    }
+    return NULL;
+}
+
+static int stats_reporter_start(struct stats_reporter *sr, struct mylib_tracer_bpf *skel,
+                                struct consumer *consumers, int nr_consumers,
+                                struct governor *gov) {
+    int err;
+
+    memset(sr, 0, sizeof(*sr));
+    sr->skel = skel;
+    sr->consumers = consumers;
+    sr->nr_consumers = nr_consumers;
+    sr->gov = gov;
+
+    err = pthread_create(&sr->thread, NULL, stats_reporter_thread, sr);
+    if (err)
+        return -err;
+    sr->started = 1;
+    return 0;
+}
+
+static void stats_reporter_stop(struct stats_reporter *sr) {
+    if (!sr->started)
+        return;
+    __atomic_store_n(&sr->stop, 1, __ATOMIC_RELAXED);
+    pthread_join(sr->thread, NULL);
+    sr->started = 0;
+}
+
+// Kernel-side totals on exit: a human line and a JSON line for scripts
+static void print_kernel_stats(struct mylib_tracer_bpf *skel, const struct stats_reporter *sr) {
+    struct stats total;
+    int err;
+
+    if (env.no_kstats) {
+        printf("Kernel stats: disabled (--no-kstats)\n");
+        return;
+    }
+    err = read_kernel_stats(skel, &total);
+    if (err) {
+        fprintf(stderr, "Failed to read kernel statistics: %s\n", strerror(-err));
+        return;
+    }
+    // The peak fill is only known when the reporter sampled it
+    printf("Kernel stats: %llu sent, %llu reserve failures, %llu dropped",
+           (unsigned long long)total.events_sent,
+           (unsigned long long)total.reserve_failures,
+           (unsigned long long)total.events_dropped);
+    if (sr->skel)
+        printf(", ringbuf peak %.1f%% full", sr->fill_peak_pct);
+    printf("\n");
+    printf("Kernel stats JSON: {\"events_sent\": %llu, \"reserve_failures\": %llu, "
+           "\"events_dropped\": %llu, \"sample_failures\": %llu",
+           (unsigned long long)total.events_sent,
+           (unsigned long long)total.reserve_failures,
+           (unsigned long long)total.events_dropped,
+           (unsigned long long)total.sample_failures);
+    if (sr->skel)
+        printf(", \"ringbuf_peak_pct\": %.1f", sr->fill_peak_pct);
+    printf("}\n");
+}
+
+// With --sample, scale the recorded calls back up to an estimate of all calls.
+// Under --budget the divisor varied, so the kernel's weighted count is used
+// and the divisor shown is the final one.
+static void print_sampling(struct mylib_tracer_bpf *skel, const struct governor *gov,
+                           unsigned long long calls) {
+    unsigned long long estimated = calls * env.sample_every;
+    struct stats total = { 0 };
+
+    if (env.sample_mode == SAMPLE_ALL)
+        return;
+    if (!env.no_kstats && !read_kernel_stats(skel, &total) && gov)
+        estimated = total.calls_estimated;
+    printf("Sampling: 1 in %u calls (%s%s), %llu calls sampled, ~%llu calls estimated",
+           gov ? gov->divisor : env.sample_every, gov ? "governed, " : "",
+           env.sample_mode == SAMPLE_RANDOM ? "random" : "every Nth per CPU",
+           calls, estimated);
+    // Picked at entry but not remembered for the exit: lost, not sampled out
+    if (total.sample_failures)
+        printf(", %llu picked calls lost (sampled_calls update failed)",
+               (unsigned long long)total.sample_failures);
+    printf("\n");
+}
+
+static void print_budget(void) {
+    printf("Governor: budget");
+    if (env.budget.cpu_pct > 0)
+        printf(" %.1f%% CPU", env.budget.cpu_pct);
+    if (env.budget.cpu_pct > 0 && env.budget.events_per_s > 0)
+        printf(",");
+    if (env.budget.events_per_s > 0)
+        printf(" %.0f events/s", env.budget.events_per_s);
+}
+
+// Reaction time and how close to the budget it settled
+static void print_governor(const struct governor *g) {
+    print_budget();
+    printf(", sampling 1 in %u..%u (final %u), %lu adjustments\n",
+           g->min_divisor, g->max_divisor, g->divisor, g->adjustments);
+    printf("Governor: %lu over-budget episodes, reaction avg %.0f ms, max %.0f ms, "
+           "steady state at %.1f%% of budget\n",
+           g->episodes, g->episodes ? g->reaction_sum_ms / g->episodes : 0.0,
+           g->reaction_max_ms,
+           g->steady_ticks ? 100.0 * g->steady_load_sum / g->steady_ticks : 0.0);
+}
+
+// Histogram mode: nothing to consume, just report the in-kernel aggregate
+static int histogram_loop(struct mylib_tracer_bpf *skel, const char *output_file) {
+    struct latency_hist hist;
+    time_t last = time(NULL);
+    int err;
+
+    while (!exiting) {
+        usleep(100000);
+        if (env.interval_s > 0 && time(NULL) - last >= env.interval_s) {
+            last = time(NULL);
+            err = read_latency_hist(skel, &hist);
+            if (err)
+                return err;
+            print_latency_hist(stdout, &hist);
+            printf("\n");
+        }
+    }
+
+    err = read_latency_hist(skel, &hist);
+    if (err) {
+        fprintf(stderr, "Failed to read latency histogram: %s\n", strerror(-err));
+        return err;
+    }
+
+    printf("\nTracing stopped. Aggregated %llu calls in-kernel.\n",
+           (unsigned long long)hist.count);
+    print_latency_hist(stdout, &hist);
+    print_sampling(skel, NULL, hist.count);
+
+    if (output_file) {
+        FILE *f = fopen(output_file, "w");
+        if (!f) {
+            fprintf(stderr, "Failed to open output file: %s\n", strerror(errno));
+            return -errno;
+        }
+        print_latency_hist(f, &hist);
+        fclose(f);
+        printf("Wrote histogram to %s\n", output_file);
+    }
+    return 0;
+}
+
+// Next event of one consumer's store during the merge
+struct merge_head {
+    struct event_cursor cursor;
+    union stored_event ev;
+    size_t size;  // 0 once the store is exhausted
+    __u64 time;   // Merge key: stores are in submit order, for spans the end time
+};
+
+static void merge_head_advance(struct merge_head *h) {
+    h->size = event_cursor_next(&h->cursor, &h->ev);
+    if (h->size)
+        h->time = event_submit_time(&h->ev, h->size);
+}
+
+// In CTF mode filename is a trace directory instead of a text file
+static int trace_output_open(struct trace_output *out, const char *filename, int nr_streams) {
+    memset(out, 0, sizeof(*out));
+    if (env.format == FORMAT_CTF)
+        out->ctf = ctf_writer_open(filename, nr_streams, event_clock());
+    else
+        out->text = text_writer_open(filename);
+    if (!out->ctf && !out->text) {
+        int err = -errno;
+        fprintf(stderr, "Failed to open output %s: %s\n", filename, strerror(-err));
+        return err;
+    }
+    return 0;
+}
+
+// Text output has no streams; events land in the order they are written
+static int trace_output_write(void *ctx, int stream, const void *data, size_t size) {
+    struct trace_output *out = ctx;
+
+    if (out->ctf)
+        return ctf_writer_write_event(out->ctf, stream, data, size);
+    return text_writer_write_event(out->text, data, size);
+}
+
+static int trace_output_close(struct trace_output *out, unsigned long dropped,
+                              unsigned long long *bytes) {
+    int err = 0;
+
+    if (out->ctf) {
+        err = ctf_writer_close(out->ctf, dropped, bytes);
+    } else if (out->text) {
+        err = text_writer_close(out->text, bytes);
+    }
+    out->ctf = NULL;
+    out->text = NULL;
+    return err;
+}
+
+static void print_trace_size(unsigned long long bytes, unsigned long events,
+                             const struct timespec *start) {
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Trace size: %llu bytes (%.1f bytes/event), written in %.1f ms\n",
+           bytes, events ? (double)bytes / events : 0.0,
+           (end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6);
+}
+
+// Consumer holding the oldest pending event, or -1 once all are exhausted
+static int merge_pick(const struct merge_head *heads, int nr_heads) {
+    int best = -1;
+
+    for (int i = 0; i < nr_heads; i++) {
+        if (!heads[i].size)
+            continue;
+        if (best < 0 || heads[i].time < heads[best].time)
+            best = i;
+    }
+    return best;
+}
+
+// Move the merge forward by n events. A single store needs no merge, so its
+// cursor skips whole chunks without rebuilding events.
+static void merge_skip(struct merge_head *heads, int nr_heads, unsigned long n) {
+    if (nr_heads == 1) {
+        if (n && heads[0].size) {
+            event_cursor_skip(&heads[0].cursor, n - 1);
+            merge_head_advance(&heads[0]);
+        }
+        return;
+    }
+    while (n--) {
+        int best = merge_pick(heads, nr_heads);
+        if (best < 0)
+            return;
+        merge_head_advance(&heads[best]);
+    }
+}
+
+// Events per formatting range: a few MB of text, enough to amortize the
+// hand-off between threads
+#define FORMAT_RANGE_EVENTS (64 * 1024)
+
+// A contiguous slice of the merged event order, formatted by one worker
+struct format_range {
+    struct merge_head *heads;  // Merge state at the range's first event
+    unsigned long nr_events;
+    char *text;
+    size_t len;
+    int done;
+};
+
+// Workers claim ranges in order and format them into private buffers; the
+// calling thread writes finished ranges to the file in order. At most
+// `window` ranges are claimed ahead of the writer, which bounds memory.
+struct format_pool {
+    struct format_range *ranges;
+    unsigned int nr_ranges;
+    int nr_heads;
+    unsigned int next;     // Next range to claim
+    unsigned int written;  // Ranges written to the file
+    unsigned int window;
+    int err;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;   // A range was formatted or written
+};
+
+static int format_range(struct format_range *r, int nr_heads) {
+    size_t cap = r->nr_events * 128 + TEXT_EVENT_MAX;  // Grows for long lines
+    char *text = malloc(cap);
+    size_t len = 0;
+
+    if (!text)
+        return -ENOMEM;
+    for (unsigned long n = 0; n < r->nr_events; n++) {
+        int best = merge_pick(r->heads, nr_heads);
+        if (best < 0)
+            break;
+        if (cap - len < TEXT_EVENT_MAX) {
+            char *grown = realloc(text, cap * 2);
+            if (!grown) {
+                free(text);
+                return -ENOMEM;
+            }
+            text = grown;
+            cap *= 2;
+        }
+        len += text_format_event(text + len, &r->heads[best].ev, r->heads[best].size);
+        merge_head_advance(&r->heads[best]);
+    }
+    r->text = text;
+    r->len = len;
+    return 0;
+}
+
+static void *format_worker(void *arg) {
+    struct format_pool *p = arg;
+
+    for (;;) {
+        struct format_range *r;
+        int err;
+
+        pthread_mutex_lock(&p->lock);
+        while (!p->err && p->next < p->nr_ranges && p->next >= p->written + p->window)
+            pthread_cond_wait(&p->cond, &p->lock);
+        if (p->err || p->next >= p->nr_ranges) {
+            pthread_mutex_unlock(&p->lock);
+            return NULL;
+        }
+        r = &p->ranges[p->next++];
+        pthread_mutex_unlock(&p->lock);
+
+        err = format_range(r, p->nr_heads);
+
+        pthread_mutex_lock(&p->lock);
+        r->done = 1;
+        if (err && !p->err)
+            p->err = err;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+// Split the merged order into ranges, format them on nr_threads workers and
+// concatenate the results in order. Only the range boundaries are found
+// sequentially: a skip over chunks for one store, a merge pass without
+// formatting for several.
+static int write_text_parallel(struct text_writer *w, struct consumer *consumers,
+                               int nr_consumers, unsigned long total,
+                               unsigned int nr_threads) {
+    struct format_pool pool = {
+        .nr_ranges = (total + FORMAT_RANGE_EVENTS - 1) / FORMAT_RANGE_EVENTS,
+        .nr_heads = nr_consumers,
+        .window = nr_threads * 2,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    };
+    size_t heads_size = nr_consumers * sizeof(struct merge_head);
+    struct merge_head *heads = calloc(nr_consumers, sizeof(*heads));
+    pthread_t *threads = calloc(nr_threads, sizeof(*threads));
+    unsigned int started = 0;
+    int err = 0;
+
+    pool.ranges = calloc(pool.nr_ranges, sizeof(*pool.ranges));
+    if (!heads || !threads || !pool.ranges) {
+        err = -ENOMEM;
+        goto out;
+    }
+
+    for (int i = 0; i < nr_consumers; i++) {
+        event_cursor_init(&heads[i].cursor, &consumers[i].store);
+        merge_head_advance(&heads[i]);
+    }
+    for (unsigned int i = 0; i < pool.nr_ranges; i++) {
+        struct format_range *r = &pool.ranges[i];
+
+        r->heads = malloc(heads_size);
+        if (!r->heads) {
+            err = -ENOMEM;
+            goto out;
+        }
+        memcpy(r->heads, heads, heads_size);
+        r->nr_events = total - (unsigned long)i * FORMAT_RANGE_EVENTS;
+        if (r->nr_events > FORMAT_RANGE_EVENTS)
+            r->nr_events = FORMAT_RANGE_EVENTS;
+        if (i + 1 < pool.nr_ranges)
+            merge_skip(heads, nr_consumers, r->nr_events);
+    }
+
+    for (; started < nr_threads; started++) {
+        err = -pthread_create(&threads[started], NULL, format_worker, &pool);
+        if (err)
+            break;
+    }
+    if (!started)
+        goto out;
+    err = 0;
+
+    for (unsigned int i = 0; i < pool.nr_ranges && !err; i++) {
+        struct format_range *r = &pool.ranges[i];
+
+        pthread_mutex_lock(&pool.lock);
+        while (!r->done && !pool.err)
+            pthread_cond_wait(&pool.cond, &pool.lock);
+        err = pool.err;
+        pthread_mutex_unlock(&pool.lock);
+        if (err)
+            break;
+
+        err = text_writer_write(w, r->text, r->len);
+        free(r->text);
+        r->text = NULL;
+
+        pthread_mutex_lock(&pool.lock);
+        pool.written++;
+        if (err && !pool.err)
+            pool.err = err;
+        pthread_cond_broadcast(&pool.cond);
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+out:
+    for (unsigned int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    if (pool.ranges) {
+        for (unsigned int i = 0; i < pool.nr_ranges; i++) {
+            free(pool.ranges[i].heads);
+            free(pool.ranges[i].text);
+        }
+    }
+    free(pool.ranges);
+    free(threads);
+    free(heads);
+    return err;
+}
+
+// Threads for post-run text formatting: --format-threads, else one per
+// online CPU, never more than there are ranges
+static unsigned int format_threads(unsigned long total) {
+    unsigned long ranges = (total + FORMAT_RANGE_EVENTS - 1) / FORMAT_RANGE_EVENTS;
+    long n = env.format_threads;
+
+    if (n <= 0)
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1)
+        n = 1;
+    if ((unsigned long)n > ranges)
+        n = ranges;
+    return n;
+}
+
+// Write all buffered events to file (AFTER tracing completes).
+// Per-CPU buffers are merged by timestamp so the file stays globally ordered.
+// Text is formatted in parallel ranges; CTF packets are built sequentially.
+static void write_events_to_file(const char *filename,
+                                 struct consumer *consumers, int nr_consumers) {
+    unsigned long total = 0, dropped = 0;
+    unsigned long long bytes = 0;
+    unsigned int nr_threads = 1;
+    struct trace_output out;
+    struct timespec start;
+    struct merge_head *heads;
+    int err = 0;
+
+    for (int i = 0; i < nr_consumers; i++) {
+        total += consumers[i].event_count;
+        dropped += consumers[i].events_dropped;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (trace_output_open(&out, filename, 1))
+        return;
+
+    if (out.text) {
+        nr_threads = format_threads(total);
+        printf("Writing %lu events to %s (text, %u formatting thread%s)...\n",
+               total, filename, nr_threads, nr_threads == 1 ? "" : "s");
+    } else {
+        printf("Writing %lu events to %s (CTF)...\n", total, filename);
+    }
+
+    if (nr_threads > 1) {
+        err = write_text_parallel(out.text, consumers, nr_consumers, total, nr_threads);
+        goto out;
+    }
+
+    heads = calloc(nr_consumers, sizeof(*heads));
+    if (!heads) {
+        fprintf(stderr, "Failed to allocate merge state\n");
+        err = -ENOMEM;
+        goto out;
+    }
+    for (int i = 0; i < nr_consumers; i++) {
+        event_cursor_init(&heads[i].cursor, &consumers[i].store);
+        merge_head_advance(&heads[i]);
+    }
+
+    for (unsigned long n = 0; n < total && !err; n++) {
+        int best = merge_pick(heads, nr_consumers);
+        if (best < 0)
+            break;
+
+        err = trace_output_write(&out, 0, &heads[best].ev, heads[best].size);
+        merge_head_advance(&heads[best]);
+    }
+
+    free(heads);
+
+out:
+    {
+        int close_err = trace_output_close(&out, dropped, &bytes);
+        if (!err)
+            err = close_err;
+    }
+
+    if (err) {
+        fprintf(stderr, "Failed to write trace: %s\n", strerror(-err));
+        return;
+    }
+    printf("Wrote %lu events (%lu dropped)\n", total, dropped);
+    print_trace_size(bytes, total, &start);
+}
+
+// --flight-recorder: a snapshot record goes to its CPU's store, which keeps
+// the stores in write order for the merge
+static int flight_record(void *ctx, int cpu, void *data, size_t size) {
+    struct consumer *c = &((struct consumer *)ctx)[cpu];
+
+    if (size != sizeof(struct trace_event_exit) && size != sizeof(struct trace_event_return))
+        c->calls++;
+    if (event_store_append(&c->store, data, size))
+        c->events_dropped++;
+    else
+        c->event_count++;
+    return 0;
+}
+
+// Replace what the stores hold with a snapshot of the flight recorder
+static int flight_fill(struct flight_recorder *fr, struct consumer *consumers,
+                       int nr_consumers, const char *reason) {
+    struct flight_snapshot st;
+    int err;
+
+    for (int i = 0; i < nr_consumers; i++) {
+        struct consumer *c = &consumers[i];
+
+        event_store_free(&c->store);
+        event_store_init(&c->store, MAX_EVENTS);
+        c->event_count = c->events_dropped = c->calls = 0;
+    }
+    err = flight_recorder_snapshot(fr, flight_record, consumers, &st);
+    if (err) {
+        fprintf(stderr, "Failed to take a flight recorder snapshot: %s\n", strerror(-err));
+        return err;
+    }
+    printf("Snapshot (%s): %lu events, %lu skipped (being rewritten), %llu older ones overwritten\n",
+           reason, st.records, st.skipped, st.older);
+    return 0;
+}
+
+// --flight-recorder: there is nothing to consume while tracing. Write a
+// snapshot to output_file.N on SIGUSR1 or when the probes count a new
+// anomaly (--flight-trigger); the exit snapshot is taken by main.
+static int flight_loop(struct mylib_tracer_bpf *skel, struct flight_recorder *fr,
+                       struct consumer *consumers, int nr_consumers, const char *output_file) {
+    unsigned long long cpu_start = thread_cpu_ns();
+    __u64 anomalies, anomalies_seen = 0;
+    unsigned int nr_snapshots = 0;
+    char path[PATH_MAX];
+    int err = 0;
+
+    while (!exiting) {
+        usleep(100000);  // Cut short by SIGUSR1
+
+        anomalies = __atomic_load_n(&skel->bss->flight_anomalies, __ATOMIC_RELAXED);
+        if (!snapshot_requested && anomalies == anomalies_seen)
+            continue;
+        const char *reason = snapshot_requested ? "SIGUSR1" : "anomaly";
+        snapshot_requested = 0;
+        anomalies_seen = anomalies;
+
+        err = flight_fill(fr, consumers, nr_consumers, reason);
+        if (err)
+            break;
+        snprintf(path, sizeof(path), "%s.%u", output_file, ++nr_snapshots);
+        write_events_to_file(path, consumers, nr_consumers);
+    }
+    consumers[0].cpu_ns = thread_cpu_ns() - cpu_start;
+    if (nr_snapshots)
+        printf("Flight recorder: %u snapshot(s) written while tracing\n", nr_snapshots);
+    return err;
+}
+
+// Find library path - try multiple locations
+static const char* find_library() {
+    // The MYLIB_USDT build of the library, installed next to the plain one
+    static const char* usdt_locations[] = {
+        "../lib/usdt/libmylib.so",            // CMake build from bin/
+        "./lib/usdt/libmylib.so",             // CMake build from build/
+        "./build/lib/usdt/libmylib.so",       // CMake build from project root
+        "../build/lib/usdt/libmylib.so",      // CMake build from subdir
+        NULL
+    };
+    static const char* locations[] = {
+        "../lib/libmylib.so",                 // CMake build from bin/
+        "./lib/libmylib.so",                   // CMake build from build/
+        "./build/lib/libmylib.so",             // CMake build from project root
+        "../build/lib/libmylib.so",            // CMake build from subdir
+        "./build/lib/libmylib.so.1.0",         // CMake versioned lib from root
+        "../sample_library/libmylib.so",       // Makefile build from subdir
+        "./sample_library/libmylib.so",        // Makefile build from root
+        NULL
+    };
+
+    if (env.usdt) {
+        for (int i = 0; usdt_locations[i] != NULL; i++) {
+            if (access(usdt_locations[i], F_OK) == 0) {
+                return usdt_locations[i];
+            }
+        }
+        return NULL;
+    }
+
+    for (int i = 0; locations[i] != NULL; i++) {
+        if (access(locations[i], F_OK) == 0) {
+            return locations[i];
+        }
+    }
+    return NULL;
+}
+
+// Per-function uprobes hold a perf event fd each; make room for them
+static void raise_fd_limit(rlim_t needed) {
+    struct rlimit rl;
 
-static void sig_handler(int sig) {
-    exiting = 1;
+    if (getrlimit(RLIMIT_NOFILE, &rl) || rl.rlim_cur >= needed)
+        return;
+    rl.rlim_cur = needed < rl.rlim_max ? needed : rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
 }
 
-// Get function offset in library using nm
-static long get_function_offset(const char *lib_path, const char *func_name) {
-    char cmd[512];
-    FILE *fp;
-    char line[256];
-    long offset = -1;
+// --functions: a uprobe and a uretprobe per function, all running the
+// generic programs, with the function's table index as the cookie
+static int attach_functions(struct mylib_tracer_bpf *skel, const char *lib_path,
+                            struct bpf_link ***links, unsigned int *nr_links) {
+    *links = calloc(2 * func_table.nr, sizeof(**links));
+    if (!*links)
+        return -ENOMEM;
+    *nr_links = 2 * func_table.nr;
+    raise_fd_limit(2 * func_table.nr + 256);
 
-    snprintf(cmd, sizeof(cmd), "nm -D %s | grep ' T %s$'", lib_path, func_name);
-    fp = popen(cmd, "r");
-    if (!fp) {
-        return -1;
+    for (unsigned int i = 0; i < func_table.nr; i++) {
+        const struct func_layout *f = &func_table.funcs[i];
+        LIBBPF_OPTS(bpf_uprobe_opts, entry_opts, .bpf_cookie = i);
+        LIBBPF_OPTS(bpf_uprobe_opts, exit_opts, .bpf_cookie = i, .retprobe = true);
+
+        (*links)[2 * i] = bpf_program__attach_uprobe_opts(skel->progs.generic_entry, -1,
+                                                          lib_path, f->offset, &entry_opts);
+        if (!(*links)[2 * i]) {
+            int err = -errno;
+            fprintf(stderr, "Failed to attach entry uprobe to %s: %s\n",
+                    f->name, strerror(-err));
+            return err;
+        }
+        (*links)[2 * i + 1] = bpf_program__attach_uprobe_opts(skel->progs.generic_exit, -1,
+                                                              lib_path, f->offset, &exit_opts);
+        if (!(*links)[2 * i + 1]) {
+            int err = -errno;
+            fprintf(stderr, "Failed to attach exit uprobe to %s: %s\n",
+                    f->name, strerror(-err));
+            return err;
+        }
     }
+    return 0;
+}
+
+// --functions --uprobe-multi: one link per program covering every offset,
+// created with a single syscall; cookies[i] is again the table index
+static int attach_functions_multi(struct mylib_tracer_bpf *skel, const char *lib_path,
+                                  struct bpf_link ***links, unsigned int *nr_links) {
+    unsigned long *offsets = calloc(func_table.nr, sizeof(*offsets));
+    __u64 *cookies = calloc(func_table.nr, sizeof(*cookies));
+    int err = 0;
 
-    if (fgets(line, sizeof(line), fp)) {
-        offset = strtol(line, NULL, 16);
+    *links = calloc(2, sizeof(**links));
+    if (!offsets || !cookies || !*links) {
+        err = -ENOMEM;
+        goto out;
     }
+    *nr_links = 2;
+    for (unsigned int i = 0; i < func_table.nr; i++) {
+        offsets[i] = func_table.funcs[i].offset;
+        cookies[i] = i;
+    }
+
+    LIBBPF_OPTS(bpf_uprobe_multi_opts, entry_opts,
+                .offsets = offsets, .cookies = cookies, .cnt = func_table.nr);
+    LIBBPF_OPTS(bpf_uprobe_multi_opts, exit_opts,
+                .offsets = offsets, .cookies = cookies, .cnt = func_table.nr,
+                .retprobe = true);
 
-    pclose(fp);
-    return offset;
+    (*links)[0] = bpf_program__attach_uprobe_multi(skel->progs.generic_multi_entry, -1,
+                                                   lib_path, NULL, &entry_opts);
+    if (!(*links)[0]) {
+        err = -errno;
+        fprintf(stderr, "Failed to attach uprobe_multi entry link: %s\n", strerror(-err));
+        goto out;
+    }
+    (*links)[1] = bpf_program__attach_uprobe_multi(skel->progs.generic_multi_exit, -1,
+                                                   lib_path, NULL, &exit_opts);
+    if (!(*links)[1]) {
+        err = -errno;
+        fprintf(stderr, "Failed to attach uprobe_multi exit link: %s\n", strerror(-err));
+    }
+out:
+    free(offsets);
+    free(cookies);
+    return err;
 }
 
-// Handle event: Just store in memory buffer (FAST!)
-static int handle_event(void *ctx, void *data, size_t data_sz) {
-    // Check if buffer is full
-    if (event_count >= MAX_EVENTS) {
-        events_dropped++;
-        return 0;
+// Destroy probe links, NULLing them; returns the time taken in microseconds
+static double detach_links(struct bpf_link **links, unsigned int nr) {
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned int i = 0; i < nr; i++) {
+        if (links[i]) {
+            bpf_link__destroy(links[i]);
+            links[i] = NULL;
+        }
     }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return elapsed_us(&start, &end);
+}
 
-    // Copy event to buffer
-    memcpy(&event_buffer[event_count], data, data_sz);
-    event_sizes[event_count] = data_sz;
-    event_count++;
+// Attach to the mylib:my_traced_function_{entry,exit} USDT probes. libbpf
+// finds them in .note.stapsdt and bumps their semaphores while attached.
+static int attach_usdt_probes(struct mylib_tracer_bpf *skel, const char *lib_path,
+                              struct bpf_link **entry, struct bpf_link **exit) {
+    *entry = bpf_program__attach_usdt(skel->progs.usdt_my_traced_function_entry,
+                                      -1 /* any process */, lib_path,
+                                      "mylib", "my_traced_function_entry", NULL);
+    if (!*entry) {
+        int err = -errno;
+        fprintf(stderr, "Failed to attach entry USDT probe: %s\n", strerror(-err));
+        if (err == -ENOENT)
+            fprintf(stderr, "%s has no USDT probes; use the lib/usdt/ build of libmylib\n",
+                    lib_path);
+        return err;
+    }
 
+    *exit = bpf_program__attach_usdt(skel->progs.usdt_my_traced_function_exit,
+                                     -1 /* any process */, lib_path,
+                                     "mylib", "my_traced_function_exit", NULL);
+    if (!*exit) {
+        int err = -errno;
+        fprintf(stderr, "Failed to attach exit USDT probe: %s\n", strerror(-err));
+        return err;
+    }
     return 0;
 }
 
-// Write all buffered events to file (AFTER tracing completes)
-static void write_events_to_file(const char *filename) {
-    FILE *f = fopen(filename, "w");
-    if (!f) {
-        fprintf(stderr, "Failed to open output file: %s\n", strerror(errno));
-        return;
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] [output_file]\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -P, --percpu-rb    One ring buffer and one pinned consumer thread per CPU\n");
+    fprintf(stderr, "  -w, --wakeup=POLICY\n");
+    fprintf(stderr, "                     Ring buffer notification policy (default: force):\n");
+    fprintf(stderr, "                       force         wake the consumer on every event\n");
+    fprintf(stderr, "                       adaptive      kernel default, wake only if consumer caught up\n");
+    fprintf(stderr, "                       none          never wake, drain every --drain-interval\n");
+    fprintf(stderr, "                       batch[:N]     wake every N events per CPU (default 64)\n");
+    fprintf(stderr, "                       watermark[:P] wake once the ringbuf is P%% full (default 25)\n");
+    fprintf(stderr, "  -T, --transport=auto|ringbuf|perf|arena\n");
+    fprintf(stderr, "                     Event transport (default: auto, ringbuf if the kernel has it)\n");
+    fprintf(stderr, "                     perf uses a per-CPU perf buffer; force/batch/none wakeups only\n");
+    fprintf(stderr, "                     arena: per-CPU rings in a BPF arena, polled without wakeups\n");
+    fprintf(stderr, "                     (experimental, Linux 6.10+ and clang 18+)\n");
+    fprintf(stderr, "  -B, --batch-consume\n");
+    fprintf(stderr, "                     Read runs of records in place from the mmapped ringbuf,\n");
+    fprintf(stderr, "                     one callback and one consumer update per run\n");
+    fprintf(stderr, "  -b, --busy-poll[=CPU]\n");
+    fprintf(stderr, "                     Spin on the ringbufs from one thread pinned to CPU (default:\n");
+    fprintf(stderr, "                     last CPU in the tracer's affinity mask) instead of sleeping;\n");
+    fprintf(stderr, "                     implies --wakeup=none\n");
+    fprintf(stderr, "  -d, --drain-interval=MS\n");
+    fprintf(stderr, "                     Poll timeout / periodic drain interval (default: 1)\n");
+    fprintf(stderr, "  -H, --histogram[=log2|linear:STEP_NS]\n");
+    fprintf(stderr, "                     Aggregate call latency in-kernel, no per-event traffic\n");
+    fprintf(stderr, "  -i, --interval=SEC Print the histogram (or --stats) every SEC seconds\n");
+    fprintf(stderr, "  -s, --stats        Print kernel-side events/s, reserve failures/s and ringbuf\n");
+    fprintf(stderr, "                     fill level every --interval seconds (default: 1)\n");
+    fprintf(stderr, "  -f, --format=FMT   Trace file format: text (default) or ctf\n");
+    fprintf(stderr, "                     ctf writes a babeltrace2-readable directory\n");
+    fprintf(stderr, "  -S, --stream       Write continuously from a background thread instead of\n");
+    fprintf(stderr, "                     buffering %d events; memory stays constant\n", MAX_EVENTS);
+    fprintf(stderr, "  -C, --chunk-size=KB\n");
+    fprintf(stderr, "                     Streaming: size of each double-buffered chunk (default: 1024)\n");
+    fprintf(stderr, "  -j, --format-threads=N\n");
+    fprintf(stderr, "                     Threads formatting the text trace after the run\n");
+    fprintf(stderr, "                     (default: one per online CPU, 1 = sequential)\n");
+    fprintf(stderr, "  -n, --sample=N|random:N\n");
+    fprintf(stderr, "                     Record 1 call in N in-kernel: every Nth call per CPU, or at\n");
+    fprintf(stderr, "                     random with probability 1/N; entry and exit stay paired\n");
+    fprintf(stderr, "  -g, --budget=cpu=PCT,events=N\n");
+    fprintf(stderr, "                     Keep the tracer under PCT%% of one core and/or N events/s\n");
+    fprintf(stderr, "                     by adjusting the --sample divisor every 100 ms\n");
+    fprintf(stderr, "  -t, --tgid=LIST    Trace only these processes (comma-separated, up to %d)\n",
+            MAX_FILTER_IDS);
+    fprintf(stderr, "  -p, --pid=LIST     Trace only these threads (comma-separated, up to %d)\n",
+            MAX_FILTER_IDS);
+    fprintf(stderr, "  -L, --library=PATH Library to attach to (default: search for libmylib.so)\n");
+    fprintf(stderr, "  -U, --usdt         Attach to the library's USDT probes (lib/usdt/ build)\n");
+    fprintf(stderr, "                     instead of uprobe + uretprobe; captures the double arg3\n");
+    fprintf(stderr, "  -F, --functions=LIST\n");
+    fprintf(stderr, "                     Trace these functions (comma-separated names or glob\n");
+    fprintf(stderr, "                     patterns) with generic probes; arguments are decoded\n");
+    fprintf(stderr, "                     from BTF type information (see --btf)\n");
+    fprintf(stderr, "  -Y, --btf=PATH     BTF for --functions (default: the library's .BTF section,\n");
+    fprintf(stderr, "                     then <library>.btf, as written by pahole)\n");
+    fprintf(stderr, "  -M, --uprobe-multi Attach --functions with two uprobe_multi links instead of\n");
+    fprintf(stderr, "                     a uprobe and a uretprobe per function (Linux 6.6+)\n");
+    fprintf(stderr, "  -k, --no-kstats    Leave the kernel-side counters out of the BPF programs\n");
+    fprintf(stderr, "  -a, --args=all|none|LIST\n");
+    fprintf(stderr, "                     Arguments to capture, e.g. 1,2 (default: all); with\n");
+    fprintf(stderr, "                     --functions, the Nth integer argument register\n");
+    fprintf(stderr, "  -K, --clock=mono|boot|coarse|tai\n");
+    fprintf(stderr, "                     Event timestamp source (default: mono)\n");
+    fprintf(stderr, "  -O, --rb-output    Build records on the BPF stack and copy them with\n");
+    fprintf(stderr, "                     bpf_ringbuf_output() instead of reserve/submit\n");
+    fprintf(stderr, "  -G, --stage[=N[:US]]\n");
+    fprintf(stderr, "                     Stage records in per-CPU kernel buffers and move them to\n");
+    fprintf(stderr, "                     the ringbuf N at a time (default %d, at most %zu), or\n",
+            STAGE_DEFAULT_EVENTS, STAGE_MAX_EVENTS);
+    fprintf(stderr, "                     every US microseconds (default %d); Linux 5.19+\n",
+            STAGE_DEFAULT_FLUSH_US);
+    fprintf(stderr, "  -r, --flight-recorder[=N]\n");
+    fprintf(stderr, "                     Keep only the last N events per CPU (default %d) in\n",
+            FLIGHT_DEFAULT_SLOTS);
+    fprintf(stderr, "                     overwritten kernel buffers; nothing is consumed. Write them\n");
+    fprintf(stderr, "                     on exit, and to output_file.1, .2, ... on SIGUSR1\n");
+    fprintf(stderr, "  -X, --flight-trigger=US\n");
+    fprintf(stderr, "                     Also snapshot when a call takes US microseconds or more\n");
+    fprintf(stderr, "                     (needs --flight-recorder and --combined)\n");
+    fprintf(stderr, "  -c, --combined     One record per call (entry time, duration, args) emitted\n");
+    fprintf(stderr, "                     at exit, instead of separate entry and exit events\n");
+    fprintf(stderr, "  -R, --resolve-bench=N\n");
+    fprintf(stderr, "                     Resolve N function symbols in the library, print timings, exit\n");
+    fprintf(stderr, "  -h, --help         Show this help\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "By default, traces events in memory only (no file output).\n");
+    fprintf(stderr, "To write trace to file:\n");
+    fprintf(stderr, "  1. Specify output_file on command line, OR\n");
+    fprintf(stderr, "  2. Set EBPF_TRACE_WRITE_FILE=1 environment variable\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Examples:\n");
+    fprintf(stderr, "  %s /tmp/trace.txt          # Write to file (command line)\n", prog);
+    fprintf(stderr, "  EBPF_TRACE_WRITE_FILE=1 %s /tmp/trace.txt  # Write to file (env var)\n", prog);
+    fprintf(stderr, "  %s                         # No file output (benchmark mode)\n", prog);
+    fprintf(stderr, "  %s --percpu-rb             # Per-CPU ring buffers (many-core hosts)\n", prog);
+    fprintf(stderr, "  %s --wakeup=batch:128      # Amortize wakeups over 128 events\n", prog);
+    fprintf(stderr, "  %s --histogram -i 1        # Latency distribution, printed every second\n", prog);
+    fprintf(stderr, "  %s --stats -i 5            # Kernel-side throughput and loss every 5 s\n", prog);
+    fprintf(stderr, "  %s -f ctf /tmp/ebpf_ctf    # Binary CTF trace (babeltrace2 /tmp/ebpf_ctf)\n", prog);
+    fprintf(stderr, "  %s -S -P -f ctf /tmp/ebpf_ctf  # Unbounded capture, one CTF stream per CPU\n", prog);
+    fprintf(stderr, "  %s -L /lib/x86_64-linux-gnu/libc.so.6 -R 1000  # Symbol resolution cost\n", prog);
+    fprintf(stderr, "  %s --usdt /tmp/trace.txt   # USDT probes (run the app with LD_LIBRARY_PATH=lib/usdt)\n", prog);
+    fprintf(stderr, "  %s --combined /tmp/trace.txt  # One span per call, half the ringbuf traffic\n", prog);
+    fprintf(stderr, "  %s --stage=64              # One ringbuf record per 64 events per CPU\n", prog);
+    fprintf(stderr, "  %s -r -c -X 500 /tmp/fr.txt  # Last 4096 calls per CPU, dumped on a 500 us call\n", prog);
+    fprintf(stderr, "  %s --budget=cpu=2 --stats  # Sample as needed to stay under 2%% CPU\n", prog);
+    fprintf(stderr, "  %s -F 'my_*,set_*' /tmp/trace.txt  # Every matching function, typed arguments\n", prog);
+}
+
+// Comma-separated list of IDs for --pid / --tgid
+static int parse_id_list(const char *arg, __u32 *ids, unsigned int *nr) {
+    const char *p = arg;
+
+    while (*p) {
+        char *end;
+        unsigned long id = strtoul(p, &end, 10);
+
+        if (end == p || id == 0 || id > 0xffffffffUL || (*end && *end != ','))
+            return -EINVAL;
+        if (*nr >= MAX_FILTER_IDS)
+            return -E2BIG;
+        ids[(*nr)++] = id;
+        p = *end ? end + 1 : end;
     }
+    return *nr ? 0 : -EINVAL;
+}
+
+static void print_id_list(const char *what, const __u32 *ids, unsigned int nr) {
+    printf("%s", what);
+    for (unsigned int i = 0; i < nr; i++)
+        printf("%s%u", i ? "," : " ", ids[i]);
+}
+
+// N or random:N
+static int parse_sample(const char *arg) {
+    char *end;
+
+    if (!strncmp(arg, "random:", 7)) {
+        env.sample_mode = SAMPLE_RANDOM;
+        arg += 7;
+    } else {
+        env.sample_mode = SAMPLE_EVERY_N;
+    }
+    env.sample_every = strtoul(arg, &end, 10);
+    if (end == arg || *end || env.sample_every == 0)
+        return -EINVAL;
+    if (env.sample_every == 1)
+        env.sample_mode = SAMPLE_ALL;
+    return 0;
+}
 
-    printf("Writing %lu events to %s...\n", event_count, filename);
+// cpu=PCT and/or events=N, comma-separated
+static int parse_budget(const char *arg) {
+    const char *p = arg;
 
-    for (unsigned long i = 0; i < event_count; i++) {
-        if (event_sizes[i] == sizeof(struct trace_event_entry)) {
-            const struct trace_event_entry *e = &event_buffer[i].entry;
-            fprintf(f,
-                    "[%lu.%09lu] mylib:my_traced_function_entry: "
-                    "{ arg1 = %d, arg2 = %lu, arg3 = %f, arg4 = 0x%lx }\n",
-                    e->timestamp / 1000000000,
-                    e->timestamp % 1000000000,
-                    e->arg1,
-                    e->arg2,
-                    e->arg3,
-                    e->arg4);
-        } else if (event_sizes[i] == sizeof(struct trace_event_exit)) {
-            const struct trace_event_exit *e = &event_buffer[i].exit;
-            fprintf(f,
-                    "[%lu.%09lu] mylib:my_traced_function_exit\n",
-                    e->timestamp / 1000000000,
-                    e->timestamp % 1000000000);
+    while (*p) {
+        double *limit;
+        char *end;
+
+        if (!strncmp(p, "cpu=", 4)) {
+            limit = &env.budget.cpu_pct;
+            p += 4;
+        } else if (!strncmp(p, "events=", 7)) {
+            limit = &env.budget.events_per_s;
+            p += 7;
+        } else {
+            return -EINVAL;
         }
+        *limit = strtod(p, &end);
+        if (end == p || *limit <= 0 || (*end && *end != ','))
+            return -EINVAL;
+        p = *end ? end + 1 : end;
     }
+    env.governed = 1;
+    return env.budget.cpu_pct > 0 || env.budget.events_per_s > 0 ? 0 : -EINVAL;
+}
 
-    fclose(f);
-    printf("Wrote %lu events (%lu dropped)\n", event_count, events_dropped);
+// --flight-recorder[=N]: records kept per CPU
+static int parse_flight_slots(const char *arg) {
+    char *end;
+
+    env.flight_slots = FLIGHT_DEFAULT_SLOTS;
+    if (!arg)
+        return 0;
+    env.flight_slots = strtoul(arg, &end, 10);
+    if (end == arg || *end || env.flight_slots == 0 || env.flight_slots > FLIGHT_MAX_SLOTS)
+        return -EINVAL;
+    return 0;
 }
 
-// Find library path - try multiple locations
-static const char* find_library() {
-    static const char* locations[] = {
-        "../lib/libmylib.so",                 // CMake build from bin/
-        "./lib/libmylib.so",                   // CMake build from build/
-        "./build/lib/libmylib.so",             // CMake build from project root
-        "../build/lib/libmylib.so",            // CMake build from subdir
-        "./build/lib/libmylib.so.1.0",         // CMake versioned lib from root
-        "../sample_library/libmylib.so",       // Makefile build from subdir
-        "./sample_library/libmylib.so",        // Makefile build from root
-        NULL
-    };
+// N[:US]: records per batch, flush timer period
+static int parse_stage(const char *arg) {
+    char *end;
 
-    for (int i = 0; locations[i] != NULL; i++) {
-        if (access(locations[i], F_OK) == 0) {
-            return locations[i];
+    env.stage_events = STAGE_DEFAULT_EVENTS;
+    env.stage_flush_us = STAGE_DEFAULT_FLUSH_US;
+    if (!arg)
+        return 0;
+    env.stage_events = strtoul(arg, &end, 10);
+    if (end == arg || env.stage_events == 0 || env.stage_events > STAGE_MAX_EVENTS)
+        return -EINVAL;
+    if (*end == ':') {
+        arg = end + 1;
+        env.stage_flush_us = strtoul(arg, &end, 10);
+        if (end == arg || env.stage_flush_us == 0)
+            return -EINVAL;
+    }
+    return *end ? -EINVAL : 0;
+}
+
+static int parse_histogram(const char *arg) {
+    env.histogram = 1;
+    if (!arg || !strcmp(arg, "log2")) {
+        env.hist_step_ns = 0;
+    } else if (!strncmp(arg, "linear:", 7)) {
+        env.hist_step_ns = strtoul(arg + 7, NULL, 10);
+        if (env.hist_step_ns == 0)
+            return -EINVAL;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int parse_wakeup_policy(const char *arg) {
+    const char *param = strchr(arg, ':');
+    size_t len = param ? (size_t)(param - arg) : strlen(arg);
+
+    if (len == 5 && !strncmp(arg, "force", len)) {
+        env.wakeup_policy = WAKEUP_FORCE;
+    } else if (len == 8 && !strncmp(arg, "adaptive", len)) {
+        env.wakeup_policy = WAKEUP_ADAPTIVE;
+    } else if (len == 4 && !strncmp(arg, "none", len)) {
+        env.wakeup_policy = WAKEUP_NONE;
+    } else if (len == 5 && !strncmp(arg, "batch", len)) {
+        env.wakeup_policy = WAKEUP_BATCH;
+        if (param)
+            env.wakeup_batch = strtoul(param + 1, NULL, 10);
+        if (env.wakeup_batch == 0)
+            return -EINVAL;
+    } else if (len == 9 && !strncmp(arg, "watermark", len)) {
+        env.wakeup_policy = WAKEUP_WATERMARK;
+        if (param)
+            env.watermark_pct = strtoul(param + 1, NULL, 10);
+        if (env.watermark_pct == 0 || env.watermark_pct > 100)
+            return -EINVAL;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+// all, none, or a comma-separated list of argument numbers (1-based)
+static int parse_args(const char *arg) {
+    const char *p = arg;
+
+    if (!strcmp(arg, "all")) {
+        env.capture_args = CAPTURE_ALL_ARGS;
+        return 0;
+    }
+    env.capture_args = 0;
+    if (!strcmp(arg, "none"))
+        return 0;
+    while (*p) {
+        char *end;
+        unsigned long n = strtoul(p, &end, 10);
+
+        if (end == p || n < 1 || n > CALL_REGS || (*end && *end != ','))
+            return -EINVAL;
+        env.capture_args |= 1U << (n - 1);
+        p = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+static const char *const ts_clock_names[] = {
+    [TS_CLOCK_MONO] = "mono",
+    [TS_CLOCK_BOOT] = "boot",
+    [TS_CLOCK_COARSE] = "coarse",
+    [TS_CLOCK_TAI] = "tai",
+};
+
+static int parse_clock(const char *arg) {
+    for (int i = 0; i < (int)(sizeof(ts_clock_names) / sizeof(ts_clock_names[0])); i++) {
+        if (!strcmp(arg, ts_clock_names[i])) {
+            env.ts_clock = i;
+            return 0;
         }
     }
-    return NULL;
+    return -EINVAL;
+}
+
+static void print_capture_args(void) {
+    if (env.capture_args == CAPTURE_ALL_ARGS) {
+        printf("all");
+        return;
+    }
+    if (!env.capture_args) {
+        printf("none");
+        return;
+    }
+    for (int i = 0, first = 1; i < CALL_REGS; i++) {
+        if (env.capture_args & (1U << i)) {
+            printf("%s%d", first ? "" : ",", i + 1);
+            first = 0;
+        }
+    }
+}
+
+static const char *wakeup_policy_name(int policy) {
+    switch (policy) {
+    case WAKEUP_FORCE:     return "force";
+    case WAKEUP_ADAPTIVE:  return "adaptive";
+    case WAKEUP_NONE:      return "none";
+    case WAKEUP_BATCH:     return "batch";
+    case WAKEUP_WATERMARK: return "watermark";
+    default:               return "unknown";
+    }
 }
 
 int main(int argc, char **argv) {
-    struct mylib_tracer_bpf *skel;
-    struct ring_buffer *rb = NULL;
+    struct mylib_tracer_bpf *skel = NULL;
+    struct consumer *consumers = NULL;
+    int nr_consumers = 0;
     int err;
     const char *lib_path;
     const char *func_name = "my_traced_function";
     long func_offset;
     struct bpf_link *link_entry = NULL;
     struct bpf_link *link_exit = NULL;
+    struct bpf_link **func_links = NULL;
+    unsigned int nr_func_links = 0;
 
     const char *output_file = NULL;
+    struct trace_output stream_out = { 0 };
+    struct stats_reporter reporter = { 0 };
+    struct flight_recorder *fr = NULL;
+    struct governor gov;
+
+    static const struct option long_opts[] = {
+        { "percpu-rb",      no_argument,       NULL, 'P' },
+        { "wakeup",         required_argument, NULL, 'w' },
+        { "transport",      required_argument, NULL, 'T' },
+        { "batch-consume",  no_argument,       NULL, 'B' },
+        { "busy-poll",      optional_argument, NULL, 'b' },
+        { "drain-interval", required_argument, NULL, 'd' },
+        { "histogram",      optional_argument, NULL, 'H' },
+        { "interval",       required_argument, NULL, 'i' },
+        { "format",         required_argument, NULL, 'f' },
+        { "stream",         no_argument,       NULL, 'S' },
+        { "chunk-size",     required_argument, NULL, 'C' },
+        { "format-threads", required_argument, NULL, 'j' },
+        { "sample",         required_argument, NULL, 'n' },
+        { "budget",         required_argument, NULL, 'g' },
+        { "tgid",           required_argument, NULL, 't' },
+        { "pid",            required_argument, NULL, 'p' },
+        { "library",        required_argument, NULL, 'L' },
+        { "resolve-bench",  required_argument, NULL, 'R' },
+        { "usdt",           no_argument,       NULL, 'U' },
+        { "functions",      required_argument, NULL, 'F' },
+        { "btf",            required_argument, NULL, 'Y' },
+        { "uprobe-multi",   no_argument,       NULL, 'M' },
+        { "no-kstats",      no_argument,       NULL, 'k' },
+        { "args",           required_argument, NULL, 'a' },
+        { "clock",          required_argument, NULL, 'K' },
+        { "rb-output",      no_argument,       NULL, 'O' },
+        { "stage",          optional_argument, NULL, 'G' },
+        { "flight-recorder", optional_argument, NULL, 'r' },
+        { "flight-trigger", required_argument, NULL, 'X' },
+        { "combined",       no_argument,       NULL, 'c' },
+        { "stats",          no_argument,       NULL, 's' },
+        { "help",           no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
 
     // Unbuffer stdout to ensure messages appear immediately
     setbuf(stdout, NULL);
     setbuf(stderr, NULL);
 
+    int opt;
+    while ((opt = getopt_long(argc, argv, "PT:Bb::w:d:H::i:f:SC:j:n:g:t:p:L:R:UF:Y:Mka:K:OG::r::X:csh", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'P':
+            env.percpu_rb = 1;
+            break;
+        case 'T':
+            if (!strcmp(optarg, "auto")) {
+                env.transport = TRANSPORT_AUTO;
+            } else if (!strcmp(optarg, "ringbuf")) {
+                env.transport = TRANSPORT_RINGBUF;
+            } else if (!strcmp(optarg, "perf")) {
+                env.transport = TRANSPORT_PERF;
+            } else if (!strcmp(optarg, "arena")) {
+                env.transport = TRANSPORT_ARENA;
+            } else {
+                fprintf(stderr, "Invalid transport: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'B':
+            env.batch_consume = 1;
+            break;
+        case 'b':
+            env.busy_poll = 1;
+            if (optarg) {
+                char *end;
+                env.busy_poll_cpu = strtol(optarg, &end, 10);
+                if (*end || env.busy_poll_cpu < 0 || env.busy_poll_cpu >= CPU_SETSIZE) {
+                    fprintf(stderr, "Invalid busy-poll CPU: %s\n", optarg);
+                    return 1;
+                }
+            }
+            break;
+        case 'w':
+            if (parse_wakeup_policy(optarg)) {
+                fprintf(stderr, "Invalid wakeup policy: %s\n", optarg);
+                return 1;
+            }
+            env.wakeup_set = 1;
+            break;
+        case 'd':
+            env.drain_interval_ms = atoi(optarg);
+            if (env.drain_interval_ms <= 0) {
+                fprintf(stderr, "Invalid drain interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'H':
+            if (parse_histogram(optarg)) {
+                fprintf(stderr, "Invalid histogram spec: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'i':
+            env.interval_s = atoi(optarg);
+            break;
+        case 'f':
+            if (!strcmp(optarg, "text")) {
+                env.format = FORMAT_TEXT;
+            } else if (!strcmp(optarg, "ctf")) {
+                env.format = FORMAT_CTF;
+            } else {
+                fprintf(stderr, "Invalid format: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'S':
+            env.stream = 1;
+            break;
+        case 'C':
+            env.chunk_kb = atoi(optarg);
+            if (env.chunk_kb == 0) {
+                fprintf(stderr, "Invalid chunk size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'j':
+            env.format_threads = atoi(optarg);
+            if (env.format_threads <= 0) {
+                fprintf(stderr, "Invalid thread count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            if (parse_sample(optarg)) {
+                fprintf(stderr, "Invalid sampling rate: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'g':
+            if (parse_budget(optarg)) {
+                fprintf(stderr, "Invalid budget: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 't':
+            if (parse_id_list(optarg, env.tgids, &env.nr_tgids)) {
+                fprintf(stderr, "Invalid TGID list: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            if (parse_id_list(optarg, env.pids, &env.nr_pids)) {
+                fprintf(stderr, "Invalid PID list: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'L':
+            env.library = optarg;
+            break;
+        case 'U':
+            env.usdt = 1;
+            break;
+        case 'F':
+            env.functions = optarg;
+            break;
+        case 'Y':
+            env.btf_path = optarg;
+            break;
+        case 'M':
+            env.uprobe_multi = 1;
+            break;
+        case 'k':
+            env.no_kstats = 1;
+            break;
+        case 'a':
+            if (parse_args(optarg)) {
+                fprintf(stderr, "Invalid argument list: %s (expected all, none or 1-%d, "
+                        "comma-separated)\n", optarg, CALL_REGS);
+                return 1;
+            }
+            break;
+        case 'K':
+            if (parse_clock(optarg)) {
+                fprintf(stderr, "Invalid clock: %s (expected mono, boot, coarse or tai)\n",
+                        optarg);
+                return 1;
+            }
+            break;
+        case 'O':
+            env.rb_output = 1;
+            break;
+        case 'G':
+            if (parse_stage(optarg)) {
+                fprintf(stderr, "Invalid staging spec: %s (expected N[:US], N at most %zu)\n",
+                        optarg, STAGE_MAX_EVENTS);
+                return 1;
+            }
+            break;
+        case 'r':
+            if (parse_flight_slots(optarg)) {
+                fprintf(stderr, "Invalid flight recorder size: %s (1-%d events per CPU)\n",
+                        optarg, FLIGHT_MAX_SLOTS);
+                return 1;
+            }
+            break;
+        case 'X': {
+            char *end;
+            unsigned long long us = strtoull(optarg, &end, 10);
+
+            if (end == optarg || *end || us == 0) {
+                fprintf(stderr, "Invalid flight trigger: %s\n", optarg);
+                return 1;
+            }
+            env.flight_trigger_ns = us * 1000;
+            break;
+        }
+        case 'c':
+            env.combined = 1;
+            break;
+        case 's':
+            env.stats = 1;
+            break;
+        case 'R':
+            env.resolve_bench = atoi(optarg);
+            if (env.resolve_bench <= 0) {
+                fprintf(stderr, "Invalid symbol count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
     fprintf(stderr, "eBPF tracer starting (PID %d)...\n", getpid());
 
     // Check if we should write trace to file (via environment variable or command line)
@@ -161,31 +2235,88 @@ int main(int argc, char **argv) {
     const char *write_trace_env = getenv("EBPF_TRACE_WRITE_FILE");
     int should_write_file = (write_trace_env != NULL && strcmp(write_trace_env, "1") == 0);
 
-    if (argc == 2) {
-        output_file = argv[1];
+    if (argc - optind == 1) {
+        output_file = argv[optind];
         should_write_file = 1;  // If file specified on command line, always write
-    } else if (argc > 2) {
-        fprintf(stderr, "Usage: %s [output_file]\n", argv[0]);
-        fprintf(stderr, "\n");
-        fprintf(stderr, "By default, traces events in memory only (no file output).\n");
-        fprintf(stderr, "To write trace to file:\n");
-        fprintf(stderr, "  1. Specify output_file on command line, OR\n");
-        fprintf(stderr, "  2. Set EBPF_TRACE_WRITE_FILE=1 environment variable\n");
-        fprintf(stderr, "\n");
-        fprintf(stderr, "Examples:\n");
-        fprintf(stderr, "  %s /tmp/trace.txt          # Write to file (command line)\n", argv[0]);
-        fprintf(stderr, "  EBPF_TRACE_WRITE_FILE=1 %s /tmp/trace.txt  # Write to file (env var)\n", argv[0]);
-        fprintf(stderr, "  %s                         # No file output (benchmark mode)\n", argv[0]);
+    } else if (argc - optind > 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Streaming only makes sense with somewhere to stream to
+    if (env.stream && env.histogram) {
+        fprintf(stderr, "--stream and --histogram are mutually exclusive\n");
+        return 1;
+    }
+    if (env.combined && env.histogram) {
+        fprintf(stderr, "--combined and --histogram are mutually exclusive\n");
+        return 1;
+    }
+    if (env.stats && env.histogram) {
+        fprintf(stderr, "--stats and --histogram are mutually exclusive\n");
+        return 1;
+    }
+    if (env.busy_poll && env.histogram) {
+        fprintf(stderr, "--busy-poll and --histogram are mutually exclusive\n");
+        return 1;
+    }
+    if (env.functions && (env.usdt || env.histogram || env.combined)) {
+        fprintf(stderr, "--functions cannot be combined with --usdt, --histogram or --combined\n");
+        return 1;
+    }
+    if (env.no_kstats && (env.stats || env.governed)) {
+        fprintf(stderr, "--no-kstats cannot be combined with --stats or --budget\n");
+        return 1;
+    }
+    if (env.rb_output && env.histogram) {
+        fprintf(stderr, "--rb-output and --histogram are mutually exclusive\n");
+        return 1;
+    }
+    if (env.stage_events && (env.histogram || env.rb_output)) {
+        fprintf(stderr, "--stage cannot be combined with --histogram or --rb-output\n");
+        return 1;
+    }
+    if (env.flight_slots && (env.histogram || env.stream || env.stage_events || env.rb_output ||
+                             env.percpu_rb || env.batch_consume || env.busy_poll ||
+                             env.transport == TRANSPORT_PERF || env.transport == TRANSPORT_ARENA)) {
+        fprintf(stderr, "--flight-recorder keeps events in its own kernel buffers; it cannot be\n"
+                "combined with --histogram, --stream, --stage, --rb-output, --percpu-rb,\n"
+                "--batch-consume, --busy-poll or --transport\n");
+        return 1;
+    }
+    if (env.flight_trigger_ns && (!env.flight_slots || !env.combined)) {
+        fprintf(stderr, "--flight-trigger needs --flight-recorder and --combined (calls are timed at exit)\n");
+        return 1;
+    }
+    if (env.uprobe_multi && !env.functions) {
+        fprintf(stderr, "--uprobe-multi requires --functions\n");
+        return 1;
+    }
+    if (env.governed && env.histogram) {
+        fprintf(stderr, "--budget and --histogram are mutually exclusive\n");
         return 1;
     }
+    // The governor starts from --sample (default: every call) and needs the
+    // pairing map, so it always samples
+    if (env.governed && env.sample_mode == SAMPLE_ALL)
+        env.sample_mode = SAMPLE_EVERY_N;
+    // A spinning consumer never needs waking
+    if (env.busy_poll && !env.wakeup_set)
+        env.wakeup_policy = WAKEUP_NONE;
+    if (env.busy_poll && env.busy_poll_cpu < 0)
+        env.busy_poll_cpu = last_allowed_cpu();
+    if (env.stats && env.interval_s <= 0)
+        env.interval_s = 1;
+    if (env.stream || env.flight_slots)
+        should_write_file = 1;
 
     // If env var is set but no file specified, use default location
     if (should_write_file && !output_file) {
-        output_file = "/tmp/ebpf_trace.txt";
+        output_file = env.format == FORMAT_CTF ? "/tmp/ebpf_trace_ctf" : "/tmp/ebpf_trace.txt";
     }
 
     // Find the library
-    lib_path = find_library();
+    lib_path = env.library ? env.library : find_library();
     if (!lib_path) {
         fprintf(stderr, "Failed to find libmylib.so in any expected location\n");
         fprintf(stderr, "Tried:\n");
@@ -198,19 +2329,118 @@ int main(int argc, char **argv) {
 
     printf("Using library: %s\n", lib_path);
 
-    // Allocate event buffer (do this BEFORE tracing starts)
-    event_buffer = calloc(MAX_EVENTS, sizeof(union stored_event));
-    event_sizes = calloc(MAX_EVENTS, sizeof(size_t));
-    if (!event_buffer || !event_sizes) {
-        fprintf(stderr, "Failed to allocate event buffer\n");
+    // Symbol resolution benchmark needs neither BPF nor root
+    if (env.resolve_bench)
+        return resolve_bench(lib_path, env.resolve_bench);
+
+    if (env.functions) {
+        err = func_table_build(&func_table, lib_path, env.btf_path, env.functions);
+        if (err) {
+            fprintf(stderr, "Failed to resolve functions '%s': %s\n",
+                    env.functions, strerror(-err));
+            return 1;
+        }
+        if (func_table.type_source[0])
+            printf("Tracing %u function(s), types from %s:\n", func_table.nr,
+                   func_table.type_source);
+        else
+            printf("Tracing %u function(s), no BTF found (raw registers):\n", func_table.nr);
+        func_table_mask(&func_table, env.capture_args);
+        func_table_print(&func_table, stdout);
+        func_table_install(&func_table);
+    }
+
+    // Fall back to the perf buffer on kernels without ringbuf (pre-5.8)
+    if (!env.histogram && !env.flight_slots && env.transport == TRANSPORT_AUTO) {
+        if (libbpf_probe_bpf_map_type(BPF_MAP_TYPE_RINGBUF, NULL) > 0) {
+            env.transport = TRANSPORT_RINGBUF;
+        } else {
+            env.transport = TRANSPORT_PERF;
+            printf("BPF ringbuf unavailable, falling back to the perf buffer\n");
+        }
+    }
+    if (env.rb_output && (env.transport == TRANSPORT_PERF || env.transport == TRANSPORT_ARENA)) {
+        fprintf(stderr, "--rb-output needs the ringbuf transport\n");
+        err = -EINVAL;
+        goto cleanup;
+    }
+    if (env.stage_events && env.transport != TRANSPORT_RINGBUF) {
+        fprintf(stderr, "--stage needs the ringbuf transport\n");
         return 1;
     }
-    printf("Allocated buffer for %d events (%zu MB)\n", MAX_EVENTS,
-           (MAX_EVENTS * sizeof(union stored_event)) / (1024*1024));
+    if (env.transport == TRANSPORT_ARENA && !env.histogram) {
+        if (env.percpu_rb || env.batch_consume) {
+            fprintf(stderr, "--percpu-rb and --batch-consume need the ringbuf transport\n");
+            return 1;
+        }
+        if (env.wakeup_set && env.wakeup_policy != WAKEUP_NONE) {
+            fprintf(stderr, "The arena transport has no wakeups; its rings are polled\n");
+            return 1;
+        }
+        env.wakeup_policy = WAKEUP_NONE;
+    }
+    if (env.transport == TRANSPORT_PERF) {
+        if (env.percpu_rb || env.batch_consume) {
+            fprintf(stderr, "--percpu-rb and --batch-consume need the ringbuf transport\n");
+            return 1;
+        }
+        if (env.wakeup_policy == WAKEUP_ADAPTIVE || env.wakeup_policy == WAKEUP_WATERMARK) {
+            fprintf(stderr, "The perf buffer supports force, batch and none wakeups only\n");
+            return 1;
+        }
+    }
+
+    if (env.histogram) {
+        nr_consumers = 0;  // Everything stays in-kernel
+    } else if (env.percpu_rb || env.transport == TRANSPORT_PERF ||
+               env.transport == TRANSPORT_ARENA || env.stage_events || env.flight_slots) {
+        nr_consumers = libbpf_num_possible_cpus();
+        if (nr_consumers <= 0 || nr_consumers > MAX_CPUS) {
+            fprintf(stderr, "Unsupported CPU count for per-CPU buffers: %d\n", nr_consumers);
+            return 1;
+        }
+    } else {
+        nr_consumers = 1;
+    }
+
+    // Allocate event buffers (do this BEFORE tracing starts)
+    if (nr_consumers > 0) {
+        consumers = calloc(nr_consumers, sizeof(*consumers));
+        if (!consumers) {
+            fprintf(stderr, "Failed to allocate event buffer\n");
+            return 1;
+        }
+        for (int i = 0; i < nr_consumers; i++) {
+            if (consumer_alloc(&consumers[i], nr_consumers > 1 ? i : -1)) {
+                fprintf(stderr, "Failed to allocate event buffer\n");
+                nr_consumers = i + 1;  // Only free what was initialized
+                err = -ENOMEM;
+                goto cleanup;
+            }
+        }
+        if (env.stage_events) {
+            stage_consumers = consumers;
+            nr_stage_consumers = nr_consumers;
+        }
+        if (env.stream) {
+            printf("Streaming to %s: 2 x %u KB chunks x %d consumer(s)\n",
+                   output_file, env.chunk_kb, nr_consumers);
+        } else if (env.flight_slots) {
+            printf("Flight recorder: last %u events x %d CPUs (%zu KB per CPU), snapshots to %s\n",
+                   env.flight_slots, nr_consumers,
+                   (size_t)env.flight_slots * sizeof(struct flight_slot) / 1024, output_file);
+        } else {
+            printf("Event store: up to %d events x %d consumer(s), "
+                   "%u-event chunks allocated as they fill\n",
+                   MAX_EVENTS, nr_consumers, event_store_chunk_events());
+        }
+    }
 
     // Set up signal handler
     signal(SIGINT, sig_handler);
     signal(SIGTERM, sig_handler);
+    if (env.flight_slots)
+        signal(SIGUSR1, snapshot_handler);
 
     // Set up libbpf errors and debug info callback
     libbpf_set_print(NULL);
@@ -223,13 +2453,224 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    if (env.histogram) {
+        // Probes never touch a ringbuf in histogram mode
+        skel->rodata->histogram_mode = 1;
+        skel->rodata->hist_linear_step_ns = env.hist_step_ns;
+        bpf_map__set_autocreate(skel->maps.events, false);
+    } else if (env.percpu_rb) {
+        // Producers pick their CPU's ringbuf; the shared one is never created
+        skel->rodata->use_percpu_ringbuf = 1;
+        bpf_map__set_max_entries(skel->maps.percpu_events, nr_consumers);
+        bpf_map__set_autocreate(skel->maps.events, false);
+    }
+
+    // The perf transport must not create ringbufs: older kernels lack them
+    if (env.transport == TRANSPORT_PERF) {
+        skel->rodata->use_perfbuf = 1;
+        bpf_map__set_autocreate(skel->maps.events, false);
+        bpf_map__set_autocreate(skel->maps.percpu_events, false);
+    } else {
+        bpf_map__set_autocreate(skel->maps.perf_events, false);
+    }
+
+    // Arena rings instead of ringbufs, one per CPU
+    if (env.transport == TRANSPORT_ARENA && !env.histogram) {
+        if (!skel->rodata->arena_built) {
+            fprintf(stderr, "The BPF object was built without arena support (needs clang 18+)\n");
+            err = -EOPNOTSUPP;
+            goto cleanup;
+        }
+        skel->rodata->use_arena = 1;
+        bpf_map__set_max_entries(skel->maps.arena, ARENA_PAGES(nr_consumers));
+        bpf_map__set_autocreate(skel->maps.events, false);
+        bpf_map__set_autocreate(skel->maps.percpu_events, false);
+    } else {
+        bpf_map__set_autocreate(skel->maps.arena, false);
+    }
+
+    // Flight recorder: overwritten per-CPU slots instead of a transport
+    if (env.flight_slots) {
+        skel->rodata->flight_slots = env.flight_slots;
+        skel->rodata->flight_trigger_ns = env.flight_trigger_ns;
+        bpf_map__set_max_entries(skel->maps.flight, env.flight_slots * nr_consumers);
+        bpf_map__set_autocreate(skel->maps.events, false);
+        bpf_map__set_autocreate(skel->maps.percpu_events, false);
+    } else {
+        bpf_map__set_autocreate(skel->maps.flight, false);
+        bpf_map__set_autocreate(skel->maps.flight_head, false);
+    }
+
+    // Entry state lives in task storage; only create it when it is used
+    if (env.combined)
+        skel->rodata->combined_mode = 1;
+    else
+        bpf_map__set_autocreate(skel->maps.span_start, false);
+
+    // Sampling state is only created when sampling
+    skel->rodata->sample_mode = env.sample_mode;
+    skel->rodata->sample_every = env.sample_every;
+    skel->rodata->sample_threshold = (__u32)((1ULL << 32) / env.sample_every);
+    skel->rodata->sample_governed = env.governed;
+    if (env.sample_mode != SAMPLE_EVERY_N)
+        bpf_map__set_autocreate(skel->maps.sample_counter, false);
+    if (env.sample_mode == SAMPLE_ALL)
+        bpf_map__set_autocreate(skel->maps.sampled_calls, false);
+    if (!env.governed)
+        bpf_map__set_autocreate(skel->maps.sample_rate, false);
+
+    // Feature switches: what is off is pruned from the programs at load time
+    skel->rodata->stats_enabled = !env.no_kstats;
+    if (env.no_kstats)
+        bpf_map__set_autocreate(skel->maps.statistics, false);
+    skel->rodata->capture_args = env.capture_args;
+    skel->rodata->ts_clock = env.ts_clock;
+    skel->rodata->use_ringbuf_output = env.rb_output;
+
+    // Kernel-side staging: per-CPU batches, plus the timer that flushes them
+    skel->rodata->stage_events = env.stage_events;
+    skel->rodata->stage_flush_ns = (__u64)env.stage_flush_us * 1000;
+    skel->rodata->nr_stage_cpus = env.stage_events ? nr_consumers : 0;
+    bpf_program__set_autoload(skel->progs.stage_start, env.stage_events);
+    bpf_program__set_autoload(skel->progs.stage_stop, env.stage_events);
+    if (!env.stage_events) {
+        bpf_map__set_autocreate(skel->maps.staging, false);
+        bpf_map__set_autocreate(skel->maps.stage_timer, false);
+    }
+
+    // Target filter, checked first in every probe
+    skel->rodata->nr_filter_tgids = env.nr_tgids;
+    for (unsigned int i = 0; i < env.nr_tgids; i++)
+        skel->rodata->filter_tgids[i] = env.tgids[i];
+    skel->rodata->nr_filter_pids = env.nr_pids;
+    for (unsigned int i = 0; i < env.nr_pids; i++)
+        skel->rodata->filter_pids[i] = env.pids[i];
+
+    // Load only the probe flavour we attach
+    bpf_program__set_autoload(skel->progs.my_traced_function_entry, !env.usdt && !env.functions);
+    bpf_program__set_autoload(skel->progs.my_traced_function_exit, !env.usdt && !env.functions);
+    bpf_program__set_autoload(skel->progs.generic_entry, env.functions && !env.uprobe_multi);
+    bpf_program__set_autoload(skel->progs.generic_exit, env.functions && !env.uprobe_multi);
+    bpf_program__set_autoload(skel->progs.generic_multi_entry, env.uprobe_multi);
+    bpf_program__set_autoload(skel->progs.generic_multi_exit, env.uprobe_multi);
+    bpf_program__set_autoload(skel->progs.usdt_my_traced_function_entry, env.usdt);
+    bpf_program__set_autoload(skel->progs.usdt_my_traced_function_exit, env.usdt);
+
+    // Notification policy; the watermark is relative to the ringbuf each producer writes to
+    skel->rodata->wakeup_policy = env.wakeup_policy;
+    skel->rodata->wakeup_batch = env.wakeup_batch;
+    skel->rodata->wakeup_watermark =
+        (__u64)(env.percpu_rb ? PERCPU_RINGBUF_SIZE : EVENTS_RINGBUF_SIZE) *
+        env.watermark_pct / 100;
+
     // Load & verify BPF programs
     err = mylib_tracer_bpf__load(skel);
     if (err) {
         fprintf(stderr, "Failed to load and verify BPF skeleton\n");
+        if (env.uprobe_multi)
+            fprintf(stderr, "uprobe_multi programs need Linux 6.6+; retry without --uprobe-multi\n");
+        if (skel->rodata->use_arena)
+            fprintf(stderr, "The arena transport needs Linux 6.10+; retry with --transport=ringbuf\n");
+        if (env.stage_events)
+            fprintf(stderr, "Kernel-side staging needs Linux 5.19+; retry without --stage\n");
         goto cleanup;
     }
 
+    // The governed rate starts at --sample's; an all-zero entry samples nothing
+    if (env.governed) {
+        governor_init(&gov, &env.budget, env.sample_every);
+        err = set_sample_rate(skel, env.sample_every);
+        if (err) {
+            fprintf(stderr, "Failed to set sampling rate: %s\n", strerror(-err));
+            goto cleanup;
+        }
+    }
+
+    // Staged records are flushed by size or by this timer, whichever is first
+    if (env.stage_events) {
+        err = run_stage_prog(skel->progs.stage_start);
+        if (err) {
+            fprintf(stderr, "Failed to start the staging flush timer: %s\n", strerror(-err));
+            goto cleanup;
+        }
+    }
+
+    // Set up ring buffer polling before attaching so no event is missed
+    if (env.histogram) {
+        printf("Histogram mode: %s buckets", env.hist_step_ns ? "linear" : "log2");
+        if (env.hist_step_ns)
+            printf(" of %lu ns", env.hist_step_ns);
+        printf("\n");
+    } else if (env.flight_slots) {
+        fr = flight_recorder_new(bpf_map__fd(skel->maps.flight), bpf_map__fd(skel->maps.flight_head),
+                                 nr_consumers, env.flight_slots);
+        if (!fr) {
+            err = -errno;
+            fprintf(stderr, "Failed to map the flight recorder: %s\n", strerror(-err));
+            goto cleanup;
+        }
+    } else if (env.transport == TRANSPORT_PERF) {
+        err = setup_perf_consumer(skel, consumers);
+        if (err) {
+            fprintf(stderr, "Failed to create perf buffer: %s\n", strerror(-err));
+            goto cleanup;
+        }
+        printf("Using perf buffer: %d CPUs x %d pages\n", nr_consumers, PERF_BUFFER_PAGES);
+    } else if (env.transport == TRANSPORT_ARENA) {
+        err = setup_arena_consumers(skel, consumers, nr_consumers);
+        if (err)
+            goto cleanup;
+        printf("Using %d arena rings (%d slots of %zu bytes, %zu KB each)\n",
+               nr_consumers, ARENA_RING_SLOTS, sizeof(struct arena_slot),
+               (size_t)ARENA_RING_PAGES * ARENA_PAGE_SIZE / 1024);
+    } else if (env.percpu_rb) {
+        err = setup_percpu_consumers(skel, consumers, nr_consumers);
+        if (err)
+            goto cleanup;
+        printf("Using %d per-CPU ring buffers (%d KB each)\n",
+               nr_consumers, PERCPU_RINGBUF_SIZE / 1024);
+    } else {
+        err = consumer_open_ring(&consumers[0], bpf_map__fd(skel->maps.events));
+        if (err) {
+            fprintf(stderr, "Failed to create ring buffer: %s\n", strerror(-err));
+            goto cleanup;
+        }
+    }
+
+    // Streaming: one output stream per consumer, writer running before attach
+    if (env.stream) {
+        err = trace_output_open(&stream_out, output_file, nr_consumers);
+        if (err)
+            goto cleanup;
+        stream_writer = stream_writer_start(nr_consumers, (size_t)env.chunk_kb * 1024,
+                                            trace_output_write, &stream_out);
+        if (!stream_writer) {
+            err = -errno;
+            fprintf(stderr, "Failed to start stream writer: %s\n", strerror(-err));
+            goto cleanup;
+        }
+    }
+
+    // Attach time covers symbol resolution plus creating both probe links
+    struct timespec attach_start, attach_end;
+    clock_gettime(CLOCK_MONOTONIC, &attach_start);
+
+    if (env.usdt) {
+        err = attach_usdt_probes(skel, lib_path, &link_entry, &link_exit);
+        if (err)
+            goto cleanup;
+        goto attached;
+    }
+    if (env.functions) {
+        if (env.uprobe_multi)
+            err = attach_functions_multi(skel, lib_path, &func_links, &nr_func_links);
+        else
+            err = attach_functions(skel, lib_path, &func_links, &nr_func_links);
+        if (err)
+            goto cleanup;
+        goto attached;
+    }
+
     // Get function offset
     func_offset = get_function_offset(lib_path, func_name);
     if (func_offset < 0) {
@@ -264,57 +2705,257 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
-    printf("Successfully attached uprobes to %s\n", func_name);
+attached:
+    clock_gettime(CLOCK_MONOTONIC, &attach_end);
+    if (env.functions) {
+        printf("Successfully attached generic uprobes to %u function(s) (%u links%s)\n",
+               func_table.nr, nr_func_links, env.uprobe_multi ? ", uprobe_multi" : "");
+    } else {
+        printf("Successfully attached %s to %s\n", env.usdt ? "USDT probes" : "uprobes",
+               func_name);
+    }
+    unsigned int nr_probed = env.functions ? func_table.nr : 1;
+    printf("Attach time: %.2f ms (%u function%s)\n", elapsed_us(&attach_start, &attach_end) / 1e3,
+           nr_probed, nr_probed != 1 ? "s" : "");
+    if (!env.histogram && !env.flight_slots) {
+        printf("Wakeup policy: %s", wakeup_policy_name(env.wakeup_policy));
+        if (env.wakeup_policy == WAKEUP_BATCH)
+            printf(" (every %u events)", env.wakeup_batch);
+        else if (env.wakeup_policy == WAKEUP_WATERMARK)
+            printf(" (%u%% full)", env.watermark_pct);
+        if (env.busy_poll)
+            printf(", busy-polling on CPU %d\n", env.busy_poll_cpu);
+        else
+            printf(", drain interval %d ms\n", env.drain_interval_ms);
+        printf("Consumer: %s\n",
+               env.transport == TRANSPORT_PERF ? "libbpf perf_buffer (one callback per sample)" :
+               env.transport == TRANSPORT_ARENA ? "arena reader (records read in place, polled)" :
+               env.batch_consume ? "in-place batches (one callback per run of records)" :
+               "libbpf ring_buffer (one callback per record)");
+    }
+    if (env.combined)
+        printf("Combined mode: one span record per call, emitted at exit\n");
+    if (env.stage_events)
+        printf("Staging: %u records per CPU batch (%d bytes max), flushed at least every %u us\n",
+               env.stage_events, STAGE_BYTES, env.stage_flush_us);
+    printf("BPF features: kernel stats %s, args ", env.no_kstats ? "off" : "on");
+    print_capture_args();
+    printf(", clock %s", ts_clock_names[env.ts_clock]);
+    if (!env.histogram)
+        printf(", %s", env.transport == TRANSPORT_PERF ? "perf_event_output" :
+               env.transport == TRANSPORT_ARENA ? "arena slot copy" :
+               env.stage_events ? "staged batches, ringbuf_output per batch" :
+               env.flight_slots ? "flight recorder slots" :
+               env.rb_output ? "ringbuf_output" : "ringbuf reserve/submit");
+    printf("\n");
+    if (env.sample_mode != SAMPLE_ALL)
+        printf("Sampling: 1 in %u calls (%s%s)\n", env.sample_every,
+               env.governed ? "governed, " : "",
+               env.sample_mode == SAMPLE_RANDOM ? "random" : "every Nth per CPU");
+    if (env.governed) {
+        print_budget();
+        printf(", adjusted every 100 ms\n");
+    }
+    if (env.nr_tgids || env.nr_pids) {
+        printf("Tracing only:");
+        if (env.nr_tgids)
+            print_id_list(" TGIDs", env.tgids, env.nr_tgids);
+        if (env.nr_pids)
+            print_id_list(" PIDs", env.pids, env.nr_pids);
+        printf("\n");
+    }
+    if (env.flight_slots) {
+        printf("Snapshots: on exit, on kill -USR1 %d", getpid());
+        if (env.flight_trigger_ns)
+            printf(", on calls of %llu us or more", env.flight_trigger_ns / 1000);
+        printf("\n");
+    }
     printf("Tracing... Press Ctrl-C to stop.\n");
 
-    // Set up ring buffer polling
-    rb = ring_buffer__new(bpf_map__fd(skel->maps.events), handle_event, NULL, NULL);
-    if (!rb) {
-        err = -1;
-        fprintf(stderr, "Failed to create ring buffer\n");
+    if (env.histogram) {
+        err = histogram_loop(skel, should_write_file ? output_file : NULL);
         goto cleanup;
     }
 
-    // Process events - CRITICAL: Use short timeout for low-latency benchmarks
-    // With BPF_RB_FORCE_WAKEUP, events wake us immediately, but we still need
-    // a short timeout to check for termination signal frequently
-    while (!exiting) {
-        err = ring_buffer__poll(rb, 1 /* timeout, ms - reduced from 100ms for low latency */);
-        if (err == -EINTR) {
-            err = 0;
-            break;
+    // --stats prints every interval and --budget steps the governor; without
+    // either there is no reporter thread waking up while tracing
+    if (env.stats || env.governed) {
+        err = stats_reporter_start(&reporter, skel, consumers, nr_consumers,
+                                   env.governed ? &gov : NULL);
+        if (err) {
+            fprintf(stderr, "Failed to start statistics reporter: %s\n", strerror(-err));
+            goto cleanup;
         }
-        if (err < 0) {
-            fprintf(stderr, "Error polling ring buffer: %d\n", err);
-            break;
+    }
+
+    struct timespec trace_start, trace_end;
+    clock_gettime(CLOCK_MONOTONIC, &trace_start);
+
+    if (env.flight_slots) {
+        err = flight_loop(skel, fr, consumers, nr_consumers, output_file);
+    } else if (env.busy_poll) {
+        err = busy_poll_loop(consumers, nr_consumers);
+    } else if (env.percpu_rb || env.transport == TRANSPORT_ARENA) {
+        for (int i = 0; i < nr_consumers; i++) {
+            err = pthread_create(&consumers[i].thread, NULL, consumer_thread, &consumers[i]);
+            if (err) {
+                fprintf(stderr, "Failed to start consumer thread for CPU %d: %s\n",
+                        i, strerror(err));
+                exiting = 1;
+                err = -err;
+                break;
+            }
+            consumers[i].thread_started = 1;
         }
+        for (int i = 0; i < nr_consumers; i++) {
+            if (consumers[i].thread_started) {
+                void *ret;
+                pthread_join(consumers[i].thread, &ret);
+                if ((long)ret < 0 && !err)
+                    err = (long)ret;
+            }
+        }
+    } else {
+        err = consumer_poll_loop(&consumers[0]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &trace_end);
+
+    // Nothing is consumed any more; detach now, timed like the attach
+    struct bpf_link *fixed_links[] = { link_entry, link_exit };
+    double detach_us = detach_links(fixed_links, 2);
+    link_entry = link_exit = NULL;
+    if (func_links)
+        detach_us += detach_links(func_links, nr_func_links);
+
+    // Flush the partly filled batches and pick them up
+    if (env.stage_events) {
+        int serr = run_stage_prog(skel->progs.stage_stop);
+
+        if (serr)
+            fprintf(stderr, "Failed to flush the staging buffers: %s\n", strerror(-serr));
+        for (int i = 0; i < nr_consumers; i++)
+            consumer_consume(&consumers[i]);
     }
 
+    // The exit snapshot, taken once the probes have stopped writing
+    if (env.flight_slots && !err)
+        err = flight_fill(fr, consumers, nr_consumers, "exit");
+
+    unsigned long event_count = 0;
+    unsigned long long consumer_cpu_ns = 0, perf_lost = 0;
+    unsigned long long calls = 0;
+    unsigned long latency_samples = 0;
+    unsigned long long latency_sum = 0, latency_max = 0;
+    for (int i = 0; i < nr_consumers; i++) {
+        event_count += consumers[i].event_count;
+        consumer_cpu_ns += consumers[i].cpu_ns;
+        perf_lost += consumers[i].perf_lost;
+        calls += consumers[i].calls;
+        latency_samples += consumers[i].latency_samples;
+        latency_sum += consumers[i].latency_sum_ns;
+        if (consumers[i].latency_max_ns > latency_max)
+            latency_max = consumers[i].latency_max_ns;
+    }
     printf("\nTracing stopped. Captured %lu events.\n", event_count);
+    printf("Detach time: %.2f ms (%u function%s)\n", detach_us / 1e3,
+           nr_probed, nr_probed != 1 ? "s" : "");
+    if (!env.stream && event_count > 0) {
+        size_t store_bytes = 0;
+        unsigned int chunks = 0;
+
+        for (int i = 0; i < nr_consumers; i++) {
+            store_bytes += event_store_bytes(&consumers[i].store);
+            chunks += consumers[i].store.nr_chunks;
+        }
+        printf("Event store: %.1f MB in %u chunk(s) (%.1f bytes/event)\n",
+               store_bytes / (1024.0 * 1024.0), chunks, (double)store_bytes / event_count);
+    }
+    if (latency_samples > 0) {
+        printf("Delivery latency: avg %.0f ns, max %llu ns (%lu samples)\n",
+               (double)latency_sum / latency_samples, latency_max, latency_samples);
+    }
+    {
+        double trace_ms = elapsed_us(&trace_start, &trace_end) / 1e3;
+        printf("Consumer CPU: %.1f ms over %.1f ms of tracing (%.1f%% of one core, %s)\n",
+               consumer_cpu_ns / 1e6, trace_ms,
+               trace_ms > 0 ? consumer_cpu_ns / 1e4 / trace_ms : 0.0,
+               env.busy_poll ? "busy-poll" :
+               env.flight_slots ? "snapshots only" :
+               env.transport == TRANSPORT_ARENA ? "polling" : "epoll");
+    }
+    if (env.transport == TRANSPORT_PERF)
+        printf("Perf buffer: %llu samples lost\n", perf_lost);
+    stats_reporter_stop(&reporter);
+    print_sampling(skel, reporter.gov, calls);
+    if (reporter.gov)
+        print_governor(reporter.gov);
+    print_kernel_stats(skel, &reporter);
+
+    if (stream_writer) {
+        // Consumers have stopped; flush what is left in their chunks
+        struct stream_writer_stats ws;
+        unsigned long dropped = 0;
+        unsigned long long bytes = 0;
+        struct timespec start;
+
+        for (int i = 0; i < nr_consumers; i++)
+            dropped += consumers[i].events_dropped;
 
-    // Write all buffered events to file (AFTER tracing completes) - only if requested
-    if (should_write_file && event_count > 0 && output_file) {
-        write_events_to_file(output_file);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int werr = stream_writer_stop(stream_writer, &ws);
+        stream_writer = NULL;
+        int cerr = trace_output_close(&stream_out, dropped, &bytes);
+        if (werr || cerr) {
+            fprintf(stderr, "Failed to write trace: %s\n", strerror(-(werr ? werr : cerr)));
+            if (!err)
+                err = werr ? werr : cerr;
+        } else {
+            printf("Streamed %llu events to %s in %llu chunks (%lu dropped)\n",
+                   ws.events_written, output_file, ws.chunks_written, dropped);
+            printf("Writer backpressure: %llu stalls, %.1f ms stalled\n",
+                   ws.stalls, ws.stall_ns / 1e6);
+            print_trace_size(bytes, ws.events_written, &start);
+        }
+    } else if (should_write_file && event_count > 0 && output_file) {
+        // Write all buffered events to file (AFTER tracing completes) - only if requested
+        write_events_to_file(output_file, consumers, nr_consumers);
     } else if (!should_write_file) {
         printf("File output disabled. Events captured in memory only.\n");
         printf("Set EBPF_TRACE_WRITE_FILE=1 or specify output file to write trace.\n");
     }
 
 cleanup:
-    if (rb)
-        ring_buffer__free(rb);
+    stats_reporter_stop(&reporter);
     if (link_entry)
         bpf_link__destroy(link_entry);
     if (link_exit)
         bpf_link__destroy(link_exit);
+    if (func_links) {
+        detach_links(func_links, nr_func_links);
+        free(func_links);
+    }
+
+    // Error paths that bail out before the consumers ran
+    if (stream_writer)
+        stream_writer_stop(stream_writer, NULL);
+    if (stream_out.text || stream_out.ctf) {
+        unsigned long long bytes;
+        trace_output_close(&stream_out, 0, &bytes);
+    }
+
+    flight_recorder_free(fr);
+
+    // Free consumers and event buffers
+    if (consumers) {
+        for (int i = 0; i < nr_consumers; i++)
+            consumer_free(&consumers[i]);
+        free(consumers);
+    }
+
     if (skel)
         mylib_tracer_bpf__destroy(skel);
 
-    // Free event buffers
-    if (event_buffer)
-        free(event_buffer);
-    if (event_sizes)
-        free(event_sizes);
+    elf_resolver_cache_clear();
 
     return err < 0 ? -err : 0;
 }
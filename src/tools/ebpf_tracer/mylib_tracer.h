@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: GPL-2.0
+// Definitions shared between the BPF programs (mylib_tracer.bpf.c) and the
+// userspace loader (mylib_tracer.c). Only fixed-width __uN types from
+// <linux/types.h> are used so both sides agree on layout.
+#ifndef MYLIB_TRACER_H
+#define MYLIB_TRACER_H
+
+// Upper bound on CPUs for per-CPU ring buffers (outer map is resized at load time)
+#define MAX_CPUS 1024
+
+// Size of the shared ring buffer (OPTIMIZED: 2MB for benchmarking high loads)
+#define EVENTS_RINGBUF_SIZE (2 * 1024 * 1024)
+
+// Size of each ring buffer in per-CPU mode (power of two, multiple of page size)
+#define PERCPU_RINGBUF_SIZE (512 * 1024)
+
+// Largest event record (struct trace_event_call); records are all
+// multiples of 4 bytes
+#define MAX_RECORD_SIZE 64
+
+// --transport=arena: one ring of fixed-size slots per CPU in a BPF arena
+// that userspace mmaps. The arena is mapped at ARENA_USER_BASE (map_extra),
+// so its low 32 bits, which are all the BPF side addresses by, start at 0.
+// The first and last pages are left to arena globals (libbpf has put them at
+// either end); ring i starts at page 1 + i * ARENA_RING_PAGES.
+#define ARENA_USER_BASE (1ULL << 44)
+#define ARENA_PAGE_SIZE 4096
+#define ARENA_RING_SLOTS 8192      // Power of two
+
+struct arena_slot {
+    __u32 size;                    // Record length in data
+    __u32 pad;
+    __u8 data[MAX_RECORD_SIZE];
+};
+
+// Single producer per ring: the BPF programs running on its CPU, serialized
+// by busy (they can be preempted mid-write by another task on that CPU).
+// head and tail are free-running slot counts on separate cache lines.
+struct arena_ring {
+    __u64 head;                    // Slots published; written by BPF only
+    __u64 busy;                    // A program on this CPU is filling slot head
+    __u64 tail __attribute__((aligned(64)));  // Slots consumed; written by userspace only
+    struct arena_slot slots[ARENA_RING_SLOTS] __attribute__((aligned(64)));
+};
+
+#define ARENA_RING_PAGES ((sizeof(struct arena_ring) + ARENA_PAGE_SIZE - 1) / ARENA_PAGE_SIZE)
+#define ARENA_RING_OFFSET(cpu) (ARENA_PAGE_SIZE * (1 + (__u64)(cpu) * ARENA_RING_PAGES))
+#define ARENA_PAGES(nr_cpus) (2 + (nr_cpus) * ARENA_RING_PAGES)
+
+// --stage: records staged per CPU in the `staging` map, each preceded by
+// its __u32 size, then moved to the ringbuf as one sample (the header plus
+// len bytes of data) once stage_events have accumulated, the next record
+// would not fit, or the flush timer fires
+#define STAGE_BYTES 4096
+#define STAGE_DEFAULT_EVENTS 32
+#define STAGE_DEFAULT_FLUSH_US 1000
+
+struct stage_batch {
+    __u32 cpu;        // CPU the records were produced on
+    __u32 count;      // Records in data
+    __u32 len;        // Bytes of data used
+    __u32 lock;       // Append or flush in progress (BPF only)
+    __u8 data[STAGE_BYTES];
+};
+
+// --flight-recorder: the last flight_slots records of each CPU, kept in the
+// `flight` array map (CPU c owns entries c * flight_slots onward) and
+// overwritten in place. Nothing is consumed while tracing; userspace mmaps
+// the map and copies the slots out when it takes a snapshot.
+#define FLIGHT_DEFAULT_SLOTS 4096
+#define FLIGHT_MAX_SLOTS (1 << 20)
+
+struct flight_slot {
+    __u64 seq;        // Index + 1 of the record on its CPU; 0 while being written
+    __u32 size;       // Record length in data
+    __u32 pad;
+    __u8 data[MAX_RECORD_SIZE];
+};
+
+// Capacity of each --pid / --tgid filter list (rodata arrays)
+#define MAX_FILTER_IDS 16
+
+// --functions: functions traced through the generic probes (the BPF cookie
+// of each attachment is the function's index) and the integer argument
+// registers captured per call (x86-64 SysV: rdi, rsi, rdx, rcx, r8, r9)
+#define MAX_TRACED_FUNCS 4096
+#define CALL_REGS 6
+
+// --args: bit i set = capture argument i + 1 (rodata knob capture_args)
+#define CAPTURE_ALL_ARGS ((1U << CALL_REGS) - 1)
+
+// Event timestamp source (rodata knob ts_clock), and the userspace clock
+// each one matches
+enum ts_clock {
+    TS_CLOCK_MONO = 0,    // bpf_ktime_get_ns: CLOCK_MONOTONIC
+    TS_CLOCK_BOOT,        // bpf_ktime_get_boot_ns: CLOCK_BOOTTIME (counts suspend)
+    TS_CLOCK_COARSE,      // bpf_ktime_get_coarse_ns: CLOCK_MONOTONIC_COARSE (jiffy resolution)
+    TS_CLOCK_TAI,         // bpf_ktime_get_tai_ns: CLOCK_TAI (wall time, no leap seconds)
+};
+
+// Ring buffer notification policy (rodata knob wakeup_policy)
+enum wakeup_policy {
+    WAKEUP_FORCE = 0,     // BPF_RB_FORCE_WAKEUP on every event (lowest latency)
+    WAKEUP_ADAPTIVE,      // Kernel default: wake only if the consumer has caught up
+    WAKEUP_NONE,          // BPF_RB_NO_WAKEUP; consumer drains periodically
+    WAKEUP_BATCH,         // Force a wakeup every wakeup_batch events per CPU
+    WAKEUP_WATERMARK,     // Force a wakeup once unconsumed data >= wakeup_watermark bytes
+};
+
+// In-kernel call sampling (rodata knob sample_mode)
+enum sample_mode {
+    SAMPLE_ALL = 0,     // Record every call
+    SAMPLE_EVERY_N,     // Deterministic: every sample_every-th call on each CPU
+    SAMPLE_RANDOM,      // bpf_get_prandom_u32() < sample_threshold, i.e. 1/sample_every
+};
+
+// --budget: the sampling rate in the `sample_rate` array map, rewritten by
+// the userspace governor while tracing (replaces sample_every/threshold)
+struct sample_rate {
+    __u32 every;        // Record 1 call in every
+    __u32 threshold;    // SAMPLE_RANDOM: 2^32 / every (unused when every == 1)
+};
+
+// In-kernel latency histogram (histogram mode). One copy per CPU; userspace
+// sums them. Slot i holds durations in [2^i, 2^(i+1)) ns in log2 mode, or
+// [i*step, (i+1)*step) ns in linear mode with the last slot as overflow.
+#define HIST_SLOTS 64
+
+struct latency_hist {
+    __u64 slots[HIST_SLOTS];
+    __u64 count;
+    __u64 sum_ns;
+};
+
+// Kernel-side counters (per-CPU `statistics` map; userspace sums the CPUs)
+struct stats {
+    __u64 events_sent;
+    __u64 events_dropped;     // Exit without a recorded entry, or storage unavailable
+    __u64 reserve_failures;   // Ringbuf full: the event was lost in the kernel
+    __u64 calls_estimated;    // --budget: sum of the divisor over sampled calls
+    __u64 sample_failures;    // --sample: picked calls not recorded (sampled_calls update failed)
+};
+
+// Entry event with all arguments
+struct trace_event_entry {
+    __u64 timestamp;
+    __s32 arg1;
+    __u64 arg2;
+    double arg3;
+    __u64 arg4;
+    __u32 event_type;  // 0=entry
+} __attribute__((packed));
+
+// Exit event - minimal size
+struct trace_event_exit {
+    __u64 timestamp;
+    __u32 event_type;  // 1=exit
+} __attribute__((packed));
+
+// Combined mode: one record per call, emitted by the exit probe. timestamp is
+// the entry time; the record is submitted at timestamp + duration_ns.
+struct trace_event_span {
+    __u64 timestamp;
+    __u64 duration_ns;
+    __s32 arg1;
+    __u64 arg2;
+    double arg3;
+    __u64 arg4;
+    __u32 event_type;  // 2=span
+} __attribute__((packed));
+
+// --functions: entry of any traced function. All integer argument registers
+// are captured; userspace decodes them with the function's layout.
+struct trace_event_call {
+    __u64 timestamp;
+    __u32 func_id;
+    __u64 regs[CALL_REGS];
+    __u32 event_type;  // 3=call
+} __attribute__((packed));
+
+// --functions: return of any traced function, with the integer return register
+struct trace_event_return {
+    __u64 timestamp;
+    __u32 func_id;
+    __u64 ret;
+    __u32 event_type;  // 4=return
+} __attribute__((packed));
+
+#endif // MYLIB_TRACER_H
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0
+// Ringbuf layout (kernel/bpf/ringbuf.c): page 0 holds the consumer position
+// and is writable; page 1 holds the producer position; the data pages follow
+// and are mapped twice back to back, so a run that wraps around the end of
+// the buffer is still contiguous in our address space.
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <bpf/bpf.h>
+#include "ringbuf_batch.h"
+
+struct ringbuf_batch {
+    ringbuf_batch_fn fn;
+    void *ctx;
+    unsigned long *consumer_pos;
+    unsigned long *producer_pos;
+    const char *data;
+    unsigned long mask;  // Data size - 1 (a power of two)
+    size_t page_size;
+    int epoll_fd;
+};
+
+struct ringbuf_batch *ringbuf_batch_new(int map_fd, ringbuf_batch_fn fn, void *ctx) {
+    struct bpf_map_info info;
+    __u32 len = sizeof(info);
+    struct ringbuf_batch *rb;
+    struct epoll_event ev = { .events = EPOLLIN };
+    void *tmp;
+    int err;
+
+    memset(&info, 0, sizeof(info));
+    if (bpf_obj_get_info_by_fd(map_fd, &info, &len))
+        return NULL;
+    if (info.type != BPF_MAP_TYPE_RINGBUF) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    rb = calloc(1, sizeof(*rb));
+    if (!rb)
+        return NULL;
+    rb->fn = fn;
+    rb->ctx = ctx;
+    rb->mask = info.max_entries - 1;
+    rb->page_size = getpagesize();
+    rb->epoll_fd = -1;
+
+    tmp = mmap(NULL, rb->page_size, PROT_READ | PROT_WRITE, MAP_SHARED, map_fd, 0);
+    if (tmp == MAP_FAILED)
+        goto err_out;
+    rb->consumer_pos = tmp;
+
+    tmp = mmap(NULL, rb->page_size + 2 * (size_t)info.max_entries, PROT_READ,
+               MAP_SHARED, map_fd, rb->page_size);
+    if (tmp == MAP_FAILED)
+        goto err_out;
+    rb->producer_pos = tmp;
+    rb->data = (const char *)tmp + rb->page_size;
+
+    rb->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (rb->epoll_fd < 0 || epoll_ctl(rb->epoll_fd, EPOLL_CTL_ADD, map_fd, &ev))
+        goto err_out;
+    return rb;
+
+err_out:
+    err = errno;
+    ringbuf_batch_free(rb);
+    errno = err;
+    return NULL;
+}
+
+void ringbuf_batch_free(struct ringbuf_batch *rb) {
+    if (!rb)
+        return;
+    if (rb->epoll_fd >= 0)
+        close(rb->epoll_fd);
+    if (rb->producer_pos)
+        munmap(rb->producer_pos, rb->page_size + 2 * (rb->mask + 1));
+    if (rb->consumer_pos)
+        munmap(rb->consumer_pos, rb->page_size);
+    free(rb);
+}
+
+int ringbuf_batch_consume(struct ringbuf_batch *rb) {
+    unsigned long cons = __atomic_load_n(rb->consumer_pos, __ATOMIC_RELAXED);
+    int total = 0;
+
+    for (;;) {
+        unsigned long prod = __atomic_load_n(rb->producer_pos, __ATOMIC_ACQUIRE);
+        unsigned long start = cons;
+        int n = 0;
+
+        // Extend the run up to the first record still being written
+        while (cons < prod) {
+            const __u32 *hdr = (const __u32 *)(rb->data + (cons & rb->mask));
+            __u32 len = __atomic_load_n(hdr, __ATOMIC_ACQUIRE);
+
+            if (len & BPF_RINGBUF_BUSY_BIT)
+                break;
+            cons += ((len & ~BPF_RINGBUF_DISCARD_BIT) + BPF_RINGBUF_HDR_SZ + 7) & ~7UL;
+            n++;
+        }
+        if (cons == start)
+            return total;
+
+        int err = rb->fn(rb->ctx, rb->data + (start & rb->mask), cons - start);
+
+        // One release store frees the whole run for the producers
+        __atomic_store_n(rb->consumer_pos, cons, __ATOMIC_RELEASE);
+        if (err)
+            return err;
+        total += n;
+        if (cons < prod)
+            return total;  // Stopped at a busy record; its commit will notify
+    }
+}
+
+int ringbuf_batch_poll(struct ringbuf_batch *rb, int timeout_ms) {
+    struct epoll_event ev;
+    int n = epoll_wait(rb->epoll_fd, &ev, 1, timeout_ms);
+
+    if (n < 0)
+        return -errno;
+    if (n == 0)
+        return 0;
+    return ringbuf_batch_consume(rb);
+}
+
+double ringbuf_batch_fill_pct(const struct ringbuf_batch *rb) {
+    unsigned long prod = __atomic_load_n(rb->producer_pos, __ATOMIC_ACQUIRE);
+    unsigned long cons = __atomic_load_n(rb->consumer_pos, __ATOMIC_RELAXED);
+
+    return 100.0 * (prod - cons) / (rb->mask + 1);
+}
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-2.0
+// Batch ring buffer consumer. Maps a BPF ringbuf like libbpf's ring_buffer,
+// but hands each run of contiguous committed records to one callback, in
+// place in the mapped data pages, and advances the consumer position once
+// per run instead of once per record.
+#ifndef RINGBUF_BATCH_H
+#define RINGBUF_BATCH_H
+
+#include <stddef.h>
+#include <linux/types.h>
+#include <linux/bpf.h>
+
+// Called with a run of records in the ringbuf's own layout (8-byte header,
+// payload, padding to 8 bytes). The run is only valid during the call.
+// Returns 0 or a negative errno, which stops consumption.
+typedef int (*ringbuf_batch_fn)(void *ctx, const void *run, size_t len);
+
+struct ringbuf_batch;
+
+// Map the ringbuf behind map_fd. Returns NULL and sets errno on failure.
+struct ringbuf_batch *ringbuf_batch_new(int map_fd, ringbuf_batch_fn fn, void *ctx);
+void ringbuf_batch_free(struct ringbuf_batch *rb);
+
+// Wait up to timeout_ms for a notification, then consume. Same return
+// values as ringbuf_batch_consume; -EINTR if interrupted by a signal.
+int ringbuf_batch_poll(struct ringbuf_batch *rb, int timeout_ms);
+
+// Hand every committed record to the callback. Returns the number of
+// records consumed or the callback's error.
+int ringbuf_batch_consume(struct ringbuf_batch *rb);
+
+// Unconsumed data as a percentage of the ringbuf size
+double ringbuf_batch_fill_pct(const struct ringbuf_batch *rb);
+
+// Step through a run: returns the next record's payload and sets *size, or
+// NULL at the end. Records discarded by the BPF side are skipped.
+static inline const void *ringbuf_batch_next(const char **pos, const char *end,
+                                             __u32 *size) {
+    while (*pos < end) {
+        const char *hdr = *pos;
+        __u32 len = *(const __u32 *)hdr;
+
+        *pos += ((len & ~BPF_RINGBUF_DISCARD_BIT) + BPF_RINGBUF_HDR_SZ + 7) & ~7U;
+        if (!(len & BPF_RINGBUF_DISCARD_BIT)) {
+            *size = len;
+            return hdr + BPF_RINGBUF_HDR_SZ;
+        }
+    }
+    return NULL;
+}
+
+#endif // RINGBUF_BATCH_H
@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: GPL-2.0
+// Double-buffered streaming writer. Each stream (one per consumer) fills its
+// active chunk without locking; only swapping chunks takes the lock. Chunks
+// hold records of [u8 size][event bytes] exactly as the ring buffer delivered.
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "stream_writer.h"
+
+struct chunk {
+    unsigned char *data;
+    size_t used;
+    unsigned long events;
+    int stream;
+    int queued;  // Owned by the writer thread until it clears this (under lock)
+};
+
+struct stream_state {
+    struct chunk chunks[2];
+    int active;  // Chunk the consumer is filling
+};
+
+struct stream_writer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;  // Writer: a chunk was queued or stop requested
+    pthread_cond_t done;  // Consumers: a chunk was written and is free again
+
+    // FIFO of full chunks; at most two per stream are ever queued
+    struct chunk **queue;
+    int head, len, cap;
+
+    int stopping;
+    int err;  // First sink error; later chunks are discarded
+
+    stream_sink_fn sink;
+    void *ctx;
+    size_t chunk_bytes;
+    struct stream_writer_stats stats;
+
+    int nr_streams;
+    struct stream_state streams[];
+};
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Caller holds sw->lock
+static void enqueue_chunk(struct stream_writer *sw, struct chunk *c) {
+    c->queued = 1;
+    sw->queue[(sw->head + sw->len) % sw->cap] = c;
+    sw->len++;
+    pthread_cond_signal(&sw->work);
+}
+
+static int write_chunk(struct stream_writer *sw, const struct chunk *c) {
+    size_t off = 0;
+
+    while (off < c->used) {
+        size_t size = c->data[off];
+        int err = sw->sink(sw->ctx, c->stream, c->data + off + 1, size);
+        if (err)
+            return err;
+        off += 1 + size;
+    }
+    return 0;
+}
+
+static void *writer_main(void *arg) {
+    struct stream_writer *sw = arg;
+
+    pthread_mutex_lock(&sw->lock);
+    for (;;) {
+        while (sw->len == 0 && !sw->stopping)
+            pthread_cond_wait(&sw->work, &sw->lock);
+        if (sw->len == 0)
+            break;  // Stopping and fully drained
+
+        struct chunk *c = sw->queue[sw->head];
+        sw->head = (sw->head + 1) % sw->cap;
+        sw->len--;
+        int failed = sw->err;
+        pthread_mutex_unlock(&sw->lock);
+
+        // Only this thread sets err, so a failed writer just recycles chunks
+        int err = failed ? 0 : write_chunk(sw, c);
+
+        pthread_mutex_lock(&sw->lock);
+        if (err) {
+            sw->err = err;
+        } else if (!failed) {
+            sw->stats.events_written += c->events;
+            sw->stats.chunks_written++;
+        }
+        c->used = 0;
+        c->events = 0;
+        c->queued = 0;
+        pthread_cond_broadcast(&sw->done);
+    }
+    pthread_mutex_unlock(&sw->lock);
+    return NULL;
+}
+
+static void free_writer(struct stream_writer *sw) {
+    for (int i = 0; i < sw->nr_streams; i++) {
+        free(sw->streams[i].chunks[0].data);
+        free(sw->streams[i].chunks[1].data);
+    }
+    free(sw->queue);
+    free(sw);
+}
+
+struct stream_writer *stream_writer_start(int nr_streams, size_t chunk_bytes,
+                                          stream_sink_fn sink, void *ctx) {
+    struct stream_writer *sw;
+    int err;
+
+    sw = calloc(1, sizeof(*sw) + nr_streams * sizeof(struct stream_state));
+    if (!sw)
+        return NULL;
+
+    sw->nr_streams = nr_streams;
+    sw->chunk_bytes = chunk_bytes;
+    sw->sink = sink;
+    sw->ctx = ctx;
+    sw->cap = 2 * nr_streams;
+    sw->queue = calloc(sw->cap, sizeof(*sw->queue));
+    if (!sw->queue)
+        goto err_nomem;
+
+    for (int i = 0; i < nr_streams; i++) {
+        for (int j = 0; j < 2; j++) {
+            struct chunk *c = &sw->streams[i].chunks[j];
+            c->stream = i;
+            c->data = malloc(chunk_bytes);
+            if (!c->data)
+                goto err_nomem;
+        }
+    }
+
+    pthread_mutex_init(&sw->lock, NULL);
+    pthread_cond_init(&sw->work, NULL);
+    pthread_cond_init(&sw->done, NULL);
+
+    err = pthread_create(&sw->thread, NULL, writer_main, sw);
+    if (err) {
+        free_writer(sw);
+        errno = err;
+        return NULL;
+    }
+    return sw;
+
+err_nomem:
+    free_writer(sw);
+    errno = ENOMEM;
+    return NULL;
+}
+
+// Hand the active chunk to the writer and switch to the other one, waiting
+// for it if the writer has not caught up yet (backpressure).
+static int swap_chunks(struct stream_writer *sw, struct stream_state *st) {
+    struct chunk *next;
+    int err;
+
+    pthread_mutex_lock(&sw->lock);
+    enqueue_chunk(sw, &st->chunks[st->active]);
+    st->active ^= 1;
+    next = &st->chunks[st->active];
+
+    if (next->queued) {
+        unsigned long long start = now_ns();
+        while (next->queued)
+            pthread_cond_wait(&sw->done, &sw->lock);
+        sw->stats.stalls++;
+        sw->stats.stall_ns += now_ns() - start;
+    }
+    err = sw->err;
+    pthread_mutex_unlock(&sw->lock);
+    return err;
+}
+
+int stream_writer_append(struct stream_writer *sw, int stream,
+                         const void *data, size_t size) {
+    struct stream_state *st = &sw->streams[stream];
+    struct chunk *c = &st->chunks[st->active];
+
+    if (size > 255 || size + 1 > sw->chunk_bytes)
+        return -EINVAL;
+
+    if (c->used + 1 + size > sw->chunk_bytes) {
+        int err = swap_chunks(sw, st);
+        if (err)
+            return err;
+        c = &st->chunks[st->active];
+    }
+
+    c->data[c->used] = (unsigned char)size;
+    memcpy(c->data + c->used + 1, data, size);
+    c->used += 1 + size;
+    c->events++;
+    return 0;
+}
+
+int stream_writer_stop(struct stream_writer *sw, struct stream_writer_stats *stats) {
+    int err;
+
+    pthread_mutex_lock(&sw->lock);
+    for (int i = 0; i < sw->nr_streams; i++) {
+        struct chunk *c = &sw->streams[i].chunks[sw->streams[i].active];
+        if (c->used)
+            enqueue_chunk(sw, c);
+    }
+    sw->stopping = 1;
+    pthread_cond_signal(&sw->work);
+    pthread_mutex_unlock(&sw->lock);
+
+    pthread_join(sw->thread, NULL);
+
+    err = sw->err;
+    if (stats)
+        *stats = sw->stats;
+
+    pthread_cond_destroy(&sw->done);
+    pthread_cond_destroy(&sw->work);
+    pthread_mutex_destroy(&sw->lock);
+    free_writer(sw);
+    return err;
+}
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-2.0
+// Streaming capture: consumers append events into double-buffered chunks and
+// a background writer thread flushes full chunks through a sink. Memory use
+// is fixed (2 chunks per stream) and capture length is unbounded.
+#ifndef STREAM_WRITER_H
+#define STREAM_WRITER_H
+
+#include <stddef.h>
+
+// Called on the writer thread for every event, in append order per stream.
+// Returns 0 or a negative errno (which stops further writes).
+typedef int (*stream_sink_fn)(void *ctx, int stream, const void *data, size_t size);
+
+struct stream_writer_stats {
+    unsigned long long events_written;
+    unsigned long long chunks_written;
+    unsigned long long stalls;      // Appends that waited for the writer (backpressure)
+    unsigned long long stall_ns;    // Total time consumers spent waiting
+};
+
+struct stream_writer;
+
+// Start the writer thread. Each of nr_streams streams gets two chunks of
+// chunk_bytes. Returns NULL and sets errno on failure.
+struct stream_writer *stream_writer_start(int nr_streams, size_t chunk_bytes,
+                                          stream_sink_fn sink, void *ctx);
+
+// Append one event to a stream. A stream must only be appended to by one
+// thread. Blocks while both of the stream's chunks are queued for writing.
+// Returns 0, or the sink's error once the writer has failed.
+int stream_writer_append(struct stream_writer *sw, int stream,
+                         const void *data, size_t size);
+
+// Flush partially filled chunks, wait for the writer to drain and stop it.
+// Fills stats (if non-NULL) and frees the writer. Returns the first sink error.
+int stream_writer_stop(struct stream_writer *sw, struct stream_writer_stats *stats);
+
+#endif // STREAM_WRITER_H
@@ -0,0 +1,379 @@
+// SPDX-License-Identifier: GPL-2.0
+// Hand-rolled formatting for the text trace. Integers use a two-digit lookup
+// table; the double is printed like "%f" whenever its 6-decimal rounding can
+// be decided from x * 1e6 alone, and by snprintf otherwise (NaN, infinity,
+// huge values, or a product too close to a rounding boundary).
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <unistd.h>
+#include <linux/types.h>
+#include "mylib_tracer.h"
+#include "text_writer.h"
+#include "func_table.h"
+
+#define TEXT_BUF_SIZE (4 * 1024 * 1024)
+
+struct text_writer {
+    int fd;
+    char *buf;
+    size_t used;
+    unsigned long long bytes;  // Flushed so far
+};
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static char *put_str(char *p, const char *s, size_t len) {
+    memcpy(p, s, len);
+    return p + len;
+}
+
+#define PUT_LITERAL(p, s) put_str(p, s, sizeof(s) - 1)
+
+static int count_digits(__u64 v) {
+    int n = 1;
+
+    if (v <= 0xffffffffULL) {
+        __u32 v32 = v;
+
+        for (;;) {
+            if (v32 < 10) return n;
+            if (v32 < 100) return n + 1;
+            if (v32 < 1000) return n + 2;
+            if (v32 < 10000) return n + 3;
+            v32 /= 10000;
+            n += 4;
+        }
+    }
+    for (;;) {
+        if (v < 10) return n;
+        if (v < 100) return n + 1;
+        if (v < 1000) return n + 2;
+        if (v < 10000) return n + 3;
+        v /= 10000;
+        n += 4;
+    }
+}
+
+// Write v's digits backwards ending at end. 32-bit division is much cheaper
+// than 64-bit, so switch to it once the value fits.
+static void put_digits_rev(char *end, __u64 v) {
+    __u32 v32;
+
+    while (v > 0xffffffffULL) {
+        unsigned int pair = (v % 100) * 2;
+        v /= 100;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair];
+    }
+    v32 = v;
+    while (v32 >= 100) {
+        unsigned int pair = (v32 % 100) * 2;
+        v32 /= 100;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair];
+    }
+    if (v32 >= 10) {
+        *--end = digit_pairs[v32 * 2 + 1];
+        *--end = digit_pairs[v32 * 2];
+    } else {
+        *--end = '0' + v32;
+    }
+}
+
+// Decimal ("%lu")
+static char *put_u64(char *p, __u64 v) {
+    int n = count_digits(v);
+
+    put_digits_rev(p + n, v);
+    return p + n;
+}
+
+// Exactly width digits, zero-padded ("%09lu" of a value below 10^width)
+static char *put_u32_fixed(char *p, __u32 v, int width) {
+    char *end = p + width;
+
+    for (p = end; width >= 2; width -= 2) {
+        unsigned int pair = (v % 100) * 2;
+        v /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+    if (width)
+        *--p = '0' + v % 10;
+    return end;
+}
+
+static char *put_s32(char *p, __s32 v) {
+    if (v < 0) {
+        *p++ = '-';
+        return put_u64(p, -(__s64)v);
+    }
+    return put_u64(p, v);
+}
+
+static char *put_s64(char *p, __s64 v) {
+    if (v < 0) {
+        *p++ = '-';
+        return put_u64(p, -(__u64)v);
+    }
+    return put_u64(p, v);
+}
+
+// Lowercase hex without leading zeros ("%lx")
+static char *put_hex(char *p, __u64 v) {
+    static const char hex[] = "0123456789abcdef";
+    int n = v ? (64 - __builtin_clzll(v) + 3) / 4 : 1;
+    char *end = p + n;
+
+    while (n--) {
+        p[n] = hex[v & 0xf];
+        v >>= 4;
+    }
+    return end;
+}
+
+// "%f": six decimals, rounded to nearest
+static char *put_double(char *p, double x) {
+    double ax = fabs(x);
+
+    // Below 1e9 the scaled value stays under 2^50, so the product's error is
+    // at most half an ulp of it; outside that margin around .5 the rounding
+    // of the exact decimal value goes the same way
+    if (ax < 1e9) {
+        double scaled = ax * 1e6;
+        __u64 whole = (__u64)scaled;  // floor, without a libm call
+        double frac = scaled - (double)whole;
+        double margin = scaled * 0x1p-52;
+
+        if (fabs(frac - 0.5) > margin) {
+            __u64 r = whole + (frac > 0.5);
+
+            if (signbit(x))
+                *p++ = '-';
+            p = put_u64(p, r / 1000000);
+            *p++ = '.';
+            return put_u32_fixed(p, r % 1000000, 6);
+        }
+    }
+    return p + snprintf(p, TEXT_EVENT_MAX - 128, "%f", x);
+}
+
+// "[%lu.%09lu] "
+static char *put_timestamp(char *p, __u64 ts) {
+    *p++ = '[';
+    p = put_u64(p, ts / 1000000000);
+    *p++ = '.';
+    p = put_u32_fixed(p, ts % 1000000000, 9);
+    *p++ = ']';
+    *p++ = ' ';
+    return p;
+}
+
+// "arg1 = %d, arg2 = %lu, arg3 = %f, arg4 = 0x%lx }\n"
+static char *put_args(char *p, __s32 arg1, __u64 arg2, double arg3, __u64 arg4) {
+    p = PUT_LITERAL(p, "arg1 = ");
+    p = put_s32(p, arg1);
+    p = PUT_LITERAL(p, ", arg2 = ");
+    p = put_u64(p, arg2);
+    p = PUT_LITERAL(p, ", arg3 = ");
+    p = put_double(p, arg3);
+    p = PUT_LITERAL(p, ", arg4 = 0x");
+    p = put_hex(p, arg4);
+    return PUT_LITERAL(p, " }\n");
+}
+
+// --functions: one decoded argument or return value, "?" if not captured
+static char *put_arg(char *p, const struct arg_layout *a, __u64 reg) {
+    __u64 v = func_arg_value(a, reg);
+
+    p = put_str(p, a->name, strlen(a->name));
+    p = PUT_LITERAL(p, " = ");
+    if (a->reg < 0)
+        return PUT_LITERAL(p, "?");
+    switch (a->cls) {
+    case ARG_SIGNED:
+        return put_s64(p, (__s64)v);
+    case ARG_BOOL:
+        return v ? PUT_LITERAL(p, "true") : PUT_LITERAL(p, "false");
+    case ARG_HEX:
+        p = PUT_LITERAL(p, "0x");
+        return put_hex(p, v);
+    default:
+        return put_u64(p, v);
+    }
+}
+
+// "mylib:<function>_entry" / "_exit", or func_<id> for an unknown ID
+static char *put_func_event(char *p, const struct func_layout *f, __u32 func_id,
+                            const char *suffix, size_t suffix_len) {
+    p = PUT_LITERAL(p, "mylib:");
+    if (f) {
+        p = put_str(p, f->name, strlen(f->name));
+    } else {
+        p = PUT_LITERAL(p, "func_");
+        p = put_u64(p, func_id);
+    }
+    return put_str(p, suffix, suffix_len);
+}
+
+static char *put_call(char *p, const struct trace_event_call *e) {
+    const struct func_layout *f = func_table_lookup(e->func_id);
+
+    p = put_timestamp(p, e->timestamp);
+    p = put_func_event(p, f, e->func_id, "_entry", 6);
+    if (!f || f->nr_args == 0)
+        return PUT_LITERAL(p, "\n");
+    p = PUT_LITERAL(p, ": { ");
+    for (unsigned int i = 0; i < f->nr_args; i++) {
+        const struct arg_layout *a = &f->args[i];
+
+        if (i)
+            p = PUT_LITERAL(p, ", ");
+        p = put_arg(p, a, a->reg >= 0 ? e->regs[a->reg] : 0);
+    }
+    return PUT_LITERAL(p, " }\n");
+}
+
+static char *put_return(char *p, const struct trace_event_return *e) {
+    const struct func_layout *f = func_table_lookup(e->func_id);
+
+    p = put_timestamp(p, e->timestamp);
+    p = put_func_event(p, f, e->func_id, "_exit", 5);
+    if (!f || f->ret.cls == ARG_VOID)
+        return PUT_LITERAL(p, "\n");
+    p = PUT_LITERAL(p, ": { ");
+    p = put_arg(p, &f->ret, e->ret);
+    return PUT_LITERAL(p, " }\n");
+}
+
+size_t text_format_event(char *dst, const void *data, size_t size) {
+    char *p = dst;
+
+    if (size == sizeof(struct trace_event_entry)) {
+        const struct trace_event_entry *e = data;
+
+        p = put_timestamp(p, e->timestamp);
+        p = PUT_LITERAL(p, "mylib:my_traced_function_entry: { ");
+        p = put_args(p, e->arg1, e->arg2, e->arg3, e->arg4);
+    } else if (size == sizeof(struct trace_event_exit)) {
+        const struct trace_event_exit *e = data;
+
+        p = put_timestamp(p, e->timestamp);
+        p = PUT_LITERAL(p, "mylib:my_traced_function_exit\n");
+    } else if (size == sizeof(struct trace_event_span)) {
+        const struct trace_event_span *e = data;
+
+        p = put_timestamp(p, e->timestamp);
+        p = PUT_LITERAL(p, "mylib:my_traced_function: { duration_ns = ");
+        p = put_u64(p, e->duration_ns);
+        p = PUT_LITERAL(p, ", ");
+        p = put_args(p, e->arg1, e->arg2, e->arg3, e->arg4);
+    } else if (size == sizeof(struct trace_event_call)) {
+        p = put_call(p, data);
+    } else if (size == sizeof(struct trace_event_return)) {
+        p = put_return(p, data);
+    }
+    return p - dst;
+}
+
+struct text_writer *text_writer_open(const char *path) {
+    struct text_writer *w = calloc(1, sizeof(*w));
+
+    if (!w)
+        return NULL;
+    w->buf = malloc(TEXT_BUF_SIZE);
+    if (!w->buf) {
+        free(w);
+        errno = ENOMEM;
+        return NULL;
+    }
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (w->fd < 0) {
+        int err = errno;
+        free(w->buf);
+        free(w);
+        errno = err;
+        return NULL;
+    }
+    return w;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    size_t off = 0;
+
+    while (off < len) {
+        ssize_t n = write(fd, buf + off, len - off);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        off += n;
+    }
+    return 0;
+}
+
+static int flush_buf(struct text_writer *w) {
+    int err = write_all(w->fd, w->buf, w->used);
+
+    if (err)
+        return err;
+    w->bytes += w->used;
+    w->used = 0;
+    return 0;
+}
+
+int text_writer_write_event(struct text_writer *w, const void *data, size_t size) {
+    if (w->used + TEXT_EVENT_MAX > TEXT_BUF_SIZE) {
+        int err = flush_buf(w);
+        if (err)
+            return err;
+    }
+    w->used += text_format_event(w->buf + w->used, data, size);
+    return 0;
+}
+
+int text_writer_write(struct text_writer *w, const char *buf, size_t len) {
+    int err;
+
+    // Small pieces are coalesced; large ones go straight to write(2)
+    if (w->used + len <= TEXT_BUF_SIZE) {
+        memcpy(w->buf + w->used, buf, len);
+        w->used += len;
+        return 0;
+    }
+    err = flush_buf(w);
+    if (err)
+        return err;
+    err = write_all(w->fd, buf, len);
+    if (err)
+        return err;
+    w->bytes += len;
+    return 0;
+}
+
+int text_writer_close(struct text_writer *w, unsigned long long *bytes) {
+    int err = flush_buf(w);
+
+    if (close(w->fd) && !err)
+        err = -errno;
+    if (bytes)
+        *bytes = w->bytes + w->used;
+    free(w->buf);
+    free(w);
+    return err;
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-2.0
+// babeltrace-like text trace writer. Events are formatted by hand (no
+// printf) into a large buffer that is flushed with write(2). The output is
+// byte-identical to the fprintf formats it replaces.
+#ifndef TEXT_WRITER_H
+#define TEXT_WRITER_H
+
+#include <stddef.h>
+
+// Upper bound on the length of one formatted event line (a --functions call
+// with MAX_FUNC_ARGS long-named arguments is the longest)
+#define TEXT_EVENT_MAX 1024
+
+// Format one event as delivered by the ring buffer (entry, exit, span, call
+// or return, told apart by size) into dst, which must hold TEXT_EVENT_MAX
+// bytes. Call and return events are decoded with the installed func_table.
+// Returns the line length including '\n', or 0 for an unknown record.
+size_t text_format_event(char *dst, const void *data, size_t size);
+
+struct text_writer;
+
+// Create or truncate path. Returns NULL and sets errno on failure.
+struct text_writer *text_writer_open(const char *path);
+
+// Append one event. Returns 0 or a negative errno from write(2).
+int text_writer_write_event(struct text_writer *w, const void *data, size_t size);
+
+// Append already formatted text (e.g. lines built with text_format_event on
+// another thread). Returns 0 or a negative errno from write(2).
+int text_writer_write(struct text_writer *w, const char *buf, size_t len);
+
+// Flush, close and free the writer. If bytes is non-NULL it receives the
+// file size.
+int text_writer_close(struct text_writer *w, unsigned long long *bytes);
+
+#endif // TEXT_WRITER_H